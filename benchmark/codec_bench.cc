@@ -0,0 +1,107 @@
+#include "toolpex/buffer_codec.h"
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <functional>
+
+using namespace toolpex;
+
+namespace
+{
+
+struct payload
+{
+    const char* name;
+    ::std::string data;
+};
+
+::std::vector<payload> sample_payloads(size_t n)
+{
+    ::std::vector<payload> result;
+
+    ::std::string text;
+    for (int i{}; text.size() < n; ++i)
+    {
+        text += "{\"seq\":" + ::std::to_string(i)
+             +  ",\"op\":\"put\",\"key\":\"user:" + ::std::to_string(i % 1000)
+             +  "\",\"value\":\"" + ::std::string(i % 32, 'x') + "\"}\n";
+    }
+    text.resize(n);
+    result.push_back({ "log-like", ::std::move(text) });
+
+    ::std::mt19937_64 rng{ 42 };
+    ::std::string random(n, '\0');
+    for (auto& c : random) c = static_cast<char>(rng());
+    result.push_back({ "random", ::std::move(random) });
+
+    result.push_back({ "zeros", ::std::string(n, '\0') });
+    return result;
+}
+
+using codec_factory = ::std::function<::std::unique_ptr<buffer_codec>()>;
+
+void bench(const payload& p, const codec_factory& make_enc, const codec_factory& make_dec)
+{
+    using clock = ::std::chrono::steady_clock;
+    constexpr size_t block_size = 64 * 1024;
+    constexpr int rounds = 5;
+
+    auto enc = make_enc();
+    auto dec = make_dec();
+    double enc_seconds{}, dec_seconds{};
+    size_t packed_size{};
+
+    for (int r{}; r < rounds; ++r)
+    {
+        enc->reset();
+        dec->reset();
+        buffer plain{ block_size }, packed{ block_size }, result{ block_size };
+        plain.append(p.data);
+
+        const auto t0 = clock::now();
+        run_codec(*enc, plain, packed, true);
+        const auto t1 = clock::now();
+        packed_size = packed.readable_bytes();
+        run_codec(*dec, packed, result, true);
+        const auto t2 = clock::now();
+
+        if (result.readable_bytes() != p.data.size())
+        {
+            ::std::fprintf(stderr, "%s: round trip mismatch\n", enc->name().data());
+            return;
+        }
+        enc_seconds += ::std::chrono::duration<double>(t1 - t0).count();
+        dec_seconds += ::std::chrono::duration<double>(t2 - t1).count();
+    }
+
+    const double mb = static_cast<double>(p.data.size()) * rounds / (1024 * 1024);
+    ::std::printf("%-6s %-10s %10.1f MB/s %10.1f MB/s %8.3f\n",
+                  enc->name().data(), p.name,
+                  mb / enc_seconds, mb / dec_seconds,
+                  static_cast<double>(p.data.size()) / static_cast<double>(packed_size));
+}
+
+} // annoymous namespace
+
+int main()
+{
+    ::std::printf("%-6s %-10s %15s %15s %8s\n", "codec", "payload", "compress", "decompress", "ratio");
+    for (const auto& p : sample_payloads(32 * 1024 * 1024))
+    {
+        bench(p, []{ return ::std::make_unique<noop_codec>(); },
+                 []{ return ::std::make_unique<noop_codec>(); });
+#if defined(TOOLPEX_WITH_LZ4)
+        bench(p, []{ return ::std::make_unique<lz4_compressor>(); },
+                 []{ return ::std::make_unique<lz4_decompressor>(); });
+#endif
+#if defined(TOOLPEX_WITH_ZSTD)
+        bench(p, []{ return ::std::make_unique<zstd_compressor>(); },
+                 []{ return ::std::make_unique<zstd_decompressor>(); });
+#endif
+    }
+    return 0;
+}
@@ -0,0 +1,192 @@
+// This file is part of Toolpex
+// https://github.com/JPewterschmidt/toolpex
+//
+// Copyleft 2023 - 2024, ShiXin Wang. All wrongs reserved.
+
+#ifndef TOOLPEX_BLOCK_CACHE_H
+#define TOOLPEX_BLOCK_CACHE_H
+
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <list>
+#include <span>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/types.h>
+
+#include "toolpex/macros.h"
+#include "toolpex/lru_cache.h"
+#include "toolpex/page_pool.h"
+
+TOOLPEX_NAMESPACE_BEG
+
+/*! \brief  Identifies a block by the file it belongs to and its offset in that file. */
+struct block_cache_key
+{
+    uint64_t file_id{};
+    uint64_t offset{};
+
+    bool operator==(const block_cache_key&) const noexcept = default;
+};
+
+struct block_cache_key_hash
+{
+    size_t operator()(const block_cache_key& k) const noexcept;
+};
+
+/*! \brief  A sharded LRU cache of file blocks, each block lives in a page of a `page_pool`.
+ *
+ *  The capacity is in bytes, all of it is preallocated as the page pool,
+ *  so a block costs exactly one page no matter how short it is,
+ *  and blocks longer than a page could not be cached.
+ *  Lookups return `pinned_page`s, a pinned block will not be evicted,
+ *  and its page stays valid even if the block got erased, until the last pin released.
+ *  Each shard has its own lock, LRU list and `lru_cache_stats`.
+ *
+ *  \attention  All the pins have to be released before the cache destructed.
+ */
+class block_cache
+{
+public:
+    using page_type = page_pool::page_type;
+
+private:
+    struct entry
+    {
+        block_cache_key key;
+        page_type page;
+
+        // Read through to the end of file, the only case a block is shorter than requested.
+        bool at_eof{};
+    };
+
+public:
+    /*! \brief  A block pinned in the cache, or nothing. */
+    class pinned_page
+    {
+    public:
+        pinned_page() noexcept = default;
+
+        explicit operator bool() const noexcept { return !!m_entry; }
+        const block_cache_key& key() const noexcept { return m_entry->key; }
+        const page_type& page() const noexcept { return m_entry->page; }
+        ::std::span<const ::std::byte> bytes() const noexcept { return m_entry->page.readable(); }
+
+        /// @return Whether `read_through()` hit the end of file reading this block.
+        bool at_eof() const noexcept { return m_entry->at_eof; }
+
+    private:
+        friend class block_cache;
+        explicit pinned_page(::std::shared_ptr<const entry> e) noexcept : m_entry{ ::std::move(e) } {}
+
+        ::std::shared_ptr<const entry> m_entry;
+    };
+
+public:
+    /*! \param  capacity_bytes  Rounded down to a multiple of `page_size`, at least one page.
+     *  \param  page_size       A multiple of the system page size, also the largest block could be cached.
+     *  \param  nshards         Rounded up to a power of 2.
+     *  \param  lock_memory     `mlock` the page pool.
+     */
+    block_cache(size_t capacity_bytes,
+                size_t page_size = 64 * 1024,
+                size_t nshards = 16,
+                bool lock_memory = false);
+
+    ~block_cache() noexcept = default;
+
+    block_cache(const block_cache&) = delete;
+    block_cache& operator=(const block_cache&) = delete;
+
+    /*! \return A pin of the block, or an empty one if it's not cached. */
+    pinned_page get(const block_cache_key& key) { return lookup(key, 0); }
+
+    /*! \brief  Take a page for a new block, evicts the least recently used unpinned blocks if necessary.
+     *  \throw  `std::bad_alloc` if every page is pinned.
+     */
+    page_type acquire_page();
+
+    /*! \brief  Cache `page` as the block `key`, which is a page from `acquire_page()`.
+     *  \return A pin of the block, the one already cached if someone inserted `key` first.
+     */
+    pinned_page insert(const block_cache_key& key, page_type page)
+    {
+        return install(key, ::std::move(page), false, 0);
+    }
+
+    /*! \brief  Get the block of `len` bytes at `offset` of the file,
+     *          `pread()` it into a page from the pool on miss.
+     *          A block may be shorter than `len` only at the end of the file,
+     *          a cached block shorter than `len` otherwise is read again and replaced,
+     *          and a cached block longer than `len` is returned as is.
+     *  \param  file_id Any id unique to the file, like `file_id_of(fd)`.
+     *  \throw  `std::invalid_argument` if `len` exceeds the page size,
+     *          `toolpex::posix_exception` if `pread()` failed,
+     *          `std::bad_alloc` if every page is pinned.
+     */
+    pinned_page read_through(uint64_t file_id, int fd, off_t offset, size_t len);
+
+    /*! \brief  `read_through()` with `file_id_of(fd)`, which costs an `fstat()` per call. */
+    pinned_page read_through(int fd, off_t offset, size_t len)
+    {
+        return read_through(file_id_of(fd), fd, offset, len);
+    }
+
+    /*! \return Whether the block was cached. A pinned block stays valid for the pins. */
+    bool erase(const block_cache_key& key);
+
+    /*! \brief  Erase all the blocks of a file, e.g. after it was deleted by compaction.
+     *  \return Number of blocks erased.
+     */
+    size_t erase_file(uint64_t file_id);
+
+    /*! \return An id of the file from its device and inode numbers, survives `fd` reuse. */
+    static uint64_t file_id_of(int fd);
+
+    size_t page_size() const noexcept { return m_pool.page_size(); }
+    size_t capacity_bytes() const noexcept { return m_pool.capacity() * m_pool.page_size(); }
+
+    /*! \return Bytes of the pages in use, including the pinned ones which had been erased. */
+    size_t size_bytes() const noexcept { return m_pool.in_use() * m_pool.page_size(); }
+
+    /*! \return Number of blocks cached. */
+    size_t size() const noexcept { return m_size.load(::std::memory_order_relaxed); }
+
+    size_t shards() const noexcept { return m_nshards; }
+
+    /*! \return Sum of the stats of all the shards. */
+    lru_cache_stats stats() const noexcept;
+
+private:
+    using lru_list = ::std::list<::std::shared_ptr<const entry>>;
+
+    struct alignas(64) shard
+    {
+        ::std::mutex lock;
+        lru_list lru;
+        ::std::unordered_map<block_cache_key, lru_list::iterator, block_cache_key_hash> index;
+        lru_cache_stats stats;
+    };
+
+    shard& shard_of(const block_cache_key& key) noexcept;
+
+    // A cached block shorter than `at_least` and not at the end of file is taken as a miss.
+    pinned_page lookup(const block_cache_key& key, size_t at_least);
+    pinned_page install(const block_cache_key& key, page_type page, bool at_eof, size_t at_least);
+    bool evict_one(shard& s);
+
+private:
+    // Declared first, destructed last, after all the shards gave their pages back.
+    page_pool m_pool;
+    size_t m_nshards{};
+    ::std::unique_ptr<shard[]> m_shards;
+    ::std::atomic_size_t m_size{};
+    ::std::atomic_size_t m_next_victim{};
+};
+
+TOOLPEX_NAMESPACE_END
+
+#endif
@@ -7,19 +7,35 @@
 #include <cstddef>
 #include <ranges>
 #include <variant>
+#include <vector>
+#include <deque>
+#include <optional>
+#include <climits>
+#include <atomic>
+#include <sys/uio.h>
+#include <sys/types.h>
 #include "toolpex/assert.h"
 
 namespace toolpex
 {
 
+class buffer_reader;
+
 class buffer_block
 {
 public:
     constexpr static size_t alignment = alignof(::std::max_align_t);
 
 public:
+    /**
+     * @param pmr   `nullptr` means `buffer_block_pool::default_pool()`.
+     * @param align Alignment of the storage, the capacity is rounded up to a multiple of it.
+     *              Like 512 or 4096 for `O_DIRECT` I/O.
+     * @throw `std::invalid_argument` if `align` is not a power of 2.
+     */
     buffer_block(size_t block_capa = 4096, 
-                 ::std::pmr::memory_resource* pmr = nullptr);
+                 ::std::pmr::memory_resource* pmr = nullptr, 
+                 size_t align = alignment);
 
     buffer_block(buffer_block&& other) noexcept;
     buffer_block& operator=(buffer_block&& other) noexcept;
@@ -28,21 +44,142 @@ public:
 
     size_t capacity() const noexcept { return m_block_capacity; }
     size_t size() const noexcept { return m_size; }
-    size_t left() const noexcept { return capacity() - size(); }
+    size_t storage_alignment() const noexcept { return m_alignment; }
+    ::std::pmr::memory_resource* resource() const noexcept { return m_pmr; }
+
+    /// A shared or read only block has nothing left to write.
+    size_t left() const noexcept { return shared() || m_read_only ? 0 : capacity() - size(); }
 
     void release() noexcept;
 
-    operator ::std::span<::std::byte> () noexcept;
+    /**
+     * @brief   Take the ownership of `storage` which was allocated from `pmr`,
+     *          the first `size` bytes of it are valid.
+     *          It will be given back by `pmr->deallocate(storage, capacity)`.
+     */
+    static buffer_block adopt(::std::pmr::memory_resource* pmr, ::std::byte* storage, 
+                              size_t capacity, size_t size) noexcept
+    {
+        return { pmr, nullptr, storage, capacity, size };
+    }
+
+    /**
+     * @brief   Like `adopt()`, but the storage must never be written, like a `PROT_READ` mapping.
+     *          Mutable access copies the bytes into a block of the default pool like `unshare()`,
+     *          `pmr` only has to deallocate.
+     */
+    static buffer_block adopt_read_only(::std::pmr::memory_resource* pmr, ::std::byte* storage, 
+                                        size_t size) noexcept
+    {
+        buffer_block result{ pmr, nullptr, storage, size, size };
+        result.m_read_only = true;
+        return result;
+    }
+
+    /**
+     * @brief   Make a block refers `len` bytes of the file `fd` start from `offset`, 
+     *          instead of holding the bytes.
+     *          `buffer::write_to()` sends it by `sendfile()` / `splice()`, 
+     *          no byte goes through the user space.
+     *          Other accesses to the bytes map that range of the file on demand.
+     *          The block is read only, mutable access copies it into memory like `unshare()`.
+     * @attention   The `fd` is not owned by the block, it has to stay open until the block released.
+     *              The file must not be truncated below `offset + len` meanwhile, 
+     *              touching the mapped bytes beyond the end of file raises `SIGBUS`.
+     */
+    static buffer_block file_segment(int fd, off_t offset, size_t len);
+
+    bool is_file_segment() const noexcept { return m_segment != nullptr; }
+
+    /**
+     * @brief   Send `len` bytes of a file segment start from `offset` of it to `out_fd`, 
+     *          by `sendfile()`. If `sendfile()` refused the fds, by `splice()` when `out_fd` is a pipe, 
+     *          or by `write()` from the mapping of the segment, like for an `O_APPEND` file.
+     * @return  Like `sendfile()`, -1 with `errno` set on error, `EINTR` is retried.
+     */
+    ssize_t send_to(int out_fd, size_t offset, size_t len) const noexcept;
+
+    /// @brief  Forget the valid bytes but keep the storage, so it could be written again.
+    void clear() noexcept { toolpex_assert(!is_file_segment()); m_size = 0; }
+
+    /// @brief  Drop the first `n` valid bytes without moving the others, the storage becomes shared.
+    void remove_prefix(size_t n);
+
+    /// @brief  Drop the last `n` valid bytes.
+    void remove_suffix(size_t n) noexcept { toolpex_assert(n <= m_size); m_size -= n; }
+
+    /**
+     * @brief   Make a block refers `len` valid bytes of this block start from `offset`, 
+     *          without copying, the storage is reference counted from now on.
+     *          Both blocks are read only as long as the storage is shared.
+     */
+    buffer_block share(size_t offset, size_t len) const;
+
+    /// @return Whether the storage is referred by other blocks too.
+    bool shared() const noexcept 
+    { 
+        const auto* s = m_shared.load(::std::memory_order_acquire);
+        return s && s->refs.load(::std::memory_order_acquire) > 1; 
+    }
+
+    /**
+     * @brief   Copy on write, give this block its own storage if it's shared, read only or a file segment.
+     * @throw   `toolpex::posix_exception` if a file segment could not be mapped.
+     */
+    void unshare();
+
+    /// Mutable access to a shared block will `unshare()` it first.
+    operator ::std::span<::std::byte> ();
+
+    /// A file segment which could not be mapped gives an empty span.
     operator ::std::span<const ::std::byte> () const noexcept;
 
     ::std::span<::std::byte> writable_span() noexcept;
     
     bool commit_write(size_t bytes) noexcept;
 
-    ::std::span<::std::byte> valid_span() noexcept;
+    /// Mutable access to a shared block will `unshare()` it first.
+    ::std::span<::std::byte> valid_span();
+
+    /// A file segment which could not be mapped gives an empty span.
     ::std::span<const ::std::byte> valid_span() const noexcept;
 
+    /**
+     * @brief   Like the const `valid_span()`, but a file segment which could not be mapped,
+     *          like one on a pipe or a socket, is an error instead of an empty span.
+     * @throw   `toolpex::posix_exception` if a file segment could not be mapped.
+     */
+    ::std::span<const ::std::byte> mapped_span() const;
+
 private:
+    // Allocated on the first `share()`, not from the block's memory resource, 
+    // which may serve only fixed size blocks.
+    struct shared_storage
+    {
+        ::std::atomic_size_t refs{ 1 };
+        ::std::byte* base{};
+        size_t capacity{};
+        size_t alignment{};
+    };
+
+    // The mapping is created by the first access to the bytes, 
+    // a block only sent by `send_to()` by `sendfile()` or `splice()` never maps anything.
+    // Pages beyond the end of a truncated file fault with `SIGBUS` when touched.
+    // Mapped by readers of a const block too, so the mapping is installed by a CAS.
+    struct segment_info
+    {
+        int fd{ -1 };
+        off_t offset{};
+        size_t map_len{};
+        ::std::atomic<void*> map_base{};
+
+        const ::std::byte* map(size_t len) noexcept;
+    };
+
+    buffer_block(::std::pmr::memory_resource* pmr, shared_storage* shared, 
+                 ::std::byte* storage, size_t capa, size_t size, 
+                 size_t align = alignment) noexcept;
+
     ::std::byte* cursor() noexcept;
     bool fit(size_t nbytes_wanna_write) const noexcept;
 
@@ -51,6 +188,10 @@ private:
     size_t m_block_capacity{};
     size_t m_size{};
     ::std::byte* m_storage{};
+    mutable ::std::atomic<shared_storage*> m_shared{};
+    segment_info* m_segment{};
+    size_t m_alignment{ alignment };
+    bool m_read_only{};
 };
 
 class buffer
@@ -62,8 +203,21 @@ public:
         "Alignment of buffer_block has to equvalent to the max_align_t");
 
 public:
+    /**
+     * @param pmr           `nullptr` means `buffer_block_pool::default_pool()`, which recycles blocks.
+     * @param block_align   Alignment of the blocks allocated by this buffer, see `buffer_block`.
+     *                      With 512 or 4096, the buffer could be written to an `O_DIRECT` file
+     *                      by `write_to()`, as long as every block is read from its beginning 
+     *                      and ends at a multiple of the alignment.
+     *                      `writable_span(at_least)` moves on to a new block
+     *                      leaving the current one partly filled, so pad it by `pad_to_alignment()` 
+     *                      before asking for more than it has left, and pad the last one too.
+     * @throw   `std::invalid_argument` if `block_align` is not a power of 2, 
+     *          or less than `alignof(std::max_align_t)`.
+     */
     buffer(size_t block_capacity = 4096, 
-           ::std::pmr::memory_resource* pmr = nullptr) noexcept;
+           ::std::pmr::memory_resource* pmr = nullptr, 
+           size_t block_align = alignment);
     
     buffer(buffer&& other) noexcept;
     buffer& operator=(buffer&& other) noexcept;
@@ -79,21 +233,85 @@ public:
         return this->append_bytes(::std::as_bytes(stuff));
     }
 
+    /**
+     * @brief   The free tail of the current block, 
+     *          a new block is started only if it's shorter than `at_least`, or empty.
+     */
     ::std::span<::std::byte> writable_span(size_t at_least = 0);
     bool commit_write(size_t nbytes_wrote) noexcept;
 
+    size_t block_alignment() const noexcept { return m_alignment; }
+
+    /// @return Bytes to append to make the size of the current block a multiple of `block_alignment()`.
+    size_t padding_needed() const noexcept;
+
+    /**
+     * @brief   Fill the current block with `fill` up to the next multiple of `block_alignment()`,
+     *          the padding is committed as written.
+     * @return  `false` if the current block has no room for the padding, 
+     *          which happens only to blocks added by `append_block()`.
+     */
+    bool pad_to_alignment(::std::byte fill = {}) noexcept;
+
+    /// @brief  `commit_write()` then `pad_to_alignment()`.
+    bool commit_write_padded(size_t nbytes_wrote, ::std::byte fill = {}) noexcept
+    {
+        return commit_write(nbytes_wrote) && pad_to_alignment(fill);
+    }
+
     ::std::span<const ::std::byte> next_readable_span() const noexcept;
-    bool commit_read(size_t nbytes_read) noexcept { return commit_read_impl(nbytes_read, false); }
-    bool commit_remove_after_read(size_t nbytes_read) noexcept { return commit_read_impl(nbytes_read, true); }
+
+    /**
+     * @brief   Move the reading position forward, across blocks if necessary, 
+     *          like by an offset returned by `find()`.
+     * @return  false if there're less than `nbytes_read` unread bytes, nothing committed then.
+     */
+    bool commit_read(size_t nbytes_read) noexcept { return commit_read_across_blocks(nbytes_read, false); }
+
+    /// @brief  `commit_read()`, and release the blocks read through.
+    bool commit_remove_after_read(size_t nbytes_read) noexcept { return commit_read_across_blocks(nbytes_read, true); }
     void reset_reading_info() noexcept;
 
     size_t current_block_left() const noexcept; 
     size_t current_block_capacity() const noexcept;
     size_t new_block_capacity() const noexcept { return m_newblock_capa; }
-    size_t total_nbytes_allocated() const noexcept;
-    size_t total_nbytes_valid() const noexcept;
+
+    // All the `total_nbytes_*()` and `readable_bytes()` are O(1), 
+    // they are maintained as running counters.
+
+    /// @return Sum of the capacity of blocks not released yet.
+    size_t total_nbytes_allocated() const noexcept { return m_nbytes_allocated; }
+
+    /// @return Bytes written and not released yet, including those already read.
+    size_t total_nbytes_valid() const noexcept { return m_nbytes_written - m_nbytes_released; }
+
+    /// @return Bytes ever committed by `commit_write()` or `append()`.
+    size_t total_nbytes_written() const noexcept { return m_nbytes_written; }
+
+    /// @return Bytes committed as read since construction or the last `reset_reading_info()`.
+    size_t total_nbytes_read() const noexcept { return m_nbytes_read; }
+
+    /// @return Valid bytes of the blocks released by `commit_remove_after_read()`.
+    size_t total_nbytes_released() const noexcept { return m_nbytes_released; }
+
+    /// @return Bytes written but not read yet.
+    size_t readable_bytes() const noexcept { return m_nbytes_written - m_nbytes_read; }
+
     bool empty() const noexcept;
 
+    /**
+     * @brief   Search the unread bytes, a pattern may straddle blocks.
+     *          Scans with AVX2 or SSE2 on x86-64, a scalar loop elsewhere.
+     * @return  The offset from the reading position, `std::nullopt` if not found.
+     * @throw   `toolpex::posix_exception` if a file segment could not be mapped.
+     */
+    ::std::optional<size_t> find(::std::byte b) const;
+    ::std::optional<size_t> find(::std::span<const ::std::byte> pattern) const;
+    ::std::optional<size_t> find(::std::string_view pattern) const
+    {
+        return find(::std::as_bytes(::std::span{ pattern }));
+    }
+
     const auto& blocks() const noexcept { return m_blocks; }
     const auto& last_block() const noexcept
     {
@@ -113,23 +331,141 @@ public:
         return blocks_valid_span() | rv::join;
     }
 
+    /**
+     * @brief   Duplicate all the valid bytes of this buffer without copying, 
+     *          the blocks are shared, and get copied only when someone writes to them.
+     *          Several threads could `dup()` or `slice()` the same const buffer concurrently.
+     * @param   pmr     Where the new blocks of the result come from.
+     */
     buffer dup(::std::pmr::memory_resource* pmr = nullptr) const;
 
+    /**
+     * @brief   Append a block as is without copying, the following writes go to new blocks
+     *          unless the block has room left.
+     */
+    void append_block(buffer_block blk);
+
+    /**
+     * @brief   Append `len` bytes of the file `fd` start from `offset` without reading them, 
+     *          see `buffer_block::file_segment()`.
+     *          A header appended before and a trailer after are written in order by `write_to()`.
+     * @attention   The `fd` has to stay open until the segment released, 
+     *              and the file must not be truncated below `offset + len` meanwhile, 
+     *              reading the bytes mapped beyond the end of file raises `SIGBUS`.
+     */
+    void append_file_segment(int fd, off_t offset, size_t len);
+
+    /**
+     * @brief   Make a buffer of `len` unread bytes start from `offset` after the reading position, 
+     *          shares the blocks with this buffer like `dup()` does.
+     * @throw   `std::out_of_range` if there're less than `offset + len` unread bytes.
+     */
+    buffer slice(size_t offset, size_t len) const;
+
+    /**
+     * @brief   Describe the unread bytes as an `iovec` array, for `writev()` / `sendmsg()`.
+     * @param   max_iovecs  At most this number of `iovec`s will be returned.
+     * @warning The `iovec`s refer the blocks directly, 
+     *          they are invalidated by anything which adds or releases blocks.
+     * @throw   `toolpex::posix_exception` if a file segment could not be mapped.
+     */
+    ::std::vector<::iovec> as_iovecs(size_t max_iovecs = IOV_MAX) const;
+
+    /**
+     * @brief   `readv()` from `fd` into the buffer once, and commit the bytes read.
+     *          A `unique_posix_fd` converts to `int` implicitly.
+     * @return  The number of bytes read, 0 means EOF, 
+     *          -1 means the `fd` is non-blocking and there's no data for now (errno is `EAGAIN`).
+     * @throw   `toolpex::posix_exception` on other errors.
+     */
+    ssize_t read_from(int fd);
+
+    /**
+     * @brief   `writev()` the unread bytes to `fd` until all of them are written 
+     *          or the `fd` would block, every byte written will be committed as read.
+     *          File segments go by `sendfile()` / `splice()` between the `writev()`s.
+     * @param   remove_after_read   Release the blocks once they are completely written.
+     * @return  The number of bytes written, it could be less than what is readable 
+     *          if the `fd` is non-blocking and would block.
+     * @throw   `toolpex::posix_exception` on errors other than `EAGAIN`, 
+     *          `std::runtime_error` if a file segment is beyond the end of its file.
+     */
+    size_t write_to(int fd, bool remove_after_read = true);
+
+    /**
+     * @brief   Make the first `n` unread bytes contiguous, 
+     *          only the bytes not in the first readable block are moved, 
+     *          together with the unread bytes of the first block, into one new block.
+     * @return  The `n` bytes, which are also the beginning of `next_readable_span()` now.
+     * @throw   `std::out_of_range` if there're less than `n` unread bytes,
+     *          `toolpex::posix_exception` if a file segment could not be mapped,
+     *          the buffer is left untouched then.
+     */
+    ::std::span<const ::std::byte> linearize(size_t n);
+
+    /**
+     * @brief   Copy the unread bytes into a buffer of exactly one block.
+     * @param   pmr     `nullptr` means the memory resource of this buffer.
+     * @throw   `toolpex::posix_exception` if a file segment could not be mapped.
+     */
+    buffer flatten(::std::pmr::memory_resource* pmr = nullptr) const;
+
+    /**
+     * @brief   Move the unread bytes into a single fresh block and drop all the others,
+     *          if there're no more than `max_fragment` of them.
+     *          Useful to a long-lived connection which keeps a small partial frame 
+     *          at the tail of a large, mostly consumed block.
+     *          The bytes already read are gone after compaction, 
+     *          just like they were read by `commit_remove_after_read()`.
+     * @return  Whether the compaction happened.
+     * @throw   `toolpex::posix_exception` if a file segment could not be mapped,
+     *          the buffer is left untouched then.
+     */
+    bool compact(size_t max_fragment);
+
 private:
+    friend class buffer_reader;
+
     void reset() noexcept;
     bool append_bytes(::std::span<const ::std::byte> bytes);
     bool commit_read_impl(size_t nbytes_read, bool remove_after_read = false) noexcept;
-    bool has_no_remove_after_read() const noexcept;
+    bool commit_read_across_blocks(size_t nbytes_read, bool remove_after_read) noexcept;
+    ::std::vector<::iovec> memory_iovecs(size_t max_iovecs, bool stop_at_file_segment) const;
+    void advance_reading_block(bool remove_after_read) noexcept;
+    void leave_current_block() noexcept;
+    bool has_no_remove_after_read() const noexcept { return m_nblocks_released == 0; }
+    buffer_block& new_block(size_t capacity);
+    void release_block(buffer_block& blk) noexcept;
+    ::std::optional<size_t> find_from(size_t idx, size_t offset, size_t limit, 
+                                      ::std::span<const ::std::byte> pattern) const;
+    bool equal_at(size_t idx, size_t offset, ::std::span<const ::std::byte> pattern) const;
+    ::std::byte* copy_readable_to(::std::byte* out) const;
+    void pop_released_blocks() noexcept;
 
 private:
     ::std::pmr::memory_resource* m_pmr{};
-    ::std::vector<buffer_block> m_blocks;
+
+    // Fully read blocks are popped from the front once released, 
+    // `m_current_block` stays valid since a deque never relocates its elements on push or pop at both ends.
+    ::std::deque<buffer_block> m_blocks;
+
+    // The last released block, which will be reused by the next `new_block()` if large enough,
+    // so a streaming connection writes and releases blocks without touching the memory resource.
+    ::std::optional<buffer_block> m_spare;
 
     size_t m_newblock_capa{};
+    size_t m_alignment{ alignment };
     buffer_block* m_current_block{};
 
     size_t m_current_reading_block_idx{};
     size_t m_current_block_readed_nbytes{};
+    bool m_pending_remove_after_read{};
+
+    size_t m_nbytes_allocated{};
+    size_t m_nbytes_written{};
+    size_t m_nbytes_read{};
+    size_t m_nbytes_released{};
+    size_t m_nblocks_released{};
 };
 
 /**
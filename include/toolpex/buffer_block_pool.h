@@ -0,0 +1,88 @@
+#ifndef TOOLPEX_BUFFER_BLOCK_POOL_H
+#define TOOLPEX_BUFFER_BLOCK_POOL_H
+
+#include <memory_resource>
+#include <cstddef>
+#include <memory>
+
+namespace toolpex
+{
+
+/**
+ *  @class  buffer_block_pool
+ *  @brief  A `memory_resource` recycles blocks of common sizes,
+ *          the default memory resource of `buffer` and `buffer_block`.
+ *
+ *  Requests are rounded up to power-of-two size classes
+ *  from `min_class_size` to `max_class_size`.
+ *  Freed blocks go to a free list of the calling thread first,
+ *  which takes no lock at all. When a thread caches too many blocks of a class,
+ *  half of them will be moved to a global overflow list,
+ *  where other threads could pick them up before asking the upstream resource.
+ *  A global list keeps at most about `global_cache_bytes_per_class` bytes,
+ *  the blocks beyond that go back to the upstream resource,
+ *  so a burst of traffic doesn't pin its peak memory forever.
+ *  So a steady-state connection which keeps allocating and releasing blocks
+ *  does no call to the upstream resource.
+ *
+ *  Requests larger than `max_class_size`, or with an alignment stricter than
+ *  `alignof(::std::max_align_t)` go to the upstream resource directly.
+ *
+ *  @attention  After the pool was destructed, blocks cached by other threads stay there
+ *              until the thread exits or starts using another pool,
+ *              so the upstream resource has to outlive all those threads.
+ *              The default upstream `::std::pmr::new_delete_resource()` always does.
+ */
+class buffer_block_pool : public ::std::pmr::memory_resource
+{
+public:
+    static constexpr size_t min_class_size = 64;
+    static constexpr size_t max_class_size = 64 * 1024;
+    static constexpr size_t num_classes = 11;
+    static constexpr size_t thread_cache_bytes_per_class = 256 * 1024;
+    static constexpr size_t global_cache_bytes_per_class = 4 * thread_cache_bytes_per_class;
+
+    static_assert((min_class_size << (num_classes - 1)) == max_class_size);
+
+public:
+    explicit buffer_block_pool(::std::pmr::memory_resource* upstream = nullptr);
+    ~buffer_block_pool() noexcept override;
+
+    buffer_block_pool(const buffer_block_pool&) = delete;
+    buffer_block_pool& operator=(const buffer_block_pool&) = delete;
+
+    /**
+     * @brief The process wide pool used by `buffer` when no memory resource specified.
+     *        It will never be destructed.
+     */
+    static buffer_block_pool& default_pool() noexcept;
+
+    /**
+     * @brief Give the blocks in the global overflow lists and
+     *        the free lists of the calling thread back to the upstream resource.
+     */
+    void release() noexcept;
+
+    /// @brief Number of allocations forwarded to the upstream resource.
+    size_t upstream_allocations() const noexcept;
+
+    ::std::pmr::memory_resource* upstream_resource() const noexcept;
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const ::std::pmr::memory_resource& other) const noexcept override;
+
+private:
+    struct shared_state;
+    struct thread_cache;
+
+    thread_cache* local_cache(bool create = true) const;
+
+private:
+    ::std::shared_ptr<shared_state> m_state;
+};
+
+} // namespace toolpex
+
+#endif
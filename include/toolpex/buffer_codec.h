@@ -0,0 +1,170 @@
+#ifndef TOOLPEX_BUFFER_CODEC_H
+#define TOOLPEX_BUFFER_CODEC_H
+
+#include <span>
+#include <vector>
+#include <cstddef>
+#include <string_view>
+
+#include "toolpex/buffer.h"
+
+#if defined(TOOLPEX_WITH_LZ4)
+struct LZ4F_cctx_s;
+struct LZ4F_dctx_s;
+#endif
+
+#if defined(TOOLPEX_WITH_ZSTD)
+struct ZSTD_CCtx_s;
+struct ZSTD_DCtx_s;
+#endif
+
+namespace toolpex
+{
+
+struct codec_step
+{
+    size_t consumed{};
+    size_t produced{};
+    bool finished{};
+};
+
+/**
+ *  @class  buffer_codec
+ *  @brief  A streaming transformation stage, like a compressor or a decompressor,
+ *          driven by `run_codec()`.
+ *
+ *  `process()` consumes some of `in`, produces some of `out`, and keeps its own state between calls.
+ *  It must make progress whenever `out` has at least `min_output_span()` bytes,
+ *  unless it needs more input.
+ */
+class buffer_codec
+{
+public:
+    virtual ~buffer_codec() noexcept = default;
+
+    /**
+     * @param   finish  There's no more input after `in`,
+     *                  keep calling with `finish` until `finished` is reported.
+     * @throw   `std::runtime_error` on corrupted or truncated input.
+     */
+    virtual codec_step process(::std::span<const ::std::byte> in,
+                               ::std::span<::std::byte> out,
+                               bool finish) = 0;
+
+    /// @brief  Forget the current stream, be ready for a new one.
+    virtual void reset() = 0;
+
+    virtual size_t min_output_span() const noexcept { return 1; }
+    virtual ::std::string_view name() const noexcept = 0;
+};
+
+/**
+ * @brief   Feed the unread bytes of `in` through `c`, the output goes to `out.writable_span()`.
+ *          Input blocks are released once consumed, so a long stream runs in bounded memory.
+ * @param   finish  `in` holds the end of the stream, flush everything out of the codec.
+ * @return  The number of bytes written to `out`.
+ */
+size_t run_codec(buffer_codec& c, buffer& in, buffer& out, bool finish = false);
+
+/// Copies the bytes as they are, as a baseline or a placeholder.
+class noop_codec final : public buffer_codec
+{
+public:
+    codec_step process(::std::span<const ::std::byte> in,
+                       ::std::span<::std::byte> out,
+                       bool finish) override;
+    void reset() override {}
+    ::std::string_view name() const noexcept override { return "noop"; }
+};
+
+#if defined(TOOLPEX_WITH_LZ4)
+
+/// LZ4 frame format, readable by the `lz4` command line tool.
+class lz4_compressor final : public buffer_codec
+{
+public:
+    lz4_compressor();
+    ~lz4_compressor() noexcept override;
+
+    codec_step process(::std::span<const ::std::byte> in,
+                       ::std::span<::std::byte> out,
+                       bool finish) override;
+    void reset() override;
+    ::std::string_view name() const noexcept override { return "lz4"; }
+
+private:
+    size_t drain_staging(::std::span<::std::byte> out) noexcept;
+
+private:
+    LZ4F_cctx_s* m_ctx{};
+    bool m_begun{};
+    bool m_ended{};
+
+    // LZ4F needs the worst case output space for each update, which is staged here
+    // if the output span is smaller.
+    ::std::vector<::std::byte> m_staging;
+    size_t m_staging_pos{};
+};
+
+class lz4_decompressor final : public buffer_codec
+{
+public:
+    lz4_decompressor();
+    ~lz4_decompressor() noexcept override;
+
+    codec_step process(::std::span<const ::std::byte> in,
+                       ::std::span<::std::byte> out,
+                       bool finish) override;
+    void reset() override;
+    ::std::string_view name() const noexcept override { return "lz4"; }
+
+private:
+    LZ4F_dctx_s* m_ctx{};
+};
+
+#endif
+
+#if defined(TOOLPEX_WITH_ZSTD)
+
+class zstd_compressor final : public buffer_codec
+{
+public:
+    explicit zstd_compressor(int level = 3);
+    ~zstd_compressor() noexcept override;
+
+    codec_step process(::std::span<const ::std::byte> in,
+                       ::std::span<::std::byte> out,
+                       bool finish) override;
+    void reset() override;
+    ::std::string_view name() const noexcept override { return "zstd"; }
+
+private:
+    ZSTD_CCtx_s* m_ctx{};
+};
+
+class zstd_decompressor final : public buffer_codec
+{
+public:
+    zstd_decompressor();
+    ~zstd_decompressor() noexcept override;
+
+    codec_step process(::std::span<const ::std::byte> in,
+                       ::std::span<::std::byte> out,
+                       bool finish) override;
+    void reset() override;
+    ::std::string_view name() const noexcept override { return "zstd"; }
+
+private:
+    ZSTD_DCtx_s* m_ctx{};
+
+    // zstd reports an error after several calls without progress,
+    // so empty input is only passed down when there could be buffered output.
+    bool m_output_full{};
+    bool m_frame_done{};
+};
+
+#endif
+
+} // namespace toolpex
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef TOOLPEX_BUFFER_READER_H
+#define TOOLPEX_BUFFER_READER_H
+
+#include <span>
+#include <array>
+#include <vector>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include "toolpex/buffer.h"
+#include "toolpex/encode.h"
+
+namespace toolpex
+{
+
+/**
+ *  @class  buffer_reader
+ *  @brief  A cursor over the unread bytes of a `buffer`, parses values even they straddle blocks.
+ *
+ *  Reading through the cursor doesn't touch the reading state of the buffer,
+ *  so a partial frame could be abandoned by simply dropping the reader.
+ *  Call `commit()` once a whole frame has been parsed.
+ *
+ *  Spans returned refer the blocks directly when the bytes are contiguous,
+ *  otherwise they refer a scratch area inside the reader,
+ *  and are invalidated by the next call to the reader.
+ *
+ *  File segments are mapped on demand, a segment which could not be mapped,
+ *  like one on a pipe, makes the reading calls throw `toolpex::posix_exception`.
+ *
+ *  @attention  Writing to the buffer invalidates the reader.
+ */
+class buffer_reader
+{
+public:
+    /// Straddling peeks up to this size are copied to a stack area, larger ones go to the heap.
+    static constexpr size_t small_scratch_size = 64;
+
+public:
+    explicit buffer_reader(buffer& buf) noexcept;
+
+    /// @return Bytes after the cursor.
+    size_t remaining() const noexcept { return m_remaining; }
+
+    /// @return Bytes read through the cursor but not committed to the buffer yet.
+    size_t consumed() const noexcept { return m_consumed; }
+
+    /**
+     * @brief   The next `n` bytes as a contiguous span, without moving the cursor.
+     * @return  An empty span if there're less than `n` bytes.
+     */
+    ::std::span<const ::std::byte> peek(size_t n);
+
+    /// @brief  Like `peek()`, and move the cursor over the bytes returned.
+    ::std::span<const ::std::byte> read(size_t n);
+
+    /// @return Whether there're at least `n` bytes to skip.
+    bool skip(size_t n) noexcept;
+
+    template<::std::integral Int, ::std::endian Endian = ::std::endian::big>
+    ::std::optional<Int> read_int()
+    {
+        const auto sp = read(sizeof(Int));
+        if (sp.empty()) return {};
+        if constexpr (Endian == ::std::endian::big)
+            return decode_big_endian_from<Int>(sp);
+        else return decode_little_endian_from<Int>(sp);
+    }
+
+    /**
+     * @brief   Read an unsigned LEB128 varint, as protobuf encodes.
+     * @return  `std::nullopt` if the varint is incomplete, the cursor stays.
+     * @throw   `std::runtime_error` if the varint is longer than 10 bytes, 
+     *          or its value doesn't fit in 64 bits.
+     */
+    ::std::optional<uint64_t> read_varint();
+
+    /// @return The offset of the first `delimiter` from the cursor.
+    ::std::optional<size_t> find(::std::span<const ::std::byte> delimiter) const;
+    ::std::optional<size_t> find(::std::string_view delimiter) const
+    {
+        return find(::std::as_bytes(::std::span{ delimiter }));
+    }
+
+    /**
+     * @brief   Read the bytes before the first `delimiter`, the cursor moves over the delimiter too.
+     * @return  `std::nullopt` if there's no `delimiter`, the cursor stays.
+     *          An empty span if the `delimiter` comes first.
+     */
+    ::std::optional<::std::span<const ::std::byte>> read_until(::std::span<const ::std::byte> delimiter);
+    ::std::optional<::std::span<const ::std::byte>> read_until(::std::string_view delimiter)
+    {
+        return read_until(::std::as_bytes(::std::span{ delimiter }));
+    }
+
+    /**
+     * @brief   Commit the consumed bytes as read to the buffer.
+     * @param   remove_after_read   Like `buffer::commit_remove_after_read()`.
+     * @return  The number of bytes committed.
+     */
+    size_t commit(bool remove_after_read = false);
+
+private:
+    ::std::span<const ::std::byte> block_span(size_t idx, size_t offset) const;
+    void copy_out(size_t n, ::std::byte* dst) const;
+    void seek_to_reading_position() noexcept;
+
+private:
+    buffer* m_buffer{};
+    size_t m_block_idx{};
+    size_t m_offset{};
+    size_t m_remaining{};
+    size_t m_consumed{};
+
+    ::std::array<::std::byte, small_scratch_size> m_small_scratch;
+    ::std::vector<::std::byte> m_large_scratch;
+};
+
+} // namespace toolpex
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef TOOLPEX_BUFFER_STREAMBUF_H
+#define TOOLPEX_BUFFER_STREAMBUF_H
+
+#include <streambuf>
+#include <iterator>
+#include <cstddef>
+
+#include "toolpex/buffer.h"
+
+namespace toolpex
+{
+
+/**
+ *  @class  buffer_streambuf
+ *  @brief  A `std::streambuf` reads from and writes to a `buffer` in place,
+ *          so `std::ostream` / `std::istream` work without intermediate strings.
+ *
+ *  The put area is the `writable_span()` of the buffer, characters are committed in bulk
+ *  when the span is full, on `pubsync()` (`std::flush`) and on destruction.
+ *  The get area is the `next_readable_span()`, characters consumed are committed as read
+ *  when it's refilled, on `pubsync()` and on destruction.
+ *
+ *  @attention  Don't touch the buffer directly while the stream buffer has uncommitted characters.
+ */
+class buffer_streambuf : public ::std::streambuf
+{
+public:
+    explicit buffer_streambuf(buffer& buf) noexcept
+        : m_buffer{ &buf }
+    {
+    }
+
+    ~buffer_streambuf() noexcept override { sync(); }
+
+    buffer_streambuf(const buffer_streambuf&) = delete;
+    buffer_streambuf& operator=(const buffer_streambuf&) = delete;
+
+protected:
+    int_type overflow(int_type ch) override;
+    ::std::streamsize xsputn(const char_type* s, ::std::streamsize n) override;
+    int_type underflow() override;
+    ::std::streamsize showmanyc() override;
+    int sync() override;
+
+private:
+    void commit_put_area() noexcept;
+    void commit_get_area() noexcept;
+
+private:
+    buffer* m_buffer{};
+};
+
+/**
+ *  @class  buffer_inserter
+ *  @brief  An output iterator writes characters into a buffer,
+ *          e.g. `std::format_to(buffer_inserter{ buf }, "{}: {}", k, v).commit()`.
+ *
+ *  Constructed from a `buffer`, it writes straight into `writable_span()` of the buffer,
+ *  nothing is allocated but the blocks, and copying it copies a few pointers.
+ *  Characters are committed when a span is full, the rest by `commit()`
+ *  of the iterator returned by the algorithm, like `std::copy()` or `std::format_to()`.
+ *  Constructed from a `buffer_streambuf`, it writes through it,
+ *  the stream buffer decides when to commit, `commit()` does nothing then.
+ *
+ *  @attention  Like any output iterator, keep using only the last copy returned,
+ *              and don't touch the buffer directly before `commit()`.
+ */
+class buffer_inserter
+{
+public:
+    using iterator_category = ::std::output_iterator_tag;
+    using value_type        = void;
+    using difference_type   = ::std::ptrdiff_t;
+    using pointer           = void;
+    using reference         = void;
+
+public:
+    buffer_inserter() noexcept = default;
+
+    explicit buffer_inserter(buffer& buf) noexcept
+        : m_buffer{ &buf }
+    {
+    }
+
+    explicit buffer_inserter(buffer_streambuf& sb) noexcept
+        : m_sb{ &sb }
+    {
+    }
+
+    buffer_inserter& operator=(char c)
+    {
+        if (m_sb)
+        {
+            m_sb->sputc(c);
+            return *this;
+        }
+        if (m_cur == m_end) next_span();
+        *m_cur++ = c;
+        return *this;
+    }
+
+    buffer_inserter& operator*() noexcept { return *this; }
+    buffer_inserter& operator++() noexcept { return *this; }
+    buffer_inserter& operator++(int) noexcept { return *this; }
+
+    /// @brief  Commit the characters written so far, the iterator could be used further.
+    void commit() noexcept
+    {
+        if (m_cur == m_committed) return;
+        m_buffer->commit_write(static_cast<size_t>(m_cur - m_committed));
+        m_committed = m_cur;
+    }
+
+private:
+    void next_span()
+    {
+        commit();
+        // The free tail of the current block, a new block only if it's full.
+        auto sp = m_buffer->writable_span(1);
+        m_committed = m_cur = reinterpret_cast<char*>(sp.data());
+        m_end = m_cur + sp.size();
+    }
+
+private:
+    buffer* m_buffer{};
+    buffer_streambuf* m_sb{};
+    char* m_committed{};
+    char* m_cur{};
+    char* m_end{};
+};
+
+static_assert(::std::output_iterator<buffer_inserter, const char&>);
+
+} // namespace toolpex
+
+#endif
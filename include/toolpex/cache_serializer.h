@@ -0,0 +1,87 @@
+// This file is part of Toolpex
+// https://github.com/JPewterschmidt/toolpex
+//
+// Copyleft 2023 - 2024, ShiXin Wang. All wrongs reserved.
+
+#ifndef TOOLPEX_CACHE_SERIALIZER_H
+#define TOOLPEX_CACHE_SERIALIZER_H
+
+#include <type_traits>
+#include <cstring>
+#include <cstddef>
+#include <string>
+#include <span>
+#include <stdexcept>
+
+#include "toolpex/macros.h"
+#include "toolpex/assert.h"
+
+TOOLPEX_NAMESPACE_BEG
+
+/*! \brief  Customization point which describes how a key or value
+ *          will be laid out when a cache writes it to a file,
+ *          like the `file_cache_tier` records or `save()` of `lru_cache_persistence.h`.
+ *
+ *  A specialization has to provide:
+ *  \code
+ *  static size_t encoded_size(const T&);
+ *  static void encode_to(const T&, ::std::span<::std::byte>);
+ *  static T decode_from(::std::span<const ::std::byte>);
+ *  \endcode
+ *  The primary template handles trivially copyable types by raw copying.
+ *  `decode_from()` gets bytes read back from a file, which could be truncated or corrupted,
+ *  it should throw `std::runtime_error` on malformed input rather than reading out of `src`.
+ */
+template<typename T>
+struct cache_serializer
+{
+    static_assert(::std::is_trivially_copyable_v<T>,
+        "Please specialize `toolpex::cache_serializer` for non trivially copyable types.");
+
+    static constexpr size_t encoded_size(const T&) noexcept { return sizeof(T); }
+
+    static void encode_to(const T& obj, ::std::span<::std::byte> dst) noexcept
+    {
+        toolpex_assert(dst.size() >= sizeof(T));
+        ::std::memcpy(dst.data(), &obj, sizeof(T));
+    }
+
+    static T decode_from(::std::span<const ::std::byte> src)
+    {
+        if (src.size() != sizeof(T))
+            throw ::std::runtime_error{ "cache_serializer: encoded size mismatch, corrupted input." };
+        T result;
+        ::std::memcpy(&result, src.data(), sizeof(T));
+        return result;
+    }
+};
+
+template<typename CharT, typename Traits, typename Alloc>
+struct cache_serializer<::std::basic_string<CharT, Traits, Alloc>>
+{
+    using string_type = ::std::basic_string<CharT, Traits, Alloc>;
+
+    static size_t encoded_size(const string_type& str) noexcept
+    {
+        return str.size() * sizeof(CharT);
+    }
+
+    static void encode_to(const string_type& str, ::std::span<::std::byte> dst) noexcept
+    {
+        toolpex_assert(dst.size() >= encoded_size(str));
+        ::std::memcpy(dst.data(), str.data(), encoded_size(str));
+    }
+
+    static string_type decode_from(::std::span<const ::std::byte> src)
+    {
+        if (src.size() % sizeof(CharT))
+            throw ::std::runtime_error{ "cache_serializer: encoded size mismatch, corrupted input." };
+        string_type result(src.size() / sizeof(CharT), CharT{});
+        ::std::memcpy(result.data(), src.data(), result.size() * sizeof(CharT));
+        return result;
+    }
+};
+
+TOOLPEX_NAMESPACE_END
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef TOOLPEX_CHECKSUM_H
+#define TOOLPEX_CHECKSUM_H
+
+#include <span>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "toolpex/buffer.h"
+
+namespace toolpex
+{
+
+/**
+ * @brief   CRC32C (Castagnoli), with the SSE4.2 `crc32` instruction if the CPU has it,
+ *          otherwise a slicing-by-8 table.
+ * @param   crc     The result of the previous call, to checksum data in pieces.
+ *                  `crc32c(b, crc32c(a))` equals the checksum of `a` followed by `b`.
+ */
+uint32_t crc32c(::std::span<const ::std::byte> data, uint32_t crc = 0) noexcept;
+
+/**
+ * @brief   CRC32C of all the valid bytes of `buf`, block by block, file segments included.
+ * @throw   `toolpex::posix_exception` if a file segment could not be mapped.
+ */
+uint32_t crc32c(const buffer& buf, uint32_t crc = 0);
+
+inline uint32_t crc32c(::std::string_view data, uint32_t crc = 0) noexcept
+{
+    return crc32c(::std::as_bytes(::std::span{ data }), crc);
+}
+
+/**
+ *  @class  xxhash64
+ *  @brief  A streaming XXH64, a fast 64-bit non-cryptographic hash.
+ *
+ *  Feed the data in any pieces by `update()`, `digest()` doesn't change the state,
+ *  so more data could be fed after it.
+ */
+class xxhash64
+{
+public:
+    explicit xxhash64(uint64_t seed = 0) noexcept;
+
+    xxhash64& update(::std::span<const ::std::byte> data) noexcept;
+
+    /**
+     * @brief   Feed all the valid bytes of `buf`, block by block, file segments included.
+     * @throw   `toolpex::posix_exception` if a file segment could not be mapped,
+     *          the blocks before it have been fed already.
+     */
+    xxhash64& update(const buffer& buf);
+
+    xxhash64& update(::std::string_view data) noexcept
+    {
+        return update(::std::as_bytes(::std::span{ data }));
+    }
+
+    uint64_t digest() const noexcept;
+
+private:
+    static constexpr size_t stripe_size = 32;
+
+    uint64_t m_seed{};
+    ::std::array<uint64_t, 4> m_acc{};
+    ::std::array<::std::byte, stripe_size> m_pending{};
+    size_t m_pending_size{};
+    uint64_t m_total_len{};
+};
+
+/// @brief  One shot XXH64.
+inline uint64_t xxh64(::std::span<const ::std::byte> data, uint64_t seed = 0) noexcept
+{
+    return xxhash64{ seed }.update(data).digest();
+}
+
+inline uint64_t xxh64(::std::string_view data, uint64_t seed = 0) noexcept
+{
+    return xxhash64{ seed }.update(data).digest();
+}
+
+} // namespace toolpex
+
+#endif
@@ -13,16 +13,61 @@
 #include "toolpex/macros.h"
 #include "toolpex/spin_lock.h"
 #include "toolpex/specific_counter_handler.h"
-#include <unordered_map>
-#include <ranges>
-#include <numeric>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <stop_token>
 
 TOOLPEX_NAMESPACE_BEG
 
+namespace counter_detail
+{
+    /*! \brief  Owns the slots of the registered execution units.
+     *  \attention Not thread safe, the counter guards it with its own lock.
+     */
+    template<typename Slot>
+    class execution_unit_slots
+    {
+    public:
+        Slot* add(::std::unique_ptr<Slot> slot)
+        {
+            return m_slots.emplace_back(::std::move(slot)).get();
+        }
+
+        /*! \return The removed slot, free it after unlocking. */
+        ::std::unique_ptr<Slot> remove(Slot* slot) noexcept
+        {
+            auto it = ::std::ranges::find(m_slots, slot, &::std::unique_ptr<Slot>::get);
+            auto result = ::std::move(*it);
+            *it = ::std::move(m_slots.back());
+            m_slots.pop_back();
+            return result;
+        }
+
+        auto begin() const noexcept { return m_slots.begin(); }
+        auto end() const noexcept { return m_slots.end(); }
+        size_t size() const noexcept { return m_slots.size(); }
+
+    private:
+        ::std::vector<::std::unique_ptr<Slot>> m_slots;
+    };
+}
+
 /*! \brief  Perfbook's Approximate Limit Counter implementation (lock free)
  *  \tparam ExecutionIdType A type which could represent a execution unit, like thread id or coroutine address, etc.
  *  \tparam The underlying counter type.
  *
+ *  Each execution unit gets its own cache line sized slot when its handler registered,
+ *  the handler points to the slot directly, 
+ *  so the fast path touches nothing but the relaxed atomics in that slot.
+ *
  *  \see Perfbook Chatper 5.3
  */
 template<
@@ -31,6 +76,13 @@ template<
 class approximate_limit_counter
 {
 public:
+    /*! \brief  The per execution unit counter, padded to a cache line to avoid false sharing. */
+    struct alignas(64) execution_unit_slot
+    {
+        ::std::atomic<CounterT> m_counter_max{};
+        ::std::atomic<CounterT> m_counter{};
+    };
+
     using execution_unit_handler = specific_counter_handler<ExecutionIdType, approximate_limit_counter>;
     
 public:
@@ -48,7 +100,7 @@ public:
      *          contains execution unit specific information.
      */
     execution_unit_handler 
-    get_specific_handler(auto execution_specific_initer) noexcept 
+    get_specific_handler(auto execution_specific_initer)
     { 
         return { ::std::move(execution_specific_initer), *this }; 
     }
@@ -62,7 +114,11 @@ public:
         m_global_counter_max = global_counter_max;
         m_global_counter_reserve = {};
         m_global_counter = {};
-        m_counter.clear();
+        for (auto& slot : m_slots)
+        {
+            slot->m_counter_max.store(0, ::std::memory_order_relaxed);
+            slot->m_counter.store(0, ::std::memory_order_relaxed);
+        }
     }
 
     /*! \brief Reset the counter, make it back to initial state. */
@@ -77,7 +133,7 @@ public:
      */
     bool add_count(const execution_unit_handler& h, CounterT delta) noexcept
     {
-        auto& [cnt_max, cnt] = local_variable(h);
+        auto& [cnt_max, cnt] = *h.slot();
         const auto cnt_max_v = cnt_max.load(::std::memory_order_relaxed);
         const auto cnt_v = cnt.load(::std::memory_order_relaxed);
         if (cnt_max_v - cnt_v >= delta)
@@ -103,7 +159,7 @@ public:
      */
     bool sub_count(const execution_unit_handler& h, CounterT delta) noexcept
     {
-        auto& [cntmax, cnt] = local_variable(h);
+        auto& [cntmax, cnt] = *h.slot();
         const auto cntval = cnt.load(::std::memory_order_relaxed);
         if (cntval >= delta)
         {
@@ -126,19 +182,31 @@ public:
     {
         ::std::lock_guard lk{ m_lock };
         CounterT sum{ m_global_counter };
-        for (const auto& item : m_counter)
+        for (const auto& slot : m_slots)
         {
-            sum += item.second.m_counter.load(::std::memory_order_relaxed);
+            sum += slot->m_counter.load(::std::memory_order_relaxed);
         }
         return sum;
     }
 
+    /*! \brief Register a execution unit, allocate its slot.
+     *  \return The slot, which stays valid until `count_unregister_execution_unit()`.
+     *  \attention Called by the `execution_unit_handler`, you'd better not to call it directly.
+     */
+    execution_unit_slot* count_register_execution_unit([[maybe_unused]] const ExecutionIdType& tid)
+    {
+        auto slot = ::std::make_unique<execution_unit_slot>();
+        ::std::lock_guard lk{ m_lock };
+        return m_slots.add(::std::move(slot));
+    }
+
     /*! \brief Unregister the current execution unit.
      *  
      *  Globalize the counter.
      *  Clean the resource the current execution unit occuiped.
      *
      *  \param tid Current execution unit id.
+     *  \param slot The slot returned by `count_register_execution_unit()`.
      *  
      *  \attention This function should be called after the use of 
      *             this counter in each execution unit (typically thread).
@@ -146,37 +214,23 @@ public:
      *             returned by `get_specific_handler()`, 
      *             which utilze RAII to make sure this function will be called.
      */
-    void count_unregister_execution_unit(ExecutionIdType tid) noexcept
+    void count_unregister_execution_unit([[maybe_unused]] const ExecutionIdType& tid, 
+                                         execution_unit_slot* slot) noexcept
     {
-        ::std::lock_guard lk{ m_lock };
-        globalize_count(tid);
-        m_counter.erase(tid);       
+        ::std::unique_ptr<execution_unit_slot> victim;
+        {
+            ::std::lock_guard lk{ m_lock };
+            globalize_count(*slot);
+            victim = m_slots.remove(slot);
+        }
     }
 
     CounterT limit() const noexcept { return m_global_counter_max; }
 
 private:
-    struct local_variable_t
-    {
-        ::std::atomic<CounterT> m_counter_max{};
-        ::std::atomic<CounterT> m_counter{};
-    };
-
-private:
-    auto& local_variable(const execution_unit_handler& h) noexcept
-    {
-        return local_variable(h.tid());
-    }
-
-    auto& local_variable(ExecutionIdType tid) noexcept
-    {
-        if (!m_counter.contains(tid)) m_num_online.fetch_add(1, ::std::memory_order_relaxed);
-        return m_counter[tid];
-    }
-
     void balance_count(const execution_unit_handler& h) noexcept
     {
-        auto& [cntmax, cnt] = local_variable(h);
+        auto& [cntmax, cnt] = *h.slot();
         const CounterT cntmax_val = 
             (m_global_counter_max - m_global_counter - m_global_counter_reserve) / num_online_execution_units();
 
@@ -189,9 +243,9 @@ private:
         m_global_counter -= cnt_val;
     }
 
-    void globalize_count(ExecutionIdType tid) noexcept
+    void globalize_count(execution_unit_slot& slot) noexcept
     {
-        auto& [cntmax, cnt] = local_variable(tid);
+        auto& [cntmax, cnt] = slot;
         m_global_counter += cnt.load(::std::memory_order_relaxed);
         cnt.store(0, ::std::memory_order_relaxed);
         m_global_counter_reserve -= cntmax.load(::std::memory_order_relaxed);
@@ -200,20 +254,438 @@ private:
 
     void globalize_count(const execution_unit_handler& h) noexcept
     {
-        globalize_count(h.tid());
+        globalize_count(*h.slot());
     }
 
-    size_t num_online_execution_units() const noexcept { return m_num_online; }
+    size_t num_online_execution_units() const noexcept { return m_slots.size(); }
 
 private:
     CounterT m_global_counter_max{};
     CounterT m_global_counter_reserve{};
     CounterT m_global_counter{};
-    ::std::unordered_map<ExecutionIdType, local_variable_t> m_counter;
-    ::std::atomic_size_t m_num_online{};
+    counter_detail::execution_unit_slots<execution_unit_slot> m_slots;
     mutable spin_lock m_lock;   
 };
 
+/*! \brief  Perfbook's exact limit counter, with atomic fast path.
+ *  \tparam ExecutionIdType A type which could represent a execution unit, like thread id or coroutine address, etc.
+ *  \tparam The underlying counter type.
+ *
+ *  The counter and the countermax of each execution unit are packed in one atomic word,
+ *  the fast path is a compare-and-swap on the word of its own, no lock.
+ *  When the local reserve is not enough, the slow path steals the counts and the reserves 
+ *  of all the execution units before giving up, 
+ *  so a add fails only if the limit would really be exceeded, and a sub only if the count is less than delta.
+ *
+ *  \see Perfbook Chatper 5.4.1
+ */
+template<
+    ::std::integral CounterT = ::std::size_t, 
+    typename ExecutionIdType = ::std::thread::id>
+class exact_limit_counter
+{
+public:
+    /*! \brief  The packed per execution unit counter, padded to a cache line to avoid false sharing.
+     *          The high half is the counter, the low half is the countermax.
+     */
+    struct alignas(64) execution_unit_slot
+    {
+        ::std::atomic<uint64_t> m_counter_and_max{};
+    };
+
+    using execution_unit_handler = specific_counter_handler<ExecutionIdType, exact_limit_counter>;
+
+public:
+    /*! \brief Ctor
+     *  \param  global_counter_max The maximum value of the global counter.
+     */
+    constexpr exact_limit_counter(long long global_counter_max) noexcept
+        : m_global_counter_max{ static_cast<CounterT>(global_counter_max) }
+    {
+    }
+
+    /*! \brief Make a `specific_counter_handler`, which registers the execution unit. */
+    execution_unit_handler 
+    get_specific_handler(auto execution_specific_initer)
+    { 
+        return { ::std::move(execution_specific_initer), *this }; 
+    }
+
+    /*! \brief Reset the counter, make it back to initial state.
+     *  \param global_counter_max a new maximum limit of the global counter. 
+     */
+    void reset(CounterT global_counter_max) noexcept
+    {
+        ::std::lock_guard lk{ m_lock };
+        m_global_counter_max = global_counter_max;
+        m_global_counter_reserve = {};
+        m_global_counter = {};
+        for (auto& slot : m_slots)
+            slot->m_counter_and_max.store(0, ::std::memory_order_relaxed);
+    }
+
+    /*! \brief Reset the counter, make it back to initial state. */
+    void reset() noexcept
+    {
+        return reset(m_global_counter_max);
+    }
+
+    /*! \brief Increase the value of counter.
+     *  \param h the execution specific information object.
+     *  \param delta the value you want to add.
+     *  \return false if the limit would be exceeded.
+     */
+    bool add_count(const execution_unit_handler& h, CounterT delta) noexcept
+    {
+        auto& cam = h.slot()->m_counter_and_max;
+        auto old = cam.load(::std::memory_order_relaxed);
+        for (;;)
+        {
+            const auto [cnt, cntmax] = split(old);
+            if (static_cast<uint64_t>(delta) > max_local_counter || cnt + delta > cntmax)
+                break;
+            if (cam.compare_exchange_weak(old, merge(cnt + delta, cntmax), ::std::memory_order_relaxed))
+                return true;
+        }
+
+        ::std::lock_guard lk{ m_lock };
+        globalize_count(*h.slot());
+        if (m_global_counter_max - m_global_counter - m_global_counter_reserve < delta)
+        {
+            flush_local_count();
+            if (m_global_counter_max - m_global_counter - m_global_counter_reserve < delta)
+                return false;
+        }
+        m_global_counter += delta;
+        balance_count(*h.slot());
+        return true;
+    }
+
+    /*! \brief Decrease the value of counter.
+     *  \param h the execution specific information object.
+     *  \param delta the value you want to subtract.
+     *  \return false if the counter is less than `delta`.
+     */
+    bool sub_count(const execution_unit_handler& h, CounterT delta) noexcept
+    {
+        auto& cam = h.slot()->m_counter_and_max;
+        auto old = cam.load(::std::memory_order_relaxed);
+        for (;;)
+        {
+            const auto [cnt, cntmax] = split(old);
+            if (static_cast<uint64_t>(delta) > max_local_counter || delta > cnt)
+                break;
+            if (cam.compare_exchange_weak(old, merge(cnt - delta, cntmax), ::std::memory_order_relaxed))
+                return true;
+        }
+
+        ::std::lock_guard lk{ m_lock };
+        globalize_count(*h.slot());
+        if (m_global_counter < delta)
+        {
+            flush_local_count();
+            if (m_global_counter < delta) return false;
+        }
+        m_global_counter -= delta;
+        balance_count(*h.slot());
+        return true;
+    }
+
+    /*! \brief  Read the counter value.
+     *  \attention  This call will access all the execution specific counter, 
+     *              which caused cache miss potentially.
+     */
+    auto read_count([[maybe_unused]] const execution_unit_handler&) noexcept
+    {
+        ::std::lock_guard lk{ m_lock };
+        CounterT sum{ m_global_counter };
+        for (const auto& slot : m_slots)
+            sum += split(slot->m_counter_and_max.load(::std::memory_order_relaxed)).first;
+        return sum;
+    }
+
+    /*! \brief Register a execution unit, allocate its slot.
+     *  \attention Called by the `execution_unit_handler`, you'd better not to call it directly.
+     */
+    execution_unit_slot* count_register_execution_unit([[maybe_unused]] const ExecutionIdType& tid)
+    {
+        auto slot = ::std::make_unique<execution_unit_slot>();
+        ::std::lock_guard lk{ m_lock };
+        return m_slots.add(::std::move(slot));
+    }
+
+    /*! \brief Unregister a execution unit, globalize its count and free its slot. */
+    void count_unregister_execution_unit([[maybe_unused]] const ExecutionIdType& tid, 
+                                         execution_unit_slot* slot) noexcept
+    {
+        ::std::unique_ptr<execution_unit_slot> victim;
+        {
+            ::std::lock_guard lk{ m_lock };
+            globalize_count(*slot);
+            victim = m_slots.remove(slot);
+        }
+    }
+
+    CounterT limit() const noexcept { return m_global_counter_max; }
+
+private:
+    static constexpr unsigned counter_bits = 32;
+    static constexpr uint64_t max_local_counter = (uint64_t{ 1 } << counter_bits) - 1;
+
+    static ::std::pair<uint64_t, uint64_t> split(uint64_t counter_and_max) noexcept
+    {
+        return { counter_and_max >> counter_bits, counter_and_max & max_local_counter };
+    }
+
+    static uint64_t merge(uint64_t cnt, uint64_t cntmax) noexcept
+    {
+        return (cnt << counter_bits) | cntmax;
+    }
+
+    void globalize_count(execution_unit_slot& slot) noexcept
+    {
+        const auto [cnt, cntmax] = split(slot.m_counter_and_max.exchange(0, ::std::memory_order_relaxed));
+        m_global_counter += static_cast<CounterT>(cnt);
+        m_global_counter_reserve -= static_cast<CounterT>(cntmax);
+    }
+
+    /*! \brief Steal the counts and the reserves of all the execution units. */
+    void flush_local_count() noexcept
+    {
+        if (m_global_counter_reserve == 0) return;
+        for (auto& slot : m_slots)
+            globalize_count(*slot);
+    }
+
+    void balance_count(execution_unit_slot& slot) noexcept
+    {
+        CounterT cntmax = 
+            (m_global_counter_max - m_global_counter - m_global_counter_reserve) / m_slots.size();
+        if (cntmax > max_local_counter) cntmax = static_cast<CounterT>(max_local_counter);
+        m_global_counter_reserve += cntmax;
+
+        CounterT cnt = cntmax / 2;
+        if (cnt > m_global_counter) cnt = m_global_counter;
+        m_global_counter -= cnt;
+        slot.m_counter_and_max.store(merge(cnt, cntmax), ::std::memory_order_relaxed);
+    }
+
+private:
+    CounterT m_global_counter_max{};
+    CounterT m_global_counter_reserve{};
+    CounterT m_global_counter{};
+    counter_detail::execution_unit_slots<execution_unit_slot> m_slots;
+    mutable spin_lock m_lock;
+};
+
+/*! \brief  Perfbook's statistical counter, for counters updated far more often than read.
+ *  \tparam The underlying counter type.
+ *  \tparam ExecutionIdType A type which could represent a execution unit, like thread id or coroutine address, etc.
+ *
+ *  Each execution unit adds to its own cache line sized slot, 
+ *  a slot is only written by its owner, so an add is a relaxed load and store, no locked instruction.
+ *  Reading sums all the registered slots under the lock.
+ *
+ *  \see Perfbook Chatper 5.2.2
+ */
+template<
+    ::std::integral CounterT = ::std::size_t, 
+    typename ExecutionIdType = ::std::thread::id>
+class statistical_counter
+{
+public:
+    struct alignas(64) execution_unit_slot
+    {
+        ::std::atomic<CounterT> m_counter{};
+    };
+
+    using execution_unit_handler = specific_counter_handler<ExecutionIdType, statistical_counter>;
+
+public:
+    statistical_counter() noexcept = default;
+
+    /*! \brief Make a `specific_counter_handler`, which registers the execution unit. */
+    execution_unit_handler 
+    get_specific_handler(auto execution_specific_initer)
+    { 
+        return { ::std::move(execution_specific_initer), *this }; 
+    }
+
+    void add_count(const execution_unit_handler& h, CounterT delta) noexcept
+    {
+        auto& cnt = h.slot()->m_counter;
+        cnt.store(cnt.load(::std::memory_order_relaxed) + delta, ::std::memory_order_relaxed);
+    }
+
+    void sub_count(const execution_unit_handler& h, CounterT delta) noexcept
+    {
+        auto& cnt = h.slot()->m_counter;
+        cnt.store(cnt.load(::std::memory_order_relaxed) - delta, ::std::memory_order_relaxed);
+    }
+
+    void inc(const execution_unit_handler& h) noexcept { add_count(h, 1); }
+
+    /*! \brief  Read the counter value.
+     *  \attention  This call will access all the execution specific counter, 
+     *              which caused cache miss potentially.
+     */
+    CounterT read() const noexcept
+    {
+        ::std::lock_guard lk{ m_lock };
+        CounterT sum{ m_retired };
+        for (const auto& slot : m_slots)
+            sum += slot->m_counter.load(::std::memory_order_relaxed);
+        return sum;
+    }
+
+    CounterT read_count([[maybe_unused]] const execution_unit_handler&) const noexcept { return read(); }
+
+    /*! \brief Register a execution unit, allocate its slot.
+     *  \attention Called by the `execution_unit_handler`, you'd better not to call it directly.
+     */
+    execution_unit_slot* count_register_execution_unit([[maybe_unused]] const ExecutionIdType& tid)
+    {
+        auto slot = ::std::make_unique<execution_unit_slot>();
+        ::std::lock_guard lk{ m_lock };
+        return m_slots.add(::std::move(slot));
+    }
+
+    /*! \brief Unregister a execution unit, its count is kept by the counter. */
+    void count_unregister_execution_unit([[maybe_unused]] const ExecutionIdType& tid, 
+                                         execution_unit_slot* slot) noexcept
+    {
+        ::std::unique_ptr<execution_unit_slot> victim;
+        {
+            ::std::lock_guard lk{ m_lock };
+            m_retired += slot->m_counter.load(::std::memory_order_relaxed);
+            victim = m_slots.remove(slot);
+        }
+    }
+
+private:
+    CounterT m_retired{};
+    counter_detail::execution_unit_slots<execution_unit_slot> m_slots;
+    mutable spin_lock m_lock;
+};
+
+/*! \brief  Perfbook's eventually consistent statistical counter, for counters read very often too.
+ *  \tparam The underlying counter type.
+ *  \tparam ExecutionIdType A type which could represent a execution unit, like thread id or coroutine address, etc.
+ *
+ *  Adds are the same as `statistical_counter`.
+ *  A background thread sums up the slots every `interval`, 
+ *  reading is a single relaxed load of the last sum, which could be stale by about one interval.
+ *
+ *  \see Perfbook Chatper 5.2.4
+ */
+template<
+    ::std::integral CounterT = ::std::size_t, 
+    typename ExecutionIdType = ::std::thread::id>
+class eventually_consistent_counter
+{
+public:
+    struct alignas(64) execution_unit_slot
+    {
+        ::std::atomic<CounterT> m_counter{};
+    };
+
+    using execution_unit_handler = specific_counter_handler<ExecutionIdType, eventually_consistent_counter>;
+
+public:
+    /*! \brief Ctor, starts the aggregator thread.
+     *  \param interval How often the aggregator sums up the slots.
+     */
+    explicit eventually_consistent_counter(::std::chrono::nanoseconds interval = ::std::chrono::milliseconds{ 1 })
+        : m_interval{ interval }, 
+          m_aggregator{ [this](::std::stop_token st) { aggregate_loop(::std::move(st)); } }
+    {
+    }
+
+    /*! \brief Make a `specific_counter_handler`, which registers the execution unit. */
+    execution_unit_handler 
+    get_specific_handler(auto execution_specific_initer)
+    { 
+        return { ::std::move(execution_specific_initer), *this }; 
+    }
+
+    void add_count(const execution_unit_handler& h, CounterT delta) noexcept
+    {
+        auto& cnt = h.slot()->m_counter;
+        cnt.store(cnt.load(::std::memory_order_relaxed) + delta, ::std::memory_order_relaxed);
+    }
+
+    void sub_count(const execution_unit_handler& h, CounterT delta) noexcept
+    {
+        auto& cnt = h.slot()->m_counter;
+        cnt.store(cnt.load(::std::memory_order_relaxed) - delta, ::std::memory_order_relaxed);
+    }
+
+    void inc(const execution_unit_handler& h) noexcept { add_count(h, 1); }
+
+    /*! \return The sum from the last aggregation. */
+    CounterT read() const noexcept { return m_global.load(::std::memory_order_relaxed); }
+
+    CounterT read_count([[maybe_unused]] const execution_unit_handler&) const noexcept { return read(); }
+
+    /*! \brief Aggregate right now, makes the adds happened before visible to `read()`. */
+    void flush() noexcept
+    {
+        ::std::lock_guard lk{ m_lock };
+        CounterT sum{ m_retired };
+        for (const auto& slot : m_slots)
+            sum += slot->m_counter.load(::std::memory_order_relaxed);
+        m_global.store(sum, ::std::memory_order_relaxed);
+    }
+
+    /*! \brief Register a execution unit, allocate its slot.
+     *  \attention Called by the `execution_unit_handler`, you'd better not to call it directly.
+     */
+    execution_unit_slot* count_register_execution_unit([[maybe_unused]] const ExecutionIdType& tid)
+    {
+        auto slot = ::std::make_unique<execution_unit_slot>();
+        ::std::lock_guard lk{ m_lock };
+        return m_slots.add(::std::move(slot));
+    }
+
+    /*! \brief Unregister a execution unit, its count is kept by the counter. */
+    void count_unregister_execution_unit([[maybe_unused]] const ExecutionIdType& tid, 
+                                         execution_unit_slot* slot) noexcept
+    {
+        ::std::unique_ptr<execution_unit_slot> victim;
+        {
+            ::std::lock_guard lk{ m_lock };
+            m_retired += slot->m_counter.load(::std::memory_order_relaxed);
+            victim = m_slots.remove(slot);
+        }
+    }
+
+    auto interval() const noexcept { return m_interval; }
+
+private:
+    void aggregate_loop(::std::stop_token st) noexcept
+    {
+        ::std::unique_lock lk{ m_wakeup_lock };
+        while (!st.stop_requested())
+        {
+            flush();
+            m_wakeup.wait_for(lk, st, m_interval, [] { return false; });
+        }
+    }
+
+private:
+    alignas(64) ::std::atomic<CounterT> m_global{};
+    ::std::chrono::nanoseconds m_interval{};
+    CounterT m_retired{};
+    counter_detail::execution_unit_slots<execution_unit_slot> m_slots;
+    mutable spin_lock m_lock;
+    ::std::mutex m_wakeup_lock;
+    ::std::condition_variable_any m_wakeup;
+
+    // Declared last, so it starts after and stops before all the other members.
+    // All the handlers must be destroyed before the counter.
+    ::std::jthread m_aggregator;
+};
+
 TOOLPEX_NAMESPACE_END
 
 #endif
@@ -0,0 +1,331 @@
+// This file is part of Toolpex
+// https://github.com/JPewterschmidt/toolpex
+//
+// Copyleft 2023 - 2024, ShiXin Wang. All wrongs reserved.
+
+#ifndef TOOLPEX_FILE_CACHE_TIER_H
+#define TOOLPEX_FILE_CACHE_TIER_H
+
+#include <unordered_map>
+#include <vector>
+#include <list>
+#include <filesystem>
+#include <stdexcept>
+#include <functional>
+#include <concepts>
+#include <optional>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <cerrno>
+#include <span>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "toolpex/macros.h"
+#include "toolpex/assert.h"
+#include "toolpex/buffer.h"
+#include "toolpex/encode.h"
+#include "toolpex/cache_serializer.h"
+#include "toolpex/exceptions.h"
+#include "toolpex/unique_posix_fd.h"
+
+TOOLPEX_NAMESPACE_BEG
+
+/*! \brief Hit/miss/eviction counters of a single cache tier. */
+struct cache_tier_stats
+{
+    size_t hits{};
+    size_t misses{};
+    size_t evictions{};
+};
+
+/*! \brief  A log-structured, file backed cache tier.
+ *
+ *  Entries are appended to a local file as records of
+ *  `[u32 key size][u32 value size][key bytes][value bytes]` (big endian headers),
+ *  only the location of each record is kept in memory.
+ *  Overwritten or erased records become garbage.
+ *  When a record doesn't fit in the file any more, the oldest records are evicted
+ *  until at least `compaction_garbage_ratio` of the file is garbage,
+ *  then the live records are rewritten into a fresh file.
+ *  So a compaction always reclaims a good part of the file,
+ *  instead of rewriting the whole log for a few bytes on every put.
+ *
+ *  Serialization is staged in a `toolpex::buffer`,
+ *  so each record costs exactly one `pwrite` / `pread`.
+ *
+ *  \attention Not thread safe, just like `lru_cache`.
+ *             The file is created (truncated) by the constructor and removed by the destructor.
+ */
+template<
+    typename KeyType,
+    typename ValueType,
+    typename Hash = ::std::hash<KeyType>,
+    typename KeyEq = ::std::equal_to<KeyType>,
+    typename KeySerializer = cache_serializer<KeyType>,
+    typename ValueSerializer = cache_serializer<ValueType>>
+class file_cache_tier
+{
+public:
+    static constexpr size_t record_header_size = 2 * sizeof(uint32_t);
+    static constexpr double compaction_garbage_ratio = 0.5;
+
+public:
+    /*! \param  path            Where the log file lives, typically on a local SSD.
+     *  \param  capacity_bytes  The maximum size of the log file.
+     */
+    file_cache_tier(::std::filesystem::path path, size_t capacity_bytes)
+        : m_path{ ::std::move(path) },
+          m_capacity_bytes{ capacity_bytes },
+          m_fd{ open_log(m_path) }
+    {
+        if (capacity_bytes == 0)
+        {
+            throw ::std::invalid_argument("Capacity must be a positive integer.");
+        }
+    }
+
+    file_cache_tier(file_cache_tier&&) noexcept = default;
+    file_cache_tier& operator=(file_cache_tier&&) = delete;
+
+    ~file_cache_tier() noexcept
+    {
+        if (m_fd.valid())
+        {
+            m_fd.close();
+            ::std::error_code ec;
+            ::std::filesystem::remove(m_path, ec);
+        }
+    }
+
+    /*! \brief Append a record, the oldest records may be evicted to make room.
+     *  \return false if the record is larger than the capacity of this tier,
+     *          in that case the entry is simply dropped.
+     *  \throw  `std::length_error` if the encoded key or value exceeds `UINT32_MAX` bytes.
+     */
+    bool put(const KeyType& key, const ValueType& value)
+    {
+        const size_t ksz = KeySerializer::encoded_size(key);
+        const size_t vsz = ValueSerializer::encoded_size(value);
+        const size_t rsz = record_header_size + ksz + vsz;
+        if (ksz > UINT32_MAX || vsz > UINT32_MAX)
+        {
+            throw ::std::length_error("The record is too large for the 32 bits size field.");
+        }
+
+        erase(key);
+        if (rsz > m_capacity_bytes) return false;
+        if (m_file_size + rsz > m_capacity_bytes)
+            make_room(rsz);
+
+        buffer buf{ rsz };
+        auto sp = buf.writable_span(rsz).first(rsz);
+        encode_big_endian_to(static_cast<uint32_t>(ksz), sp);
+        encode_big_endian_to(static_cast<uint32_t>(vsz), sp.subspan(sizeof(uint32_t)));
+        KeySerializer::encode_to(key, sp.subspan(record_header_size, ksz));
+        ValueSerializer::encode_to(value, sp.subspan(record_header_size + ksz, vsz));
+        buf.commit_write(rsz);
+
+        write_all(buf.next_readable_span(), m_file_size);
+        m_order.push_back(key);
+        m_index.insert_or_assign(key, record_location{ m_file_size, rsz, ::std::prev(m_order.end()) });
+        m_file_size += rsz;
+
+        return true;
+    }
+
+    /*! \brief Read the value of `key` back from the file. Counted in `stats()`. */
+    ::std::optional<ValueType> get(const KeyType& key)
+    {
+        ::std::optional<ValueType> result{};
+        auto it = m_index.find(key);
+        if (it == m_index.end())
+        {
+            ++m_stats.misses;
+            return result;
+        }
+        ++m_stats.hits;
+
+        buffer buf{ it->second.length };
+        const auto record = read_record(it->second, buf);
+        const size_t ksz = decode_big_endian_from<uint32_t>(record);
+        const size_t vsz = decode_big_endian_from<uint32_t>(record.subspan(sizeof(uint32_t)));
+        return result.emplace(ValueSerializer::decode_from(record.subspan(record_header_size + ksz, vsz)));
+    }
+
+    /*! \brief Same as `get()`, but the record will be dropped from this tier,
+     *         this is what a promotion back to a upper tier looks like.
+     */
+    ::std::optional<ValueType> take(const KeyType& key)
+    {
+        auto result = get(key);
+        if (result) erase(key);
+        return result;
+    }
+
+    bool contains(const KeyType& key) const noexcept { return m_index.contains(key); }
+
+    /*! \brief Forget `key`, the record on disk becomes garbage. */
+    bool erase(const KeyType& key) noexcept
+    {
+        auto it = m_index.find(key);
+        if (it == m_index.end()) return false;
+        // `key` may be the one in `m_order`, drop that last.
+        const auto order = it->second.order;
+        m_garbage_bytes += it->second.length;
+        m_index.erase(it);
+        m_order.erase(order);
+        return true;
+    }
+
+    /*! \brief Rewrite all the live records into a fresh log file to reclaim garbage, 
+     *         oldest first, so they keep their eviction order.
+     *  \throw `toolpex::posix_exception` or `std::filesystem::filesystem_error` on I/O errors, 
+     *         the tier is left untouched then, still on the old file.
+     */
+    void compact()
+    {
+        if (m_garbage_bytes == 0) return;
+
+        auto tmp_path = m_path;
+        tmp_path += ".compacting";
+        unique_posix_fd tmp_fd = open_log(tmp_path);
+
+        // The index is updated only after the new file took the place of the old one.
+        ::std::vector<size_t> new_offsets;
+        new_offsets.reserve(m_order.size());
+        size_t new_size{};
+        try
+        {
+            for (const auto& key : m_order)
+            {
+                const auto& loc = m_index.find(key)->second;
+                buffer buf{ loc.length };
+                write_all(tmp_fd, read_record(loc, buf), new_size);
+                new_offsets.push_back(new_size);
+                new_size += loc.length;
+            }
+            ::std::filesystem::rename(tmp_path, m_path);
+        }
+        catch (...)
+        {
+            ::std::error_code ec;
+            ::std::filesystem::remove(tmp_path, ec);
+            throw;
+        }
+
+        auto offset_it = new_offsets.begin();
+        for (const auto& key : m_order)
+            m_index.find(key)->second.offset = *offset_it++;
+        m_fd = ::std::move(tmp_fd);
+        m_file_size = new_size;
+        m_garbage_bytes = 0;
+    }
+
+    void clear()
+    {
+        m_index.clear();
+        m_order.clear();
+        m_garbage_bytes = m_file_size;
+        compact();
+    }
+
+    size_t size() const noexcept { return m_index.size(); }
+    size_t file_size() const noexcept { return m_file_size; }
+    size_t garbage_bytes() const noexcept { return m_garbage_bytes; }
+    size_t capacity_bytes() const noexcept { return m_capacity_bytes; }
+    const cache_tier_stats& stats() const noexcept { return m_stats; }
+    const ::std::filesystem::path& path() const noexcept { return m_path; }
+
+private:
+    using order_type = ::std::list<KeyType>;
+
+    struct record_location
+    {
+        size_t offset{};
+        size_t length{};
+        typename order_type::iterator order;
+    };
+
+    // Evict the oldest records until a compaction reclaims enough, then compact.
+    void make_room(size_t record_size)
+    {
+        const auto enough_garbage = [this] { 
+            return static_cast<double>(m_garbage_bytes) 
+                >= static_cast<double>(m_file_size) * compaction_garbage_ratio;
+        };
+        while (!m_order.empty() 
+               && (m_file_size - m_garbage_bytes + record_size > m_capacity_bytes || !enough_garbage()))
+        {
+            erase(m_order.front());
+            ++m_stats.evictions;
+        }
+        compact();
+    }
+
+    static unique_posix_fd open_log(const ::std::filesystem::path& p)
+    {
+        const int fd = ::open(p.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd < 0) throw posix_exception{ errno };
+        return { fd };
+    }
+
+    static void write_all(int fd, ::std::span<const ::std::byte> data, size_t offset)
+    {
+        while (!data.empty())
+        {
+            const ssize_t ret = ::pwrite(fd, data.data(), data.size(), static_cast<off_t>(offset));
+            if (ret < 0)
+            {
+                if (errno == EINTR) continue;
+                throw posix_exception{ errno };
+            }
+            data = data.subspan(static_cast<size_t>(ret));
+            offset += static_cast<size_t>(ret);
+        }
+    }
+
+    void write_all(::std::span<const ::std::byte> data, size_t offset)
+    {
+        write_all(m_fd, data, offset);
+    }
+
+    ::std::span<const ::std::byte> read_record(const record_location& loc, buffer& buf)
+    {
+        auto sp = buf.writable_span(loc.length).first(loc.length);
+        size_t nread{};
+        while (nread < loc.length)
+        {
+            const ssize_t ret = ::pread(m_fd, sp.data() + nread, loc.length - nread,
+                                        static_cast<off_t>(loc.offset + nread));
+            if (ret < 0)
+            {
+                if (errno == EINTR) continue;
+                throw posix_exception{ errno };
+            }
+            if (ret == 0) throw posix_exception{ EIO };
+            nread += static_cast<size_t>(ret);
+        }
+        buf.commit_write(loc.length);
+        return buf.next_readable_span();
+    }
+
+private:
+    using index_type = ::std::unordered_map<KeyType, record_location, Hash, KeyEq>;
+
+    ::std::filesystem::path m_path;
+    size_t m_capacity_bytes{};
+    unique_posix_fd m_fd;
+    index_type m_index{};
+    order_type m_order{};
+    size_t m_file_size{};
+    size_t m_garbage_bytes{};
+    cache_tier_stats m_stats{};
+};
+
+TOOLPEX_NAMESPACE_END
+
+#endif
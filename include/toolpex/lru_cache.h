@@ -11,23 +11,112 @@
 #include <functional>
 #include <cstddef>
 #include <utility>
+#include <iterator>
 #include <memory>
 #include <optional>
 #include <queue>
 #include <list>
+#include <atomic>
+#include <vector>
+#include <stdexcept>
 
 #include "toolpex/macros.h"
 #include "toolpex/assert.h"
 
 TOOLPEX_NAMESPACE_BEG
 
+/*! \brief The default stats policy of `lru_cache`, counts nothing. */
+struct lru_cache_no_stats
+{
+    constexpr void on_hit() noexcept {}
+    constexpr void on_miss() noexcept {}
+    constexpr void on_insert() noexcept {}
+    constexpr void on_eviction() noexcept {}
+};
+
+/*! \brief  Stats policy of `lru_cache` which counts hits, misses, inserts and evictions.
+ *
+ *  Each cache object (or each shard, if you shard your caches) owns its own counters,
+ *  all of them are relaxed atomics, so they could be read from a metrics thread 
+ *  while the cache is being used, without synchronizing with the cache itself.
+ */
+class lru_cache_stats
+{
+public:
+    lru_cache_stats() noexcept = default;
+
+    lru_cache_stats(const lru_cache_stats& other) noexcept
+        : m_hits{ other.hits() }, 
+          m_misses{ other.misses() }, 
+          m_inserts{ other.inserts() }, 
+          m_evictions{ other.evictions() }
+    {
+    }
+
+    lru_cache_stats& operator=(const lru_cache_stats& other) noexcept
+    {
+        m_hits.store(other.hits(), ::std::memory_order_relaxed);
+        m_misses.store(other.misses(), ::std::memory_order_relaxed);
+        m_inserts.store(other.inserts(), ::std::memory_order_relaxed);
+        m_evictions.store(other.evictions(), ::std::memory_order_relaxed);
+        return *this;
+    }
+
+    void on_hit() noexcept { m_hits.fetch_add(1, ::std::memory_order_relaxed); }
+    void on_miss() noexcept { m_misses.fetch_add(1, ::std::memory_order_relaxed); }
+    void on_insert() noexcept { m_inserts.fetch_add(1, ::std::memory_order_relaxed); }
+    void on_eviction() noexcept { m_evictions.fetch_add(1, ::std::memory_order_relaxed); }
+
+    size_t hits() const noexcept { return m_hits.load(::std::memory_order_relaxed); }
+    size_t misses() const noexcept { return m_misses.load(::std::memory_order_relaxed); }
+    size_t inserts() const noexcept { return m_inserts.load(::std::memory_order_relaxed); }
+    size_t evictions() const noexcept { return m_evictions.load(::std::memory_order_relaxed); }
+
+    /*! \return hits / (hits + misses), or 0 if there's no lookup yet. */
+    double hit_ratio() const noexcept
+    {
+        const size_t h = hits(), total = h + misses();
+        return total ? static_cast<double>(h) / static_cast<double>(total) : 0.0;
+    }
+
+    void reset() noexcept { *this = lru_cache_stats{}; }
+
+    /*! \brief Add the counters of `other` up to this, like aggregating the stats of shards. */
+    lru_cache_stats& operator+=(const lru_cache_stats& other) noexcept
+    {
+        m_hits.fetch_add(other.hits(), ::std::memory_order_relaxed);
+        m_misses.fetch_add(other.misses(), ::std::memory_order_relaxed);
+        m_inserts.fetch_add(other.inserts(), ::std::memory_order_relaxed);
+        m_evictions.fetch_add(other.evictions(), ::std::memory_order_relaxed);
+        return *this;
+    }
+
+private:
+    ::std::atomic_size_t m_hits{};
+    ::std::atomic_size_t m_misses{};
+    ::std::atomic_size_t m_inserts{};
+    ::std::atomic_size_t m_evictions{};
+};
+
+/*! \brief  A classic LRU cache.
+ *  \tparam StatsPolicy    `lru_cache_no_stats` or `lru_cache_stats`, 
+ *                         or any type provides `on_hit()`, `on_miss()`, `on_insert()` and `on_eviction()`.
+ */
 template<
     typename KeyType, 
     typename ValueType, 
     typename Hash = ::std::hash<KeyType>, 
-    typename KeyEq = ::std::equal_to<KeyType>>
+    typename KeyEq = ::std::equal_to<KeyType>, 
+    typename StatsPolicy = lru_cache_no_stats>
 class lru_cache
 {
+public:
+    /*! Invoked with the key and value moved out of the cache when an entry was evicted due to capacity,
+     *  or discarded by `clear()` or `assign()`. 
+     *  Not invoked by the destructor, call `clear()` first if the values hold something to release.
+     */
+    using eviction_listener = ::std::function<void(KeyType&&, ValueType&&)>;
+
 public:
     lru_cache(size_t capacity) 
         : m_capacity{ capacity }
@@ -38,6 +127,23 @@ public:
         }
     }
 
+    lru_cache(size_t capacity, eviction_listener listener) 
+        : lru_cache(capacity)
+    {
+        m_listener = ::std::move(listener);
+    }
+
+    /*! \brief Set the listener which would be invoked with every entry evicted or discarded.
+     *  \return The old listener.
+     */
+    eviction_listener set_eviction_listener(eviction_listener listener) noexcept
+    {
+        return ::std::exchange(m_listener, ::std::move(listener));
+    }
+
+    const StatsPolicy& stats() const noexcept { return m_stats; }
+    StatsPolicy& stats() noexcept { return m_stats; }
+
     bool contains(const KeyType& key) const noexcept
     {
         return m_cache_map.contains(key);
@@ -51,8 +157,10 @@ public:
         {
             // Move the accessed item to the front of the list
             m_cache_list.splice(m_cache_list.begin(), m_cache_list, it->second);
+            m_stats.on_hit();
             return result.emplace(it->second->second);
         }
+        m_stats.on_miss();
         return result; 
     }
 
@@ -75,27 +183,98 @@ public:
             // Insert the new item at the front
             m_cache_list.emplace_front(std::forward<K>(key), std::forward<V>(value));
             m_cache_map[m_cache_list.front().first] = m_cache_list.begin();
+            m_stats.on_insert();
         }
     }
 
+    /*! \brief The entry would be evicted next, its recency is not touched.
+     *  \return nullptr if the cache is empty.
+     */
+    const ::std::pair<KeyType, ValueType>* least_recently_used() const noexcept
+    {
+        return m_cache_list.empty() ? nullptr : &m_cache_list.back();
+    }
+
+    /*! \brief Remove the least recently used entry and hand it to the caller.
+     *         Counted as an eviction, but the eviction listener is not invoked.
+     *  \return The evicted key-value pair, or an empty optional if the cache is empty.
+     */
+    ::std::optional<::std::pair<KeyType, ValueType>> pop_least_recently_used()
+    {
+        ::std::optional<::std::pair<KeyType, ValueType>> result{};
+        if (m_cache_list.empty()) return result;
+
+        m_cache_map.erase(m_cache_list.back().first);
+        m_stats.on_eviction();
+        result.emplace(::std::move(m_cache_list.back()));
+        m_cache_list.pop_back();
+        return result;
+    }
+
+    bool full() const noexcept { return size() >= capacity(); }
+
     size_t capacity() const noexcept { return m_capacity; }
     size_t size()     const noexcept { return m_cache_map.size(); }
-    
-    void clear() noexcept
+
+    /*! \brief Drop all the entries, each of them goes to the eviction listener, if any. */
+    void clear()
     {
         m_cache_map = {};
-        m_cache_list = {};
+        discard(::std::exchange(m_cache_list, {}));
+    }
+
+    /*! \brief The entries from the most recently used one to the least, recency is not touched. */
+    const auto& entries() const noexcept { return m_cache_list; }
+
+    /*! \brief  Replace all the entries by `entries`, ordered from the most recently used one to the least.
+     *          Only the first `capacity()` distinct keys are kept, the later duplicates are ignored.
+     *          Not counted in `stats()`, nothing is inserted by a lookup or a `put()`.
+     *          The replaced entries go to the eviction listener, if any.
+     *  \attention If it throws before replacing, the cache is left untouched.
+     */
+    void assign(::std::vector<::std::pair<KeyType, ValueType>> entries)
+    {
+        cache_list_type list;
+        cache_map_type map;
+        for (auto& [key, value] : entries)
+        {
+            if (map.size() >= m_capacity) break;
+            if (map.contains(key)) continue;
+            list.emplace_back(::std::move(key), ::std::move(value));
+            map[list.back().first] = ::std::prev(list.end());
+        }
+
+        m_cache_list.swap(list);
+        m_cache_map.swap(map);
+        discard(::std::move(list));
     }
 
 private:
-    void evict_if_needed() noexcept
+    // Called after the entries have left the cache, so the listener sees the cache as it is.
+    void discard(auto entries)
+    {
+        if (!m_listener) return;
+        for (auto& [key, value] : entries)
+            m_listener(::std::move(key), ::std::move(value));
+    }
+
+    void evict_if_needed()
     {
         if (m_cache_map.size() < m_capacity) return;
         toolpex_assert(!m_cache_list.empty());
 
         const KeyType& last_key = m_cache_list.back().first;
         m_cache_map.erase(last_key);
+        m_stats.on_eviction();
+        if (!m_listener)
+        {
+            m_cache_list.pop_back();
+            return;
+        }
+
+        auto victim = ::std::move(m_cache_list.back());
         m_cache_list.pop_back();
+        m_listener(::std::move(victim.first), ::std::move(victim.second));
     }
 
 private:
@@ -116,6 +295,8 @@ private:
     size_t          m_capacity{};
     cache_map_type  m_cache_map{};
     cache_list_type m_cache_list{};
+    eviction_listener m_listener{};
+    [[no_unique_address]] StatsPolicy m_stats{};
 };
 
 TOOLPEX_NAMESPACE_END
@@ -0,0 +1,239 @@
+// This file is part of Toolpex
+// https://github.com/JPewterschmidt/toolpex
+//
+// Copyleft 2023 - 2024, ShiXin Wang. All wrongs reserved.
+
+#ifndef TOOLPEX_LRU_CACHE_PERSISTENCE_H
+#define TOOLPEX_LRU_CACHE_PERSISTENCE_H
+
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+#include <iterator>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cerrno>
+#include <span>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "toolpex/macros.h"
+#include "toolpex/lru_cache.h"
+#include "toolpex/encode.h"
+#include "toolpex/cache_serializer.h"
+#include "toolpex/exceptions.h"
+#include "toolpex/unique_posix_fd.h"
+
+TOOLPEX_NAMESPACE_BEG
+
+namespace lru_cache_persistence_detail
+{
+    inline constexpr uint32_t magic = 0x4c525543; // "LRUC"
+    inline constexpr uint32_t flag_keys_only = 1;
+    inline constexpr size_t chunk_size = 64 * 1024;
+    inline constexpr size_t header_size = 2 * sizeof(uint32_t) + sizeof(uint64_t);
+
+    struct header
+    {
+        bool keys_only;
+        uint64_t count;
+        ::std::span<const ::std::byte> rest;
+    };
+
+    inline void write_all(int fd, ::std::string_view data)
+    {
+        while (!data.empty())
+        {
+            const ssize_t ret = ::write(fd, data.data(), data.size());
+            if (ret < 0)
+            {
+                if (errno == EINTR) continue;
+                throw posix_exception{ errno };
+            }
+            data.remove_prefix(static_cast<size_t>(ret));
+        }
+    }
+
+    // Makes a rename in `dir` durable.
+    inline void sync_directory(const ::std::filesystem::path& dir)
+    {
+        unique_posix_fd fd{ ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC) };
+        if (!fd.valid() || ::fsync(fd) < 0) throw posix_exception{ errno };
+    }
+
+    template<typename T>
+    void append_encoded(const T& obj, ::std::string& dst)
+    {
+        const size_t sz = cache_serializer<T>::encoded_size(obj);
+        if (sz > UINT32_MAX)
+            throw ::std::length_error{ "lru_cache save(): the entry is too large for the 32 bits size field." };
+        append_encode_big_endian_to(static_cast<uint32_t>(sz), dst);
+        const size_t oldsz = dst.size();
+        dst.resize(oldsz + sz);
+        cache_serializer<T>::encode_to(obj, ::std::as_writable_bytes(::std::span{ dst }).subspan(oldsz));
+    }
+
+    inline ::std::span<const ::std::byte> take_encoded(::std::span<const ::std::byte>& rest)
+    {
+        if (rest.size() < sizeof(uint32_t))
+            throw ::std::runtime_error{ "lru_cache: truncated persisted file." };
+        const size_t sz = decode_big_endian_from<uint32_t>(rest);
+        rest = rest.subspan(sizeof(uint32_t));
+        if (rest.size() < sz)
+            throw ::std::runtime_error{ "lru_cache: truncated persisted file." };
+        auto result = rest.first(sz);
+        rest = rest.subspan(sz);
+        return result;
+    }
+
+    template<typename T>
+    T take_decoded(::std::span<const ::std::byte>& rest)
+    {
+        return cache_serializer<T>::decode_from(take_encoded(rest));
+    }
+
+    inline ::std::string read_file(const ::std::filesystem::path& p)
+    {
+        ::std::ifstream ifs{ p, ::std::ios::binary };
+        if (!ifs) throw ::std::runtime_error{ "lru_cache: can not open the persisted file." };
+        return { ::std::istreambuf_iterator<char>{ ifs }, ::std::istreambuf_iterator<char>{} };
+    }
+
+    inline header parse_header(const ::std::string& content)
+    {
+        auto bytes = ::std::as_bytes(::std::span{ content });
+        if (bytes.size() < header_size || decode_big_endian_from<uint32_t>(bytes) != magic)
+            throw ::std::runtime_error{ "lru_cache: not a persisted lru_cache file." };
+
+        const auto flags = decode_big_endian_from<uint32_t>(bytes.subspan(sizeof(uint32_t)));
+        const auto count = decode_big_endian_from<uint64_t>(bytes.subspan(2 * sizeof(uint32_t)));
+        return { (flags & flag_keys_only) != 0, count, bytes.subspan(header_size) };
+    }
+}
+
+/*! \brief  Dump the entries of `cache` to a file, from the most recently used one to the least.
+ *
+ *  File layout: `[u32 magic][u32 flags][u64 count]` followed by `count` records of
+ *  `[u32 key size][key bytes]` and, unless `keys_only`, `[u32 value size][value bytes]`.
+ *  Every integer is big endian, keys and values are encoded by `cache_serializer`.
+ *
+ *  The entries are written to a temporary file next to `p` first,
+ *  which is synced to disk, then replaces `p`, and the directory is synced too.
+ *  So a failed save, or a crash in the middle, leaves the previous snapshot intact.
+ *
+ *  \param keys_only Only the keys will be saved,
+ *                   use `load_keys()` to get them back and refetch values lazily.
+ *  \throw  `std::length_error` if an encoded key or value exceeds `UINT32_MAX` bytes,
+ *          `toolpex::posix_exception` or `std::filesystem::filesystem_error` on I/O errors,
+ *          the temporary file is removed then.
+ */
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEq, typename StatsPolicy>
+void save(const lru_cache<KeyType, ValueType, Hash, KeyEq, StatsPolicy>& cache,
+          const ::std::filesystem::path& p, bool keys_only = false)
+{
+    namespace detail = lru_cache_persistence_detail;
+
+    auto tmp_path = p;
+    tmp_path += ".saving";
+    unique_posix_fd fd{ ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+    if (!fd.valid()) throw posix_exception{ errno };
+
+    try
+    {
+        ::std::string chunk;
+        append_encode_big_endian_to(detail::magic, chunk);
+        append_encode_big_endian_to(keys_only ? detail::flag_keys_only : uint32_t{}, chunk);
+        append_encode_big_endian_to(static_cast<uint64_t>(cache.size()), chunk);
+
+        for (const auto& [key, value] : cache.entries())
+        {
+            detail::append_encoded<KeyType>(key, chunk);
+            if (!keys_only) detail::append_encoded<ValueType>(value, chunk);
+
+            if (chunk.size() >= detail::chunk_size)
+            {
+                detail::write_all(fd, chunk);
+                chunk.clear();
+            }
+        }
+        detail::write_all(fd, chunk);
+
+        // Or the rename could reach the disk before the data does.
+        if (::fsync(fd) < 0) throw posix_exception{ errno };
+        fd.close();
+        ::std::filesystem::rename(tmp_path, p);
+    }
+    catch (...)
+    {
+        ::std::error_code ec;
+        ::std::filesystem::remove(tmp_path, ec);
+        throw;
+    }
+    detail::sync_directory(p.has_parent_path() ? p.parent_path() : ::std::filesystem::path{ "." });
+}
+
+/*! \brief  Replace the content of `cache` with the entries saved by `save()`, by `lru_cache::assign()`.
+ *
+ *  Recency order will be restored. If there are more entries than the capacity,
+ *  only the most recently used ones are loaded.
+ *
+ *  \return The number of entries loaded.
+ *  \throw  `std::runtime_error` if the file is truncated or corrupted,
+ *          the cache is left untouched then.
+ *  \attention The file must not be keys only.
+ */
+template<typename KeyType, typename ValueType, typename Hash, typename KeyEq, typename StatsPolicy>
+size_t load(lru_cache<KeyType, ValueType, Hash, KeyEq, StatsPolicy>& cache, const ::std::filesystem::path& p)
+{
+    namespace detail = lru_cache_persistence_detail;
+
+    const auto content = detail::read_file(p);
+    auto [keys_only, count, rest] = detail::parse_header(content);
+    if (keys_only)
+        throw ::std::runtime_error{ "lru_cache load(): the file contains keys only, use load_keys()." };
+
+    // Decoded aside, assigned only if the whole file is fine.
+    ::std::vector<::std::pair<KeyType, ValueType>> entries;
+    entries.reserve(::std::min<uint64_t>({ count, cache.capacity(), rest.size() / (2 * sizeof(uint32_t)) }));
+    for (uint64_t i{}; i < count && entries.size() < cache.capacity(); ++i)
+    {
+        auto key = detail::take_decoded<KeyType>(rest);
+        auto value = detail::take_decoded<ValueType>(rest);
+        entries.emplace_back(::std::move(key), ::std::move(value));
+    }
+
+    cache.assign(::std::move(entries));
+    return cache.size();
+}
+
+/*! \brief  Get the keys saved by `save()`, from the most recently used one to the least.
+ *          Works for both keys only and full files.
+ */
+template<typename KeyType>
+::std::vector<KeyType> load_keys(const ::std::filesystem::path& p)
+{
+    namespace detail = lru_cache_persistence_detail;
+
+    const auto content = detail::read_file(p);
+    auto [keys_only, count, rest] = detail::parse_header(content);
+
+    ::std::vector<KeyType> result;
+    // A corrupted count must not make a huge allocation, every record has a size field at least.
+    result.reserve(::std::min<uint64_t>(count, rest.size() / sizeof(uint32_t)));
+    for (uint64_t i{}; i < count; ++i)
+    {
+        result.push_back(detail::take_decoded<KeyType>(rest));
+        if (!keys_only) (void)detail::take_encoded(rest);
+    }
+    return result;
+}
+
+TOOLPEX_NAMESPACE_END
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef TOOLPEX_MMAP_RESOURCE_H
+#define TOOLPEX_MMAP_RESOURCE_H
+
+#include <memory_resource>
+#include <filesystem>
+#include <cstddef>
+#include <atomic>
+
+#include "toolpex/buffer.h"
+
+namespace toolpex
+{
+
+/**
+ *  @class  mmap_resource
+ *  @brief  A `memory_resource` serves large blocks from anonymous `mmap`, for bulk transfers.
+ *
+ *  Requests of at least `huge_page_size` bytes are aligned to `huge_page_size`
+ *  and advised with `MADV_HUGEPAGE`, so they could be backed by transparent huge pages.
+ *  If the kernel doesn't support it, they are just ordinary pages.
+ *  Requests smaller than `min_mmap_size` go to the upstream resource,
+ *  a syscall per small block is never worth it.
+ */
+class mmap_resource : public ::std::pmr::memory_resource
+{
+public:
+    static constexpr size_t huge_page_size = 2 * 1024 * 1024;
+
+public:
+    /// @param upstream `nullptr` means `buffer_block_pool::default_pool()`.
+    explicit mmap_resource(bool use_hugepage = true,
+                           size_t min_mmap_size = 64 * 1024,
+                           ::std::pmr::memory_resource* upstream = nullptr) noexcept;
+
+    mmap_resource(const mmap_resource&) = delete;
+    mmap_resource& operator=(const mmap_resource&) = delete;
+
+    /// @return Bytes currently mapped by this resource.
+    size_t mapped_bytes() const noexcept { return m_mapped_bytes.load(::std::memory_order_relaxed); }
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const ::std::pmr::memory_resource& other) const noexcept override;
+
+private:
+    bool hugepage_eligible(size_t bytes) const noexcept;
+    size_t mapping_size(size_t bytes) const noexcept;
+
+private:
+    bool m_use_hugepage{};
+    size_t m_min_mmap_size{};
+    ::std::pmr::memory_resource* m_upstream{};
+    ::std::atomic_size_t m_mapped_bytes{};
+};
+
+/**
+ * @brief   Map a file read only, and wrap it as the blocks of a buffer,
+ *          so the contents could be parsed through the `buffer` API without `read()` copies.
+ *          Bytes appended later go to ordinary blocks.
+ *          The mapped blocks are read only, mutable access to one of them,
+ *          like writing to a `dup()` or `slice()` of the buffer, copies it into an ordinary block first.
+ * @param   block_size  Size of each block, rounded up to the page size,
+ *                      the last one might be smaller.
+ * @throw   `toolpex::posix_exception` if the file couldn't be opened or mapped.
+ * @attention   Truncating the file while it's mapped gets you a `SIGBUS`.
+ */
+buffer mapped_file_buffer(const ::std::filesystem::path& path,
+                          size_t block_size = 256 * 1024 * 1024);
+
+} // namespace toolpex
+
+#endif
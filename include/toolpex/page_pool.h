@@ -0,0 +1,113 @@
+// This file is part of Toolpex
+// https://github.com/JPewterschmidt/toolpex
+//
+// Copyleft 2023 - 2024, ShiXin Wang. All wrongs reserved.
+
+#ifndef TOOLPEX_PAGE_POOL_H
+#define TOOLPEX_PAGE_POOL_H
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+#include "toolpex/macros.h"
+#include "toolpex/spin_lock.h"
+#include "toolpex/page.h"
+
+TOOLPEX_NAMESPACE_BEG
+
+class page_pool;
+
+/*! \brief  The `Alloc` of `::page` which takes the pages from a `page_pool`.
+ *          `allocate()` throws `std::bad_alloc` once the pool is exhausted.
+ */
+class page_pool_allocator
+{
+public:
+    using value_type = char;
+
+public:
+    explicit page_pool_allocator(page_pool* pool) noexcept : m_pool{ pool } {}
+
+    char* allocate(size_t n);
+    void deallocate(char* p, size_t n) noexcept;
+
+    page_pool* pool() const noexcept { return m_pool; }
+    bool operator==(const page_pool_allocator&) const noexcept = default;
+
+private:
+    page_pool* m_pool{};
+};
+
+/*! \brief  A fixed number of fixed-size, page aligned pages carved from one slab.
+ *
+ *  The slab is mapped once by the constructor, optionally `mlock`ed,
+ *  and `page` objects made by `acquire()` return their storage to the pool on destruction.
+ *  So acquiring and dropping pages costs neither a syscall nor a `malloc`,
+ *  only a short critical section of a spin lock.
+ *
+ *  \attention  Every page has to be destructed before the pool.
+ */
+class page_pool
+{
+public:
+    using page_type = ::page<page_pool_allocator>;
+
+public:
+    /*! \param  page_size   A multiple of the system page size.
+     *  \param  npages      Number of pages of the slab.
+     *  \param  lock_memory `mlock` the slab, so the pages never get swapped out.
+     *  \throw  `std::invalid_argument` on a bad `page_size` or `npages`,
+     *          `toolpex::posix_exception` if the slab could not be mapped or locked.
+     */
+    page_pool(size_t page_size, size_t npages, bool lock_memory = false);
+    ~page_pool() noexcept;
+
+    page_pool(const page_pool&) = delete;
+    page_pool& operator=(const page_pool&) = delete;
+
+    /*! \brief  Take a page from the pool.
+     *  \throw  `std::bad_alloc` if all the pages are in use.
+     */
+    page_type acquire();
+
+    /*! \return `std::nullopt` if all the pages are in use. */
+    ::std::optional<page_type> try_acquire();
+
+    size_t page_size() const noexcept { return m_page_size; }
+    size_t capacity() const noexcept { return m_npages; }
+    bool locked() const noexcept { return m_locked; }
+
+    // Occupancy, not synchronized with each other.
+    size_t in_use() const noexcept { return m_in_use.load(::std::memory_order_relaxed); }
+    size_t available() const noexcept { return capacity() - in_use(); }
+    size_t peak_in_use() const noexcept { return m_peak_in_use.load(::std::memory_order_relaxed); }
+
+    /*! \return Whether `p` points to the beginning of a page of this pool. */
+    bool owns(const void* p) const noexcept;
+
+private:
+    friend class page_pool_allocator;
+
+    char* pop() noexcept;
+    void push(char* p) noexcept;
+
+private:
+    size_t m_page_size{};
+    size_t m_npages{};
+    size_t m_slab_size{};
+    char* m_slab{};
+    bool m_locked{};
+
+    spin_lock m_lock;
+    ::std::vector<char*> m_free;
+    ::std::atomic_size_t m_in_use{};
+    ::std::atomic_size_t m_peak_in_use{};
+};
+
+TOOLPEX_NAMESPACE_END
+
+#endif
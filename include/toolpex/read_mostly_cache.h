@@ -0,0 +1,335 @@
+// This file is part of Toolpex
+// https://github.com/JPewterschmidt/toolpex
+//
+// Copyleft 2023 - 2024, ShiXin Wang. All wrongs reserved.
+
+#ifndef TOOLPEX_READ_MOSTLY_CACHE_H
+#define TOOLPEX_READ_MOSTLY_CACHE_H
+
+#include <functional>
+#include <concepts>
+#include <optional>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <memory>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <bit>
+
+#include "toolpex/macros.h"
+#include "toolpex/assert.h"
+
+TOOLPEX_NAMESPACE_BEG
+
+/*! \brief  A cache optimized for read mostly workloads, lookups never take a lock.
+ *
+ *  Entries live in a fixed size hash table of singly linked chains.
+ *  A node is immutable after it was published, writers (insert, update, eviction)
+ *  serialize on a mutex and only swing `next` pointers,
+ *  readers traverse the chains with acquire loads inside a read side critical section.
+ *  Unlinked nodes are retired, and freed in batch after a grace period (a SRCU like
+ *  two-phase epoch, reader counters are spread over cache line padded slots).
+ *
+ *  Each lookup does two atomic RMWs on the reader slot of its thread.
+ *  Threads take slots round robin, the first `reader_slots` threads which ever read
+ *  get one of their own, later ones share, and the shared slots bounce between them.
+ *
+ *  Recency is approximated: each hit stores a coarse logical clock into the node
+ *  with a relaxed store (skipped if already up to date, so hot entries don't bounce cache lines),
+ *  and eviction picks the oldest of a few sampled entries, like Redis' approximated LRU.
+ *
+ *  \attention `ValueType` has to be copyable, `get()` returns a copy made inside the critical section.
+ */
+template<
+    typename KeyType,
+    typename ValueType,
+    typename Hash = ::std::hash<KeyType>,
+    typename KeyEq = ::std::equal_to<KeyType>>
+class read_mostly_cache
+{
+public:
+    static constexpr size_t eviction_sample_size = 5;
+    static constexpr size_t retire_batch_size = 64;
+    static constexpr size_t reader_slots = 64;
+
+public:
+    read_mostly_cache(size_t capacity)
+        : m_capacity{ capacity },
+          m_nbuckets{ ::std::bit_ceil(capacity ? capacity : 1) },
+          m_buckets{ ::std::make_unique<::std::atomic<node*>[]>(m_nbuckets) }
+    {
+        if (capacity == 0)
+        {
+            throw std::invalid_argument("Capacity must be a positive integer.");
+        }
+    }
+
+    read_mostly_cache(const read_mostly_cache&) = delete;
+    read_mostly_cache& operator=(const read_mostly_cache&) = delete;
+
+    ~read_mostly_cache() noexcept
+    {
+        // No reader could be alive here.
+        for (size_t i{}; i < m_nbuckets; ++i)
+        {
+            node* n = m_buckets[i].load(::std::memory_order_relaxed);
+            while (n) delete ::std::exchange(n, n->next.load(::std::memory_order_relaxed));
+        }
+        for (node* n : m_retired) delete n;
+    }
+
+    /*! \brief Lock free lookup. */
+    ::std::optional<ValueType> get(const KeyType& key) const
+    {
+        ::std::optional<ValueType> result{};
+        read_guard g{ *this };
+        if (node* n = find(key); n)
+        {
+            const auto now = m_clock.load(::std::memory_order_relaxed);
+            if (n->last_access.load(::std::memory_order_relaxed) != now)
+                n->last_access.store(now, ::std::memory_order_relaxed);
+            result.emplace(n->value);
+        }
+        return result;
+    }
+
+    /*! \brief Lock free lookup, won't refresh the recency. */
+    bool contains(const KeyType& key) const
+    {
+        read_guard g{ *this };
+        return find(key) != nullptr;
+    }
+
+    template<std::convertible_to<KeyType>   K,
+             std::convertible_to<ValueType> V>
+    void put(K&& key, V&& value)
+    {
+        ::std::lock_guard lk{ m_write_lock };
+
+        const auto now = m_clock.fetch_add(1, ::std::memory_order_relaxed) + 1;
+        auto* n = new node(::std::forward<K>(key), ::std::forward<V>(value), now);
+        auto& bucket = bucket_of(n->key);
+
+        node* old = find_in_chain(bucket.load(::std::memory_order_relaxed), n->key);
+        if (!old && m_size == m_capacity)
+        {
+            evict_one();
+        }
+
+        n->next.store(bucket.load(::std::memory_order_relaxed), ::std::memory_order_relaxed);
+        bucket.store(n, ::std::memory_order_release);
+
+        if (old)
+        {
+            unlink(bucket, old);
+            retire(old);
+        }
+        else ++m_size;
+    }
+
+    bool erase(const KeyType& key)
+    {
+        ::std::lock_guard lk{ m_write_lock };
+        auto& bucket = bucket_of(key);
+        node* n = find_in_chain(bucket.load(::std::memory_order_relaxed), key);
+        if (!n) return false;
+        unlink(bucket, n);
+        retire(n);
+        --m_size;
+        return true;
+    }
+
+    void clear()
+    {
+        ::std::lock_guard lk{ m_write_lock };
+        for (size_t i{}; i < m_nbuckets; ++i)
+        {
+            node* n = m_buckets[i].exchange(nullptr, ::std::memory_order_acq_rel);
+            while (n) m_retired.push_back(::std::exchange(n, n->next.load(::std::memory_order_relaxed)));
+        }
+        m_size = 0;
+        reclaim();
+    }
+
+    size_t capacity() const noexcept { return m_capacity; }
+    size_t size() const noexcept
+    {
+        ::std::lock_guard lk{ m_write_lock };
+        return m_size;
+    }
+
+private:
+    struct node
+    {
+        template<typename K, typename V>
+        node(K&& k, V&& v, uint64_t t)
+            : key{ ::std::forward<K>(k) },
+              value{ ::std::forward<V>(v) },
+              last_access{ t }
+        {
+        }
+
+        const KeyType key;
+        const ValueType value;
+        ::std::atomic<uint64_t> last_access;
+        ::std::atomic<node*> next{};
+    };
+
+    struct alignas(64) reader_slot
+    {
+        ::std::atomic_size_t readers[2]{};
+    };
+
+    class read_guard
+    {
+    public:
+        read_guard(const read_mostly_cache& c) noexcept
+            : m_slot{ &c.m_reader_slots[this_thread_slot()] }
+        {
+            for (;;)
+            {
+                const auto e = c.m_epoch.load(::std::memory_order_seq_cst);
+                m_parity = e & 1;
+                m_slot->readers[m_parity].fetch_add(1, ::std::memory_order_seq_cst);
+                if (c.m_epoch.load(::std::memory_order_seq_cst) == e)
+                    break;
+                m_slot->readers[m_parity].fetch_sub(1, ::std::memory_order_release);
+            }
+        }
+
+        ~read_guard() noexcept
+        {
+            m_slot->readers[m_parity].fetch_sub(1, ::std::memory_order_release);
+        }
+
+        read_guard(const read_guard&) = delete;
+        read_guard& operator=(const read_guard&) = delete;
+
+    private:
+        static size_t this_thread_slot() noexcept
+        {
+            // Round robin rather than hashing the thread id, which collides long before all slots are taken.
+            static ::std::atomic_size_t next_slot{};
+            thread_local const size_t idx = next_slot.fetch_add(1, ::std::memory_order_relaxed) % reader_slots;
+            return idx;
+        }
+
+    private:
+        reader_slot* m_slot{};
+        size_t m_parity{};
+    };
+
+private:
+    ::std::atomic<node*>& bucket_of(const KeyType& key) const noexcept
+    {
+        return m_buckets[Hash{}(key) & (m_nbuckets - 1)];
+    }
+
+    static node* find_in_chain(node* n, const KeyType& key) noexcept
+    {
+        for (; n; n = n->next.load(::std::memory_order_acquire))
+        {
+            if (KeyEq{}(n->key, key)) return n;
+        }
+        return nullptr;
+    }
+
+    node* find(const KeyType& key) const noexcept
+    {
+        return find_in_chain(bucket_of(key).load(::std::memory_order_acquire), key);
+    }
+
+    /*! The `next` of the unlinked node is left untouched,
+     *  so readers standing on it could still walk through.
+     */
+    void unlink(::std::atomic<node*>& bucket, node* n) noexcept
+    {
+        node* succ = n->next.load(::std::memory_order_relaxed);
+        node* cur = bucket.load(::std::memory_order_relaxed);
+        if (cur == n)
+        {
+            bucket.store(succ, ::std::memory_order_release);
+            return;
+        }
+        while (cur->next.load(::std::memory_order_relaxed) != n)
+        {
+            cur = cur->next.load(::std::memory_order_relaxed);
+            toolpex_assert(cur);
+        }
+        cur->next.store(succ, ::std::memory_order_release);
+    }
+
+    void evict_one()
+    {
+        node* victim{};
+        ::std::atomic<node*>* victim_bucket{};
+        uint64_t oldest{ ::std::numeric_limits<uint64_t>::max() };
+        size_t sampled{};
+
+        const size_t start = m_rng() & (m_nbuckets - 1);
+        for (size_t i{}; i < m_nbuckets && sampled < eviction_sample_size; ++i)
+        {
+            auto& bucket = m_buckets[(start + i) & (m_nbuckets - 1)];
+            for (node* n = bucket.load(::std::memory_order_relaxed);
+                 n && sampled < eviction_sample_size;
+                 n = n->next.load(::std::memory_order_relaxed), ++sampled)
+            {
+                if (const auto t = n->last_access.load(::std::memory_order_relaxed); t < oldest)
+                {
+                    oldest = t;
+                    victim = n;
+                    victim_bucket = &bucket;
+                }
+            }
+        }
+
+        toolpex_assert(victim);
+        unlink(*victim_bucket, victim);
+        retire(victim);
+        --m_size;
+    }
+
+    void retire(node* n)
+    {
+        m_retired.push_back(n);
+        if (m_retired.size() >= retire_batch_size)
+            reclaim();
+    }
+
+    /*! Wait for a grace period, then free all the retired nodes. */
+    void reclaim() noexcept
+    {
+        const auto old = m_epoch.fetch_add(1, ::std::memory_order_seq_cst);
+        for (auto& slot : m_reader_slots)
+        {
+            while (slot.readers[old & 1].load(::std::memory_order_seq_cst) != 0)
+                ::std::this_thread::yield();
+        }
+        for (node* n : m_retired) delete n;
+        m_retired.clear();
+    }
+
+private:
+    size_t m_capacity{};
+    size_t m_nbuckets{};
+    ::std::unique_ptr<::std::atomic<node*>[]> m_buckets;
+    size_t m_size{};
+
+    ::std::atomic<uint64_t> m_clock{};
+    mutable ::std::atomic<uint64_t> m_epoch{};
+    mutable reader_slot m_reader_slots[reader_slots]{};
+
+    mutable ::std::mutex m_write_lock;
+    ::std::vector<node*> m_retired;
+    ::std::minstd_rand m_rng{};
+};
+
+TOOLPEX_NAMESPACE_END
+
+#endif
@@ -7,9 +7,28 @@
 #define TOOLPEX_SPECIFIC_COUNTER_HANDLER_H
 
 #include "toolpex/macros.h"
+#include <utility>
+#include <concepts>
 
 TOOLPEX_NAMESPACE_BEG
 
+/*! \brief  Counters which keep a slot for each execution unit 
+ *          define `execution_unit_slot`, and register the execution units by
+ *          `execution_unit_slot* count_register_execution_unit(ExecutionIdType)`,
+ *          a handler holds the slot, so the counter never has to look it up.
+ */
+template<typename Counter>
+concept counter_with_execution_unit_slot = requires { typename Counter::execution_unit_slot; };
+
+namespace specific_counter_handler_detail
+{
+    template<typename Counter>
+    struct slot_pointer { using type = ::std::nullptr_t; };
+
+    template<counter_with_execution_unit_slot Counter>
+    struct slot_pointer<Counter> { using type = typename Counter::execution_unit_slot*; };
+}
+
 /*! \brief  RAII per thread or coroutine counter handler.
  *  Objects of this type will do some clearning up after it's lifetime.
  *  And forward counter operation to the underlying counter object.
@@ -18,30 +37,37 @@ template<typename ExecutionIdType, typename Counter>
 class specific_counter_handler
 {
 public:
-    specific_counter_handler(ExecutionIdType id, Counter& cnt) noexcept
+    using slot_pointer = typename specific_counter_handler_detail::slot_pointer<Counter>::type;
+
+public:
+    specific_counter_handler(ExecutionIdType id, Counter& cnt) 
         : m_parent{ &cnt }, 
           m_tid{ ::std::move(id) }
     {
+        if constexpr (counter_with_execution_unit_slot<Counter>)
+            m_slot = m_parent->count_register_execution_unit(m_tid);
     }
 
     specific_counter_handler(specific_counter_handler&& other) noexcept
         : m_parent{ ::std::exchange(other.m_parent, nullptr) }, 
-          m_tid{ ::std::move(other.m_tid) }
+          m_tid{ ::std::move(other.m_tid) }, 
+          m_slot{ ::std::exchange(other.m_slot, nullptr) }
     {
     }
 
     specific_counter_handler& 
     operator=(specific_counter_handler&& other) noexcept
     {
+        unregister();
         m_parent = ::std::exchange(other.m_parent, nullptr);
         m_tid = other.m_tid;
+        m_slot = ::std::exchange(other.m_slot, nullptr);
         return *this;
     }
 
     ~specific_counter_handler() noexcept
     {
-        if (!m_parent) return;
-        m_parent->count_unregister_execution_unit(m_tid);
+        unregister();
     }
 
     /*! \return The execution unit indicator 
@@ -50,6 +76,9 @@ public:
      */
     auto tid() const noexcept { return m_tid; }
 
+    /*! \return The slot of this execution unit, `nullptr` if the counter doesn't keep slots. */
+    slot_pointer slot() const noexcept { return m_slot; }
+
     decltype(auto) add_count(::std::integral auto delta) noexcept
     {
         return m_parent->add_count(*this, delta);
@@ -60,14 +89,30 @@ public:
         return m_parent->sub_count(*this, delta);
     }
 
+    decltype(auto) inc() noexcept
+    {
+        return m_parent->inc(*this);
+    }
+
     decltype(auto) read_count() noexcept
     {
         return m_parent->read_count(*this);
     }
 
+private:
+    void unregister() noexcept
+    {
+        if (!m_parent) return;
+        if constexpr (counter_with_execution_unit_slot<Counter>)
+            m_parent->count_unregister_execution_unit(m_tid, m_slot);
+        else m_parent->count_unregister_execution_unit(m_tid);
+        m_parent = nullptr;
+    }
+
 private:
     Counter* m_parent{};
     ExecutionIdType m_tid;
+    [[no_unique_address]] slot_pointer m_slot{};
 };
 
 TOOLPEX_NAMESPACE_END
@@ -0,0 +1,99 @@
+#ifndef TOOLPEX_SPSC_BYTE_RING_H
+#define TOOLPEX_SPSC_BYTE_RING_H
+
+#include <span>
+#include <atomic>
+#include <cstddef>
+
+namespace toolpex
+{
+
+/**
+ *  @class  spsc_byte_ring
+ *  @brief  A fixed capacity, lock free, single producer single consumer byte ring,
+ *          speaks the same `writable_span()` / `commit_write()` /
+ *          `next_readable_span()` / `commit_read()` vocabulary as `buffer`.
+ *
+ *  The capacity is a power of two, the head and tail are free running counters
+ *  living in separated cache lines, each side caches the counter of the other side
+ *  and only reloads it when the cached one would give a span shorter than the longest possible.
+ *
+ *  With `double_mapped`, the storage is mapped twice back to back,
+ *  so spans never stop at the wraparound point.
+ *  If the system doesn't support it, the ring falls back to a single mapping,
+ *  check `double_mapped()`.
+ *
+ *  @attention  Producer side functions must be called by only one thread, so as the consumer side.
+ */
+class spsc_byte_ring
+{
+public:
+    static constexpr size_t cache_line_size = 64;
+
+public:
+    /**
+     * @param capacity  Rounded up to a power of two,
+     *                  and to the page size if `double_mapped`.
+     */
+    explicit spsc_byte_ring(size_t capacity, bool double_mapped = false);
+    ~spsc_byte_ring() noexcept;
+
+    spsc_byte_ring(const spsc_byte_ring&) = delete;
+    spsc_byte_ring& operator=(const spsc_byte_ring&) = delete;
+
+    size_t capacity() const noexcept { return m_capacity; }
+    bool double_mapped() const noexcept { return m_double_mapped; }
+
+    // Producer side ---------------------------------------------------
+
+    /// @return The contiguous free space, empty if the ring is full.
+    ::std::span<::std::byte> writable_span() noexcept;
+    bool commit_write(size_t nbytes_wrote) noexcept;
+
+    /// @return The number of bytes copied, less than `bytes.size()` if the ring is full.
+    size_t write(::std::span<const ::std::byte> bytes) noexcept;
+
+    // Consumer side ---------------------------------------------------
+
+    /// @return The contiguous readable bytes, empty if the ring is empty.
+    ::std::span<const ::std::byte> next_readable_span() noexcept;
+    bool commit_read(size_t nbytes_read) noexcept;
+
+    /// @return The number of bytes copied.
+    size_t read(::std::span<::std::byte> out) noexcept;
+
+    // Either side -----------------------------------------------------
+
+    /// @return A snapshot, which may be stale already when you see it.
+    size_t readable_bytes() const noexcept;
+    bool empty() const noexcept { return readable_bytes() == 0; }
+
+private:
+    bool map_twice();
+
+private:
+    struct alignas(cache_line_size) producer_side
+    {
+        ::std::atomic_size_t head{};
+        size_t cached_tail{};
+    };
+
+    struct alignas(cache_line_size) consumer_side
+    {
+        ::std::atomic_size_t tail{};
+        size_t cached_head{};
+    };
+
+    producer_side m_producer;
+    consumer_side m_consumer;
+
+    // Read only after construction, shared by both sides.
+    alignas(cache_line_size) size_t m_capacity{};
+    size_t m_mask{};
+    ::std::byte* m_storage{};
+    bool m_double_mapped{};
+};
+
+} // namespace toolpex
+
+#endif
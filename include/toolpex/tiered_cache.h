@@ -0,0 +1,137 @@
+// This file is part of Toolpex
+// https://github.com/JPewterschmidt/toolpex
+//
+// Copyleft 2023 - 2024, ShiXin Wang. All wrongs reserved.
+
+#ifndef TOOLPEX_TIERED_CACHE_H
+#define TOOLPEX_TIERED_CACHE_H
+
+#include <filesystem>
+#include <functional>
+#include <concepts>
+#include <optional>
+#include <cstddef>
+#include <utility>
+
+#include "toolpex/macros.h"
+#include "toolpex/lru_cache.h"
+#include "toolpex/file_cache_tier.h"
+
+TOOLPEX_NAMESPACE_BEG
+
+/*! \brief  A two-tier cache, an in-memory `lru_cache` backed by a `file_cache_tier`.
+ *
+ *  Entries evicted from the memory tier are spilled into the file tier
+ *  instead of being dropped. A lookup which misses the memory tier checks
+ *  the file tier before giving up (or calling the loader),
+ *  a file tier hit promotes the entry back into memory.
+ *  The spills are counted as evictions in `memory_tier().stats()`.
+ *
+ *  \attention Not thread safe, just like `lru_cache`.
+ */
+template<
+    typename KeyType,
+    typename ValueType,
+    typename Hash = ::std::hash<KeyType>,
+    typename KeyEq = ::std::equal_to<KeyType>,
+    typename KeySerializer = cache_serializer<KeyType>,
+    typename ValueSerializer = cache_serializer<ValueType>>
+class tiered_cache
+{
+public:
+    using memory_tier_type = lru_cache<KeyType, ValueType, Hash, KeyEq, lru_cache_stats>;
+    using file_tier_type = file_cache_tier<KeyType, ValueType, Hash, KeyEq, KeySerializer, ValueSerializer>;
+
+public:
+    /*! \param  memory_capacity     Number of entries the memory tier holds.
+     *  \param  file_path           Path of the log file of the secondary tier.
+     *  \param  file_capacity_bytes Maximum size of the log file.
+     */
+    tiered_cache(size_t memory_capacity,
+                 ::std::filesystem::path file_path,
+                 size_t file_capacity_bytes)
+        : m_memory{ memory_capacity },
+          m_file{ ::std::move(file_path), file_capacity_bytes }
+    {
+    }
+
+    bool contains(const KeyType& key) const noexcept
+    {
+        return m_memory.contains(key) || m_file.contains(key);
+    }
+
+    /*! \brief Look the key up in memory, then in the file tier. */
+    ::std::optional<ValueType> get(const KeyType& key)
+    {
+        if (auto result = m_memory.get(key); result)
+            return result;
+
+        // Dropped from the file tier only after the promotion succeeded.
+        auto result = m_file.get(key);
+        if (result) 
+        {
+            put_memory(key, *result);
+            m_file.erase(key);
+        }
+        return result;
+    }
+
+    /*! \brief Same as `get()`, but call `loader(key)` when both tiers miss,
+     *         the loaded value will be cached in the memory tier.
+     */
+    template<typename Loader>
+    requires ::std::convertible_to<::std::invoke_result_t<Loader&, const KeyType&>, ValueType>
+    ValueType get_or_load(const KeyType& key, Loader&& loader)
+    {
+        if (auto result = get(key); result)
+            return ::std::move(*result);
+
+        ValueType value = ::std::invoke(loader, key);
+        put_memory(key, value);
+        return value;
+    }
+
+    template<std::convertible_to<KeyType>   K,
+             std::convertible_to<ValueType> V>
+    void put(K&& key, V&& value)
+    {
+        m_file.erase(key);
+        put_memory(::std::forward<K>(key), ::std::forward<V>(value));
+    }
+
+    void clear()
+    {
+        m_memory.clear();
+        m_file.clear();
+    }
+
+    size_t size() const noexcept { return m_memory.size() + m_file.size(); }
+    const memory_tier_type& memory_tier() const noexcept { return m_memory; }
+    const file_tier_type& file_tier() const noexcept { return m_file; }
+
+    const lru_cache_stats& memory_stats() const noexcept { return m_memory.stats(); }
+    const cache_tier_stats& file_stats() const noexcept { return m_file.stats(); }
+
+private:
+    template<typename K, typename V>
+    void put_memory(K&& key, V&& value)
+    {
+        // Spill the victim first, a throwing spill leaves it in memory.
+        // It's then evicted by `put()`, through the bookkeeping of the memory tier.
+        if (!m_memory.contains(key) && m_memory.full())
+        {
+            const auto* victim = m_memory.least_recently_used();
+            toolpex_assert(victim);
+            m_file.put(victim->first, victim->second);
+        }
+        m_memory.put(::std::forward<K>(key), ::std::forward<V>(value));
+    }
+
+private:
+    memory_tier_type m_memory;
+    file_tier_type m_file;
+};
+
+TOOLPEX_NAMESPACE_END
+
+#endif
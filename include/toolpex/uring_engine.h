@@ -0,0 +1,151 @@
+#ifndef TOOLPEX_URING_ENGINE_H
+#define TOOLPEX_URING_ENGINE_H
+
+#include <memory_resource>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "toolpex/buffer.h"
+#include "toolpex/callback_promise.h"
+#include "toolpex/unique_posix_fd.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace toolpex
+{
+
+/**
+ *  @class  uring_engine
+ *  @brief  A Linux only asynchronous I/O engine drives `buffer`s over io_uring,
+ *          by raw syscalls, no liburing needed.
+ *
+ *  `submit_read()` / `submit_write()` only queue requests,
+ *  a single `submit()` (or `wait()`) hands the whole batch to the kernel with one syscall.
+ *  Completions are dispatched through the `callback_promise` of each request
+ *  by `poll()` or `wait()`, with the number of bytes transferred,
+ *  or a `toolpex::posix_exception` if the request failed.
+ *  The bytes read or written are committed to the buffer before the callback runs.
+ *
+ *  With `register_arena()`, a block arena is registered to the kernel,
+ *  and buffers allocate their blocks from `registered_resource()`
+ *  will be read / written with `IORING_OP_READ_FIXED` / `IORING_OP_WRITE_FIXED`,
+ *  which saves the page pinning of every request.
+ *
+ *  @attention  Not thread safe, one engine per thread.
+ *              A buffer could have at most one read and one write in flight,
+ *              and has to outlive its requests.
+ */
+class uring_engine
+{
+public:
+    /// Pass to `offset` to use (and advance) the current file position, pipes and sockets need this.
+    static constexpr uint64_t current_position = static_cast<uint64_t>(-1);
+
+public:
+    explicit uring_engine(unsigned entries = 256);
+    ~uring_engine() noexcept;
+
+    uring_engine(const uring_engine&) = delete;
+    uring_engine& operator=(const uring_engine&) = delete;
+
+    /**
+     * @brief   Allocate `nblocks` blocks of `block_size` bytes and register them as a fixed buffer.
+     * @throw   `toolpex::posix_exception` if the kernel refused, typically `RLIMIT_MEMLOCK`.
+     */
+    void register_arena(size_t nblocks, size_t block_size);
+
+    /**
+     * @return  The memory resource serves blocks from the registered arena,
+     *          `nullptr` if `register_arena()` has not been called.
+     *          Blocks larger than the `block_size` of the arena are not supported,
+     *          construct your buffer like `buffer{ block_size, engine.registered_resource() }`.
+     * @attention   The arena dies with the engine, 
+     *              so the engine has to outlive every buffer allocates from it.
+     */
+    ::std::pmr::memory_resource* registered_resource() noexcept;
+
+    /**
+     * @brief   Queue a read from `fd` into `buf.writable_span(at_least)`,
+     *          the free tail of the current block, or a new block if it's shorter than `at_least`.
+     * @param   cp  Will be called with the number of bytes read, 0 means EOF.
+     * @attention   Do not write to `buf` until `cp` is called, 
+     *              the bytes read are committed to its current block, which has to be the one submitted.
+     *              Otherwise nothing will be committed, 
+     *              and `cp` will get a `std::runtime_error`.
+     */
+    void submit_read(int fd, buffer& buf, callback_promise<size_t> cp,
+                     uint64_t offset = current_position, size_t at_least = 0);
+
+    /**
+     * @brief   Queue a write of `buf.next_readable_span()` to `fd`.
+     * @param   cp  Will be called with the number of bytes written,
+     *              which might be less than the span (a short write).
+     * @throw   `std::invalid_argument` if the next readable span of `buf` is empty.
+     */
+    void submit_write(int fd, buffer& buf, callback_promise<size_t> cp,
+                      uint64_t offset = current_position);
+
+    /// @return The number of requests submitted to the kernel.
+    size_t submit();
+
+    /**
+     * @brief   Dispatch all the available completions without blocking.
+     * @return  The number of completions dispatched.
+     * @throw   The first exception thrown by a callback, after all the completions have been dispatched.
+     */
+    size_t poll();
+
+    /**
+     * @brief   Submit the queued requests, then block until at least `min_complete` completions are available.
+     * @return  The number of completions dispatched.
+     * @throw   Like `poll()`.
+     */
+    size_t wait(size_t min_complete = 1);
+
+    /// @return The number of requests submitted or queued but not completed yet.
+    size_t in_flight() const noexcept { return m_in_flight; }
+
+private:
+    struct operation;
+    class registered_arena;
+
+    ::io_uring_sqe* get_sqe();
+    void queue(int fd, uint8_t opcode, ::std::span<const ::std::byte> sp,
+               uint64_t offset, ::std::unique_ptr<operation> op);
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags);
+    size_t reap();
+    void dispatch(operation& op, int res);
+
+private:
+    unique_posix_fd m_ring_fd;
+
+    void* m_sq_ring{};
+    size_t m_sq_ring_size{};
+    void* m_cq_ring{};
+    size_t m_cq_ring_size{};
+    ::io_uring_sqe* m_sqes{};
+    size_t m_sqes_size{};
+
+    unsigned* m_sq_head{};
+    unsigned* m_sq_tail{};
+    unsigned* m_sq_array{};
+    unsigned m_sq_mask{};
+    unsigned m_sq_entries{};
+
+    unsigned* m_cq_head{};
+    unsigned* m_cq_tail{};
+    ::io_uring_cqe* m_cqes{};
+    unsigned m_cq_mask{};
+    unsigned m_cq_entries{};
+
+    unsigned m_to_submit{};
+    size_t m_in_flight{};
+
+    ::std::unique_ptr<registered_arena> m_arena;
+};
+
+} // namespace toolpex
+
+#endif
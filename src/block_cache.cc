@@ -0,0 +1,234 @@
+// This file is part of Toolpex
+// https://github.com/JPewterschmidt/toolpex
+//
+// Copyleft 2023 - 2024, ShiXin Wang. All wrongs reserved.
+
+#include "toolpex/block_cache.h"
+#include "toolpex/exceptions.h"
+
+#include <bit>
+#include <new>
+#include <cerrno>
+#include <stdexcept>
+#include <algorithm>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+TOOLPEX_NAMESPACE_BEG
+
+namespace
+{
+
+uint64_t mix64(uint64_t h) noexcept
+{
+    // splitmix64 finalizer.
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebull;
+    h ^= h >> 31;
+    return h;
+}
+
+} // annoymous namespace
+
+size_t block_cache_key_hash::operator()(const block_cache_key& k) const noexcept
+{
+    return mix64(k.file_id * 0x9e3779b97f4a7c15ull ^ k.offset);
+}
+
+block_cache::block_cache(size_t capacity_bytes, size_t page_size, size_t nshards, bool lock_memory)
+    : m_pool{ page_size, ::std::max<size_t>(capacity_bytes / (page_size ? page_size : 1), 1), lock_memory },
+      m_nshards{ ::std::bit_ceil(::std::max<size_t>(nshards, 1)) },
+      m_shards{ ::std::make_unique<shard[]>(m_nshards) }
+{
+}
+
+block_cache::shard& block_cache::shard_of(const block_cache_key& key) noexcept
+{
+    // The high bits, the low ones pick the bucket inside the shard.
+    return m_shards[(block_cache_key_hash{}(key) >> 32) & (m_nshards - 1)];
+}
+
+namespace
+{
+
+template<typename Entry>
+bool satisfies(const Entry& e, size_t at_least) noexcept
+{
+    return e.at_eof || e.page.readable().size() >= at_least;
+}
+
+} // annoymous namespace
+
+block_cache::pinned_page block_cache::lookup(const block_cache_key& key, size_t at_least)
+{
+    auto& s = shard_of(key);
+    ::std::lock_guard lk{ s.lock };
+    auto it = s.index.find(key);
+    if (it == s.index.end() || !satisfies(**it->second, at_least))
+    {
+        s.stats.on_miss();
+        return {};
+    }
+    s.lru.splice(s.lru.begin(), s.lru, it->second);
+    s.stats.on_hit();
+    return pinned_page{ *it->second };
+}
+
+bool block_cache::evict_one(shard& s)
+{
+    ::std::shared_ptr<const entry> victim;
+    {
+        ::std::lock_guard lk{ s.lock };
+        // Pins are only taken under the lock, so a count of 1 can't go up meanwhile.
+        auto it = ::std::find_if(s.lru.rbegin(), s.lru.rend(),
+                                 [](const auto& e) { return e.use_count() == 1; });
+        if (it == s.lru.rend()) return false;
+
+        victim = ::std::move(*it);
+        s.index.erase(victim->key);
+        s.lru.erase(::std::next(it).base());
+        s.stats.on_eviction();
+    }
+    m_size.fetch_sub(1, ::std::memory_order_relaxed);
+    // The page goes back to the pool here, outside the shard lock.
+    return true;
+}
+
+block_cache::page_type block_cache::acquire_page()
+{
+    // Victims are taken from the shards in turn, an approximation of a global LRU.
+    const size_t start = m_next_victim.fetch_add(1, ::std::memory_order_relaxed);
+    for (;;)
+    {
+        if (auto p = m_pool.try_acquire())
+            return ::std::move(*p);
+
+        bool evicted{};
+        for (size_t i{}; i < m_nshards && !evicted; ++i)
+            evicted = evict_one(m_shards[(start + i) & (m_nshards - 1)]);
+        if (!evicted) throw ::std::bad_alloc{};
+    }
+}
+
+block_cache::pinned_page block_cache::install(const block_cache_key& key, page_type page, 
+                                               bool at_eof, size_t at_least)
+{
+    toolpex_assert(m_pool.owns(page.readable().data()));
+    auto e = ::std::make_shared<const entry>(key, ::std::move(page), at_eof);
+
+    // The replaced one goes back to the pool after unlocking, if not pinned.
+    ::std::shared_ptr<const entry> replaced;
+    auto& s = shard_of(key);
+    ::std::lock_guard lk{ s.lock };
+    if (auto it = s.index.find(key); it != s.index.end())
+    {
+        if (satisfies(**it->second, at_least))
+        {
+            // Lost a race with another reader of the same block.
+            s.lru.splice(s.lru.begin(), s.lru, it->second);
+            return pinned_page{ *it->second };
+        }
+
+        // Too short for this request, the pins of the old block stay valid.
+        replaced = ::std::move(*it->second);
+        s.lru.erase(it->second);
+        s.index.erase(it);
+        m_size.fetch_sub(1, ::std::memory_order_relaxed);
+    }
+
+    s.lru.push_front(e);
+    s.index.emplace(key, s.lru.begin());
+    s.stats.on_insert();
+    m_size.fetch_add(1, ::std::memory_order_relaxed);
+    return pinned_page{ ::std::move(e) };
+}
+
+block_cache::pinned_page block_cache::read_through(uint64_t file_id, int fd, off_t offset, size_t len)
+{
+    if (len > page_size())
+        throw ::std::invalid_argument{ "block_cache::read_through: block larger than a page" };
+
+    const block_cache_key key{ file_id, static_cast<uint64_t>(offset) };
+    if (auto hit = lookup(key, len)) return hit;
+
+    // No lock held during the I/O.
+    auto page = acquire_page();
+    auto* dst = page.next_writable().data();
+    size_t nread{};
+    while (nread < len)
+    {
+        const ssize_t ret = ::pread(fd, dst + nread, len - nread, offset + static_cast<off_t>(nread));
+        if (ret < 0)
+        {
+            if (errno == EINTR) continue;
+            throw posix_exception{ errno };
+        }
+        if (ret == 0) break;
+        nread += static_cast<size_t>(ret);
+    }
+    page.commit_write(nread);
+
+    return install(key, ::std::move(page), nread < len, len);
+}
+
+bool block_cache::erase(const block_cache_key& key)
+{
+    ::std::shared_ptr<const entry> victim;
+    {
+        auto& s = shard_of(key);
+        ::std::lock_guard lk{ s.lock };
+        auto it = s.index.find(key);
+        if (it == s.index.end()) return false;
+        victim = ::std::move(*it->second);
+        s.lru.erase(it->second);
+        s.index.erase(it);
+    }
+    m_size.fetch_sub(1, ::std::memory_order_relaxed);
+    return true;
+}
+
+size_t block_cache::erase_file(uint64_t file_id)
+{
+    size_t result{};
+    for (size_t i{}; i < m_nshards; ++i)
+    {
+        auto& s = m_shards[i];
+        lru_list victims;
+        {
+            ::std::lock_guard lk{ s.lock };
+            for (auto it = s.lru.begin(); it != s.lru.end(); )
+            {
+                auto next = ::std::next(it);
+                if ((*it)->key.file_id == file_id)
+                {
+                    s.index.erase((*it)->key);
+                    victims.splice(victims.end(), s.lru, it);
+                }
+                it = next;
+            }
+        }
+        result += victims.size();
+    }
+    m_size.fetch_sub(result, ::std::memory_order_relaxed);
+    return result;
+}
+
+uint64_t block_cache::file_id_of(int fd)
+{
+    struct ::stat st{};
+    if (::fstat(fd, &st) < 0) throw posix_exception{ errno };
+    return mix64(static_cast<uint64_t>(st.st_dev)) ^ static_cast<uint64_t>(st.st_ino);
+}
+
+lru_cache_stats block_cache::stats() const noexcept
+{
+    lru_cache_stats result;
+    for (size_t i{}; i < m_nshards; ++i)
+        result += m_shards[i].stats;
+    return result;
+}
+
+TOOLPEX_NAMESPACE_END
@@ -1,32 +1,205 @@
 #include "toolpex/buffer.h"
+#include "toolpex/buffer_block_pool.h"
 #include <utility>
 #include <limits>
 #include <iterator>
 #include <functional>
 #include <algorithm>
+#include <cerrno>
+#include <array>
+#include <stdexcept>
+#include <cstring>
+#include <bit>
 
-namespace rv = ::std::ranges::views;
-namespace r = ::std::ranges;
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "toolpex/exceptions.h"
 
 namespace toolpex
 {
 
+namespace
+{
+
+// Returns the first `q` in [p, end) where `q[0] == first` and `q[m - 1] == last`, 
+// candidates whose window crosses `end` are only filtered by `first`, 
+// since the rest of the pattern lives in the following blocks.
+// Returns `end` if there's no candidate.
+const ::std::byte* scan_candidates_scalar(const ::std::byte* p, const ::std::byte* end, 
+                                          ::std::byte first, ::std::byte last, size_t m) noexcept
+{
+    for (; p != end; ++p)
+    {
+        if (*p == first && (static_cast<size_t>(end - p) < m || p[m - 1] == last))
+            return p;
+    }
+    return end;
+}
+
+#if defined(__x86_64__)
+
+const ::std::byte* scan_candidates_sse2(const ::std::byte* p, const ::std::byte* end, 
+                                        ::std::byte first, ::std::byte last, size_t m) noexcept
+{
+    const __m128i f = _mm_set1_epi8(static_cast<char>(first));
+    const __m128i l = _mm_set1_epi8(static_cast<char>(last));
+    while (static_cast<size_t>(end - p) >= 16 + m - 1)
+    {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + m - 1));
+        const auto mask = static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, f), _mm_cmpeq_epi8(b, l))));
+        if (mask) return p + ::std::countr_zero(mask);
+        p += 16;
+    }
+    return scan_candidates_scalar(p, end, first, last, m);
+}
+
+__attribute__((target("avx2")))
+const ::std::byte* scan_candidates_avx2(const ::std::byte* p, const ::std::byte* end, 
+                                        ::std::byte first, ::std::byte last, size_t m) noexcept
+{
+    const __m256i f = _mm256_set1_epi8(static_cast<char>(first));
+    const __m256i l = _mm256_set1_epi8(static_cast<char>(last));
+    while (static_cast<size_t>(end - p) >= 32 + m - 1)
+    {
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + m - 1));
+        const auto mask = static_cast<unsigned>(_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(a, f), _mm256_cmpeq_epi8(b, l))));
+        if (mask) return p + ::std::countr_zero(mask);
+        p += 32;
+    }
+    return scan_candidates_sse2(p, end, first, last, m);
+}
+
+const ::std::byte* scan_candidates(const ::std::byte* p, const ::std::byte* end, 
+                                   ::std::byte first, ::std::byte last, size_t m) noexcept
+{
+    static const auto impl = __builtin_cpu_supports("avx2") ? scan_candidates_avx2 : scan_candidates_sse2;
+    return impl(p, end, first, last, m);
+}
+
+#else
+
+const ::std::byte* scan_candidates(const ::std::byte* p, const ::std::byte* end, 
+                                   ::std::byte first, ::std::byte last, size_t m) noexcept
+{
+    return scan_candidates_scalar(p, end, first, last, m);
+}
+
+#endif
+
+} // annoymous namespace
+
 // buffer_block -----------------------------------------------------
 
 buffer_block::buffer_block(size_t block_capa, 
-                           ::std::pmr::memory_resource* pmr)
-    : m_pmr{ pmr ? pmr : ::std::pmr::get_default_resource() }
+                           ::std::pmr::memory_resource* pmr, 
+                           size_t align)
+    : m_pmr{ pmr ? pmr : &buffer_block_pool::default_pool() }
 {
-    m_block_capacity = (block_capa + alignment - 1) & ~(alignment - 1);
-    m_storage = static_cast<::std::byte*>(m_pmr->allocate(m_block_capacity));
+    if (!::std::has_single_bit(align))
+        throw ::std::invalid_argument{ "buffer_block: alignment must be a power of 2" };
+    m_alignment = ::std::max(align, alignment);
+    m_block_capacity = (block_capa + m_alignment - 1) & ~(m_alignment - 1);
+    m_storage = static_cast<::std::byte*>(m_pmr->allocate(m_block_capacity, m_alignment));
+}
+
+buffer_block::buffer_block(::std::pmr::memory_resource* pmr, shared_storage* shared, 
+                           ::std::byte* storage, size_t capa, size_t size, 
+                           size_t align) noexcept
+    : m_pmr{ pmr }, m_block_capacity{ capa }, m_size{ size }, 
+      m_storage{ storage }, m_shared{ shared }, m_alignment{ align }
+{
+}
+
+buffer_block buffer_block::file_segment(int fd, off_t offset, size_t len)
+{
+    if (fd < 0 || offset < 0)
+        throw ::std::invalid_argument{ "buffer_block::file_segment: invalid fd or offset" };
+    static const auto page_size = static_cast<off_t>(::sysconf(_SC_PAGESIZE));
+    const auto delta = static_cast<size_t>(offset & (page_size - 1));
+    buffer_block result{ nullptr, nullptr, nullptr, len, len };
+    result.m_segment = new segment_info{ .fd = fd, .offset = offset, .map_len = len + delta };
+    return result;
+}
+
+const ::std::byte* buffer_block::segment_info::map(size_t len) noexcept
+{
+    const size_t delta = map_len - len;
+    void* base = map_base.load(::std::memory_order_acquire);
+    if (!base)
+    {
+        void* p = ::mmap(nullptr, map_len, PROT_READ, MAP_PRIVATE, fd, offset - static_cast<off_t>(delta));
+        if (p == MAP_FAILED) return nullptr;
+        if (map_base.compare_exchange_strong(base, p, ::std::memory_order_acq_rel, ::std::memory_order_acquire))
+            base = p;
+        else ::munmap(p, map_len); // Another reader has mapped it.
+    }
+    return static_cast<const ::std::byte*>(base) + delta;
+}
+
+ssize_t buffer_block::send_to(int out_fd, size_t offset, size_t len) const noexcept
+{
+    toolpex_assert(m_segment && offset + len <= m_size);
+    off_t in_off = m_segment->offset + static_cast<off_t>(offset);
+    ssize_t ret{};
+    do ret = ::sendfile(out_fd, m_segment->fd, &in_off, len);
+    while (ret < 0 && errno == EINTR);
+    if (ret >= 0 || (errno != EINVAL && errno != ENOSYS)) 
+        return ret;
+
+    // `sendfile()` refuses some fds, like an `O_APPEND` one,
+    // `splice()` takes them only if the output is a pipe.
+    const int flags = ::fcntl(out_fd, F_GETFL);
+    const unsigned splice_flags = SPLICE_F_MOVE | (flags >= 0 && (flags & O_NONBLOCK) ? SPLICE_F_NONBLOCK : 0);
+    in_off = m_segment->offset + static_cast<off_t>(offset);
+    do ret = ::splice(m_segment->fd, &in_off, out_fd, nullptr, len, splice_flags);
+    while (ret < 0 && errno == EINTR);
+    if (ret >= 0 || errno != EINVAL)
+        return ret;
+
+    // Neither end is a pipe, through the mapping then.
+    const auto* p = m_segment->map(m_block_capacity);
+    if (!p) return -1;
+    do ret = ::write(out_fd, p + offset, len);
+    while (ret < 0 && errno == EINTR);
+    return ret;
 }
 
 void buffer_block::release() noexcept
 {
-    if (m_storage)
-        m_pmr->deallocate(m_storage, m_block_capacity);
+    if (m_segment)
+    {
+        if (void* base = m_segment->map_base.load(::std::memory_order_acquire))
+            ::munmap(base, m_segment->map_len);
+        delete m_segment;
+    }
+    else if (auto* shared = m_shared.load(::std::memory_order_acquire))
+    {
+        if (shared->refs.fetch_sub(1, ::std::memory_order_acq_rel) == 1)
+        {
+            m_pmr->deallocate(shared->base, shared->capacity, shared->alignment);
+            delete shared;
+        }
+    }
+    else if (m_storage)
+    {
+        m_pmr->deallocate(m_storage, m_block_capacity, m_alignment);
+    }
 
     m_storage = nullptr;
+    m_shared.store(nullptr, ::std::memory_order_relaxed);
+    m_segment = nullptr;
+    m_read_only = false;
     m_size = m_block_capacity = 0;
 }
 
@@ -39,7 +212,11 @@ buffer_block::buffer_block(buffer_block&& other) noexcept
     : m_pmr{ other.m_pmr }, 
       m_block_capacity{ ::std::exchange(other.m_block_capacity, 0) }, 
       m_size{ ::std::exchange(other.m_size, 0) }, 
-      m_storage{ ::std::exchange(other.m_storage, nullptr) }
+      m_storage{ ::std::exchange(other.m_storage, nullptr) }, 
+      m_shared{ other.m_shared.exchange(nullptr, ::std::memory_order_acq_rel) }, 
+      m_segment{ ::std::exchange(other.m_segment, nullptr) }, 
+      m_alignment{ other.m_alignment }, 
+      m_read_only{ ::std::exchange(other.m_read_only, false) }
 {
 }
 
@@ -51,17 +228,73 @@ buffer_block& buffer_block::operator=(buffer_block&& other) noexcept
     m_block_capacity = ::std::exchange(other.m_block_capacity, 0); 
     m_size = ::std::exchange(other.m_size, 0); 
     m_storage = ::std::exchange(other.m_storage, nullptr);
+    m_shared.store(other.m_shared.exchange(nullptr, ::std::memory_order_acq_rel), ::std::memory_order_release);
+    m_segment = ::std::exchange(other.m_segment, nullptr);
+    m_alignment = other.m_alignment;
+    m_read_only = ::std::exchange(other.m_read_only, false);
 
     return *this;
 }
 
-buffer_block::operator ::std::span<::std::byte> () noexcept
+buffer_block buffer_block::share(size_t offset, size_t len) const
+{
+    toolpex_assert(offset + len <= size());
+    if (m_segment)
+        return file_segment(m_segment->fd, m_segment->offset + static_cast<off_t>(offset), len);
+
+    // Installed by CAS, `dup()` and `slice()` of a const buffer could race here.
+    auto* shared = m_shared.load(::std::memory_order_acquire);
+    if (!shared)
+    {
+        auto* fresh = new shared_storage{ 
+            .base = m_storage, .capacity = m_block_capacity, .alignment = m_alignment 
+        };
+        if (m_shared.compare_exchange_strong(shared, fresh, ::std::memory_order_acq_rel, ::std::memory_order_acquire))
+            shared = fresh;
+        else delete fresh;
+    }
+    shared->refs.fetch_add(1, ::std::memory_order_relaxed);
+
+    // The slice could not be written anyway, the tail after it is just for `release()`.
+    buffer_block result{ m_pmr, shared, m_storage + offset, m_block_capacity - offset, len, m_alignment };
+    result.m_read_only = m_read_only;
+    return result;
+}
+
+void buffer_block::remove_prefix(size_t n)
+{
+    toolpex_assert(n <= m_size);
+    if (n == 0) return;
+    *this = share(n, m_size - n);
+}
+
+void buffer_block::unshare()
 {
+    if (!shared() && !m_segment && !m_read_only) return;
+
+    const auto src = mapped_span();
+
+    // Keeps the alignment of the original allocation.
+    // Read only storage may come from a resource which never allocates, the copy goes to the default one.
+    buffer_block own(m_block_capacity, m_read_only ? nullptr : m_pmr, m_alignment);
+    ::std::copy_n(src.data(), m_size, own.m_storage);
+    own.m_size = m_size;
+    *this = ::std::move(own);
+}
+
+buffer_block::operator ::std::span<::std::byte> ()
+{
+    unshare();
     return { m_storage, m_block_capacity };
 }
 
 buffer_block::operator ::std::span<const ::std::byte> () const noexcept
 {
+    if (m_segment)
+    {
+        const auto* p = m_segment->map(m_block_capacity);
+        return p ? ::std::span{ p, m_block_capacity } : ::std::span<const ::std::byte>{};
+    }
     return { m_storage, m_block_capacity };
 }
 
@@ -77,6 +310,7 @@ bool buffer_block::fit(size_t nbytes_wanna_write) const noexcept
 
 ::std::span<::std::byte> buffer_block::writable_span() noexcept
 {
+    if (m_segment || m_read_only) return {};
     return { cursor(), left() };
 }
 
@@ -87,32 +321,60 @@ bool buffer_block::commit_write(size_t bytes) noexcept
     return true;
 }
 
-::std::span<::std::byte> buffer_block::valid_span() noexcept
+::std::span<::std::byte> buffer_block::valid_span()
 {
     if (capacity() == 0) return {};
+    unshare();
     return { m_storage, size() };
 }
 
 ::std::span<const ::std::byte> buffer_block::valid_span() const noexcept
 {
     if (capacity() == 0) return {};
+    if (m_segment)
+    {
+        const auto whole = static_cast<::std::span<const ::std::byte>>(*this);
+        return whole.empty() ? whole : whole.first(size());
+    }
     return { m_storage, size() };
 }
 
+::std::span<const ::std::byte> buffer_block::mapped_span() const
+{
+    const auto result = valid_span();
+    if (result.size() != size()) throw posix_exception{ errno };
+    return result;
+}
+
 // buffer ------------------------------------------------------------
 
 buffer::buffer(size_t block_capacity, 
-               ::std::pmr::memory_resource* pmr) noexcept
-    : m_pmr{ pmr ? pmr : ::std::pmr::get_default_resource() }, 
-      m_newblock_capa{ block_capacity }
+               ::std::pmr::memory_resource* pmr, 
+               size_t block_align)
+    : m_pmr{ pmr ? pmr : &buffer_block_pool::default_pool() }, 
+      m_newblock_capa{ block_capacity }, 
+      m_alignment{ block_align }
 {
+    // Checked here, or it would fail later in the allocator under `writable_span()`.
+    if (!::std::has_single_bit(block_align) || block_align < alignment)
+        throw ::std::invalid_argument{ "buffer: block alignment must be a power of 2, at least alignof(max_align_t)" };
 }
 
 buffer::buffer(buffer&& other) noexcept
     : m_pmr{ other.m_pmr }, 
       m_blocks{ ::std::move(other.m_blocks) }, 
+      m_spare{ ::std::exchange(other.m_spare, ::std::nullopt) }, 
       m_newblock_capa{ ::std::exchange(other.m_newblock_capa, 0) }, 
-      m_current_block{ ::std::exchange(other.m_current_block, nullptr) }
+      m_alignment{ other.m_alignment }, 
+      m_current_block{ ::std::exchange(other.m_current_block, nullptr) }, 
+      m_current_reading_block_idx{ ::std::exchange(other.m_current_reading_block_idx, 0) }, 
+      m_current_block_readed_nbytes{ ::std::exchange(other.m_current_block_readed_nbytes, 0) }, 
+      m_pending_remove_after_read{ ::std::exchange(other.m_pending_remove_after_read, false) }, 
+      m_nbytes_allocated{ ::std::exchange(other.m_nbytes_allocated, 0) }, 
+      m_nbytes_written{ ::std::exchange(other.m_nbytes_written, 0) }, 
+      m_nbytes_read{ ::std::exchange(other.m_nbytes_read, 0) }, 
+      m_nbytes_released{ ::std::exchange(other.m_nbytes_released, 0) }, 
+      m_nblocks_released{ ::std::exchange(other.m_nblocks_released, 0) }
 {
 }
 
@@ -121,7 +383,18 @@ buffer& buffer::operator=(buffer&& other) noexcept
     // release() is not necessary
     m_pmr = other.m_pmr;
     m_blocks = ::std::move(other.m_blocks);
+    m_spare = ::std::exchange(other.m_spare, ::std::nullopt);
+    m_newblock_capa = ::std::exchange(other.m_newblock_capa, 0);
+    m_alignment = other.m_alignment;
     m_current_block = ::std::exchange(other.m_current_block, nullptr);
+    m_current_reading_block_idx = ::std::exchange(other.m_current_reading_block_idx, 0);
+    m_current_block_readed_nbytes = ::std::exchange(other.m_current_block_readed_nbytes, 0);
+    m_pending_remove_after_read = ::std::exchange(other.m_pending_remove_after_read, false);
+    m_nbytes_allocated = ::std::exchange(other.m_nbytes_allocated, 0);
+    m_nbytes_written = ::std::exchange(other.m_nbytes_written, 0);
+    m_nbytes_read = ::std::exchange(other.m_nbytes_read, 0);
+    m_nbytes_released = ::std::exchange(other.m_nbytes_released, 0);
+    m_nblocks_released = ::std::exchange(other.m_nblocks_released, 0);
 
     return *this;
 }
@@ -130,6 +403,56 @@ void buffer::reset() noexcept
 {
     m_current_block = nullptr;
     m_blocks.clear();
+    m_spare.reset();
+    m_current_reading_block_idx = 0;
+    m_current_block_readed_nbytes = 0;
+    m_pending_remove_after_read = false;
+    m_nbytes_allocated = m_nbytes_written = m_nbytes_read = 0;
+    m_nbytes_released = m_nblocks_released = 0;
+}
+
+buffer_block& buffer::new_block(size_t capacity)
+{
+    auto& result = (m_spare && m_spare->capacity() >= capacity)
+        ? m_blocks.emplace_back(*::std::exchange(m_spare, ::std::nullopt))
+        : m_blocks.emplace_back(capacity, m_pmr, m_alignment);
+    m_nbytes_allocated += result.capacity();
+    return result;
+}
+
+void buffer::release_block(buffer_block& blk) noexcept
+{
+    m_nbytes_allocated -= blk.capacity();
+    m_nbytes_released += blk.size();
+    ++m_nblocks_released;
+
+    if (&blk == m_current_block)
+        m_current_block = nullptr;
+
+    // Only blocks allocated by this buffer could be reused, 
+    // not the ones came from `append_block()`, which may be read only or differently aligned,
+    // nor the ones start in the middle of their allocation after a `remove_prefix()`.
+    const auto* storage = static_cast<::std::span<const ::std::byte>>(::std::as_const(blk)).data();
+    if (!m_spare && !blk.shared() && blk.capacity() >= m_newblock_capa 
+        && blk.resource() == m_pmr && blk.storage_alignment() == m_alignment
+        && reinterpret_cast<uintptr_t>(storage) % m_alignment == 0)
+    {
+        blk.clear();
+        m_spare.emplace(::std::move(blk));
+    }
+    else blk.release();
+}
+
+void buffer::pop_released_blocks() noexcept
+{
+    // Blocks read without removal stay in front of the released ones, 
+    // until they got released too.
+    while (!m_blocks.empty() && m_blocks.front().capacity() == 0)
+    {
+        m_blocks.pop_front();
+        toolpex_assert(m_current_reading_block_idx > 0);
+        --m_current_reading_block_idx;
+    }
 }
 
 size_t buffer::current_block_left() const noexcept
@@ -147,17 +470,18 @@ size_t buffer::current_block_capacity() const noexcept
 ::std::span<::std::byte> buffer::writable_span(size_t at_least)
 {
     ::std::span<::std::byte> result = m_current_block ? m_current_block->writable_span() : ::std::span<::std::byte>{};
-    if (result.size() == 0 || result.size() < (at_least ? at_least : ::std::numeric_limits<size_t>::max()))
+    if (result.empty() || result.size() < at_least)
     {
         toolpex_assert(m_pmr && m_newblock_capa); // prevent use after destruct.
+        leave_current_block();
         
         if (at_least < m_newblock_capa)
         {
-            m_current_block = &m_blocks.emplace_back(m_newblock_capa, m_pmr);
+            m_current_block = &new_block(m_newblock_capa);
         }
         else
         {
-            m_current_block = &m_blocks.emplace_back(at_least, m_pmr);
+            m_current_block = &new_block(at_least);
         }
         result = m_current_block->writable_span();
     }
@@ -168,15 +492,36 @@ size_t buffer::current_block_capacity() const noexcept
 bool buffer::commit_write(size_t nbytes_wrote) noexcept
 {
     toolpex_assert(m_current_block);
-    return m_current_block->commit_write(nbytes_wrote);
+    if (!m_current_block->commit_write(nbytes_wrote))
+        return false;
+    m_nbytes_written += nbytes_wrote;
+    return true;
+}
+
+size_t buffer::padding_needed() const noexcept
+{
+    if (!m_current_block) return 0;
+    return (0 - m_current_block->size()) & (m_alignment - 1);
+}
+
+bool buffer::pad_to_alignment(::std::byte fill) noexcept
+{
+    const size_t n = padding_needed();
+    if (n == 0) return true;
+    const auto sp = m_current_block->writable_span();
+    if (sp.size() < n) return false;
+    ::std::fill_n(sp.data(), n, fill);
+    return commit_write(n);
 }
 
 ::std::span<const ::std::byte> buffer::next_readable_span() const noexcept
 {
     if (m_blocks.empty()) [[unlikely]] return {};
     if (m_current_reading_block_idx >= m_blocks.size()) return {};
-    const auto& blk = m_blocks[m_current_reading_block_idx];
-    return blk.valid_span().subspan(m_current_block_readed_nbytes);
+    const auto sp = m_blocks[m_current_reading_block_idx].valid_span();
+    // Empty if a file segment could not be mapped.
+    if (sp.size() < m_current_block_readed_nbytes) [[unlikely]] return {};
+    return sp.subspan(m_current_block_readed_nbytes);
 }
 
 void buffer::reset_reading_info() noexcept
@@ -184,6 +529,8 @@ void buffer::reset_reading_info() noexcept
     toolpex_assert(has_no_remove_after_read());
     m_current_reading_block_idx = 0;
     m_current_block_readed_nbytes = 0;
+    m_pending_remove_after_read = false;
+    m_nbytes_read = 0;
 }
 
 bool buffer::commit_read_impl(size_t nbytes, bool remove_after_read) noexcept
@@ -191,34 +538,193 @@ bool buffer::commit_read_impl(size_t nbytes, bool remove_after_read) noexcept
     if (nbytes == 0) return true;
     if (m_blocks.empty()) [[unlikely]] return false;
     
+    // By `size()`, so a file segment doesn't have to be mapped.
     const auto& blk = m_blocks[m_current_reading_block_idx];
-    toolpex_assert(nbytes + m_current_block_readed_nbytes <= blk.valid_span().size_bytes());
+    toolpex_assert(nbytes + m_current_block_readed_nbytes <= blk.size());
 
-    if ((m_current_block_readed_nbytes += nbytes) == blk.valid_span().size())
+    m_nbytes_read += nbytes;
+    if ((m_current_block_readed_nbytes += nbytes) == blk.size())
     {
-        if (remove_after_read)
+        // Not `left()`, a shared block becomes writable again once the others released it.
+        if (&blk == m_current_block && blk.size() != blk.capacity())
         {
-            m_blocks[m_current_reading_block_idx].release();
+            // The writer may still append to this block, 
+            // `writable_span()` will move the reader forward when it leaves this block.
+            m_pending_remove_after_read = remove_after_read;
+            return true;
         }
-
-        ++m_current_reading_block_idx;
-        m_current_block_readed_nbytes = 0;
+        advance_reading_block(remove_after_read);
     }
     
     return true;
 }
 
-bool buffer::has_no_remove_after_read() const noexcept
+void buffer::leave_current_block() noexcept
 {
-    for (const auto& block : m_blocks)
+    // The reader may be waiting at the end of the block we are leaving.
+    if (m_current_reading_block_idx < m_blocks.size() 
+        && m_current_block_readed_nbytes == m_blocks[m_current_reading_block_idx].size())
     {
-        if (block.capacity() == 0) 
-            return false;
+        advance_reading_block(m_pending_remove_after_read);
+    }
+}
+
+void buffer::advance_reading_block(bool remove_after_read) noexcept
+{
+    if (remove_after_read)
+    {
+        release_block(m_blocks[m_current_reading_block_idx]);
     }
 
+    ++m_current_reading_block_idx;
+    m_current_block_readed_nbytes = 0;
+    m_pending_remove_after_read = false;
+
+    if (remove_after_read) 
+        pop_released_blocks();
+}
+
+bool buffer::commit_read_across_blocks(size_t nbytes, bool remove_after_read) noexcept
+{
+    if (nbytes > readable_bytes()) [[unlikely]] return false;
+    while (nbytes)
+    {
+        toolpex_assert(m_current_reading_block_idx < m_blocks.size());
+        const size_t readable = m_blocks[m_current_reading_block_idx].size() - m_current_block_readed_nbytes;
+        if (readable == 0) [[unlikely]]
+        {
+            // An empty block left behind by the writer, 
+            // can't be the current block, there're unread bytes after it.
+            advance_reading_block(remove_after_read);
+            continue;
+        }
+        const size_t n = ::std::min(readable, nbytes);
+        commit_read_impl(n, remove_after_read);
+        nbytes -= n;
+    }
     return true;
 }
 
+::std::vector<::iovec> buffer::as_iovecs(size_t max_iovecs) const
+{
+    return memory_iovecs(max_iovecs, false);
+}
+
+::std::vector<::iovec> buffer::memory_iovecs(size_t max_iovecs, bool stop_at_file_segment) const
+{
+    ::std::vector<::iovec> result;
+    if (m_current_reading_block_idx >= m_blocks.size()) return result;
+    if (stop_at_file_segment && m_blocks[m_current_reading_block_idx].is_file_segment()) 
+        return result;
+
+    auto push = [&result](::std::span<const ::std::byte> sp) { 
+        if (sp.empty()) return;
+        result.push_back({ const_cast<::std::byte*>(sp.data()), sp.size() });
+    };
+
+    push(m_blocks[m_current_reading_block_idx].mapped_span().subspan(m_current_block_readed_nbytes));
+    for (size_t i{ m_current_reading_block_idx + 1 }; i < m_blocks.size() && result.size() < max_iovecs; ++i)
+    {
+        if (stop_at_file_segment && m_blocks[i].is_file_segment()) break;
+        push(m_blocks[i].mapped_span());
+    }
+    
+    return result;
+}
+
+ssize_t buffer::read_from(int fd)
+{
+    toolpex_assert(m_pmr && m_newblock_capa); // prevent use after destruct.
+
+    // Reads into the free tail of the current block, or a fresh block 
+    // which joins the buffer only if the read brings data.
+    auto sp = m_current_block ? m_current_block->writable_span() : ::std::span<::std::byte>{};
+    ::std::optional<buffer_block> fresh;
+    if (sp.empty())
+    {
+        if (m_spare) fresh = ::std::exchange(m_spare, ::std::nullopt);
+        else fresh.emplace(m_newblock_capa, m_pmr, m_alignment);
+        sp = fresh->writable_span();
+    }
+    auto keep_fresh = [&] { if (fresh && !m_spare) m_spare = ::std::move(fresh); };
+
+    // Behind a short tail, the rest is bounded by a small spill instead of allocating ahead.
+    ::std::array<::std::byte, 4096> spill;
+    ::std::array<::iovec, 2> iovs{{
+        { sp.data(), sp.size() }, 
+        { spill.data(), spill.size() }, 
+    }};
+    const int iovcnt = fresh ? 1 : 2;
+    
+    ssize_t ret{};
+    do ret = ::readv(fd, iovs.data(), iovcnt);
+    while (ret < 0 && errno == EINTR);
+
+    if (ret <= 0)
+    {
+        keep_fresh();
+        if (ret == 0) return 0;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return -1;
+        throw posix_exception{ errno };
+    }
+
+    const size_t nread = static_cast<size_t>(ret);
+    if (fresh)
+    {
+        fresh->commit_write(nread);
+        append_block(::std::move(*fresh));
+        return ret;
+    }
+
+    const size_t in_place = ::std::min(nread, sp.size());
+    commit_write(in_place);
+    if (nread > in_place)
+        append_bytes(::std::span{ spill }.first(nread - in_place));
+    
+    return ret;
+}
+
+size_t buffer::write_to(int fd, bool remove_after_read)
+{
+    size_t total{};
+    while (m_current_reading_block_idx < m_blocks.size())
+    {
+        ssize_t ret{};
+        if (const auto& blk = m_blocks[m_current_reading_block_idx]; blk.is_file_segment())
+        {
+            const size_t len = blk.size() - m_current_block_readed_nbytes;
+            ret = blk.send_to(fd, m_current_block_readed_nbytes, len);
+            if (ret == 0 && len) 
+                throw ::std::runtime_error{ "buffer::write_to: file segment beyond the end of file" };
+        }
+        else
+        {
+            // In-memory blocks before the next file segment.
+            const auto iovs = memory_iovecs(IOV_MAX, true);
+            if (iovs.empty()) 
+            {
+                // Nothing readable before the next file segment, if there's one.
+                if (m_current_reading_block_idx + 1 >= m_blocks.size()) break;
+                advance_reading_block(remove_after_read);
+                continue;
+            }
+            ret = ::writev(fd, iovs.data(), static_cast<int>(iovs.size()));
+        }
+
+        if (ret < 0)
+        {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            throw posix_exception{ errno };
+        }
+        
+        commit_read_across_blocks(static_cast<size_t>(ret), remove_after_read);
+        total += static_cast<size_t>(ret);
+    }
+    
+    return total;
+}
+
 bool buffer::append(::std::string_view str)
 {
     return this->append(::std::span<const ::std::byte>{ 
@@ -244,57 +750,222 @@ size_t buffer::set_new_block_capacity(size_t newblock_capacity_bytes) noexcept
     return ::std::exchange(m_newblock_capa, newblock_capacity_bytes);
 }
 
+void buffer::append_file_segment(int fd, off_t offset, size_t len)
+{
+    if (len == 0) return;
+    append_block(buffer_block::file_segment(fd, offset, len));
+}
+
+void buffer::append_block(buffer_block blk)
+{
+    leave_current_block();
+    m_nbytes_allocated += blk.capacity();
+    m_nbytes_written += blk.size();
+    m_current_block = &m_blocks.emplace_back(::std::move(blk));
+}
+
 buffer buffer::dup(::std::pmr::memory_resource* pmr) const
 {
-    const size_t old_block_capa = new_block_capacity();
-    buffer result(old_block_capa, pmr ? pmr : m_pmr);
+    buffer result(new_block_capacity(), pmr ? pmr : m_pmr, m_alignment);
+    for (const auto& blk : m_blocks)
+    {
+        if (blk.size() == 0) continue;
+        result.append_block(blk.share(0, blk.size()));
+    }
+    
+    return result;
+}
 
-    auto fit_in_a_page = [first = true, sum = 0ul, old_block_capa] (auto&& lhs, auto&& rhs) mutable { 
-        if (::std::exchange(first, false))
+buffer buffer::slice(size_t offset, size_t len) const
+{
+    buffer result(new_block_capacity(), m_pmr, m_alignment);
+    for (size_t i{ m_current_reading_block_idx }; i < m_blocks.size() && len; ++i)
+    {
+        const auto& blk = m_blocks[i];
+        const size_t start = (i == m_current_reading_block_idx ? m_current_block_readed_nbytes : 0);
+        const size_t readable = blk.size() - start;
+        if (offset >= readable)
         {
-            if ((sum += lhs.size()) < old_block_capa)
-                return true;
-            sum = 0ul;
-            return false;
+            offset -= readable;
+            continue;
         }
 
-        const bool result = (sum += rhs.size() < old_block_capa);
-        if (!result)
+        const size_t n = ::std::min(readable - offset, len);
+        result.append_block(blk.share(start + offset, n));
+        len -= n;
+        offset = 0;
+    }
+    if (len) throw ::std::out_of_range{ "buffer::slice: not enough unread bytes" };
+
+    return result;
+}
+
+::std::span<const ::std::byte> buffer::linearize(size_t n)
+{
+    if (n > readable_bytes()) 
+        throw ::std::out_of_range{ "buffer::linearize: not enough unread bytes" };
+    if (const auto first = next_readable_span(); first.size() >= n)
+        return first.first(n);
+
+    buffer_block lin(n, m_pmr, m_alignment);
+    ::std::byte* out = lin.writable_span().data();
+
+    // Copy before touching any block, 
+    // a file segment which could not be mapped throws with the buffer untouched.
+    for (size_t idx{ m_current_reading_block_idx }, off{ m_current_block_readed_nbytes }, left{ n }; 
+         left; ++idx, off = 0)
+    {
+        const auto sp = m_blocks[idx].mapped_span().subspan(off);
+        const size_t len = ::std::min(left, sp.size());
+        out = ::std::copy_n(sp.data(), len, out);
+        left -= len;
+    }
+
+    // The bytes already read stay where they are, 
+    // so `reset_reading_info()` still sees the whole history.
+    size_t left{ n };
+    size_t idx{ m_current_reading_block_idx };
+    size_t erase_beg{ idx };
+    {
+        auto& blk = m_blocks[idx];
+        const size_t len = blk.size() - m_current_block_readed_nbytes;
+        left -= len;
+        if (m_current_block_readed_nbytes)
         {
-            sum = 0ul;
+            blk.remove_suffix(len);
+            ++erase_beg;
         }
-        return result;
-    };
+        ++idx;
+    }
 
-    for (auto block_sps : blocks_valid_span() | rv::chunk_by(fit_in_a_page))
+    for (; left; ++idx)
     {
-        const size_t need = r::fold_left(block_sps | rv::transform([](auto&& item) { return item.size(); }), 0, ::std::plus{});
-        result.set_new_block_capacity(need);
-        for (auto sp : block_sps)
-            result.append(sp);
+        auto& blk = m_blocks[idx];
+        if (blk.size() > left)
+        {
+            m_nbytes_allocated -= left;
+            blk.remove_prefix(left);
+            break;
+        }
+        left -= blk.size();
     }
-
-    result.set_new_block_capacity(old_block_capa);
     
+    // Now blocks in [erase_beg, idx) have been moved into `lin` entirely.
+    for (size_t i{ erase_beg }; i < idx; ++i)
+        m_nbytes_allocated -= m_blocks[i].capacity();
+    m_nbytes_allocated += lin.capacity();
+    lin.commit_write(n);
+
+    // `m_current_block` is always the last block, if any.
+    const bool had_current = m_current_block != nullptr;
+    const auto beg = m_blocks.begin() + static_cast<ptrdiff_t>(erase_beg);
+    m_blocks.insert(m_blocks.erase(beg, m_blocks.begin() + static_cast<ptrdiff_t>(idx)), ::std::move(lin));
+    m_current_block = had_current ? &m_blocks.back() : nullptr;
+
+    m_current_reading_block_idx = erase_beg;
+    m_current_block_readed_nbytes = 0;
+    m_pending_remove_after_read = false;
+
+    return next_readable_span().first(n);
+}
+
+buffer buffer::flatten(::std::pmr::memory_resource* pmr) const
+{
+    buffer result(new_block_capacity(), pmr ? pmr : m_pmr, m_alignment);
+    const size_t readable = readable_bytes();
+    if (readable == 0) return result;
+
+    auto& blk = result.new_block(readable);
+    copy_readable_to(blk.writable_span().data());
+    result.m_current_block = &blk;
+    result.commit_write(readable);
+
     return result;
 }
 
-size_t buffer::total_nbytes_allocated() const noexcept
+bool buffer::compact(size_t max_fragment)
+{
+    const size_t readable = readable_bytes();
+    if (readable > max_fragment || (m_blocks.size() <= 1 && m_current_block_readed_nbytes == 0))
+        return false;
+
+    // Allocated before anything changes, so a `bad_alloc` leaves the buffer untouched.
+    buffer_block fresh(::std::max(readable, m_newblock_capa), m_pmr, m_alignment);
+    copy_readable_to(fresh.writable_span().data());
+    fresh.commit_write(readable);
+
+    // Everything has been read is released. 
+    // Merging unread blocks only drops nothing, `reset_reading_info()` still works then.
+    m_nbytes_released = m_nbytes_read;
+    if (m_nbytes_read) m_nblocks_released += m_blocks.size();
+    m_blocks.clear();
+    m_current_block = &m_blocks.emplace_back(::std::move(fresh));
+    m_nbytes_allocated = m_current_block->capacity();
+    m_current_reading_block_idx = 0;
+    m_current_block_readed_nbytes = 0;
+    m_pending_remove_after_read = false;
+
+    return true;
+}
+
+::std::byte* buffer::copy_readable_to(::std::byte* out) const
 {
-    return r::fold_left(
-        blocks() | rv::transform([](auto&& item) { return item.capacity(); }),
-        0, 
-        ::std::plus{}
-    );
+    for (size_t i{ m_current_reading_block_idx }; i < m_blocks.size(); ++i)
+    {
+        const auto sp = m_blocks[i].mapped_span();
+        const size_t start = (i == m_current_reading_block_idx ? m_current_block_readed_nbytes : 0);
+        out = ::std::copy(sp.begin() + static_cast<ptrdiff_t>(start), sp.end(), out);
+    }
+    return out;
 }
 
-size_t buffer::total_nbytes_valid() const noexcept
+::std::optional<size_t> buffer::find(::std::byte b) const
 {
-    return r::fold_left(
-        blocks_valid_span() | rv::transform([](auto&& item) { return item.size(); }),
-        0, 
-        ::std::plus{}
-    );
+    return find(::std::span{ &b, 1 });
+}
+
+::std::optional<size_t> buffer::find(::std::span<const ::std::byte> pattern) const
+{
+    return find_from(m_current_reading_block_idx, m_current_block_readed_nbytes, readable_bytes(), pattern);
+}
+
+::std::optional<size_t> buffer::find_from(size_t idx, size_t offset, size_t limit, 
+                                          ::std::span<const ::std::byte> pattern) const
+{
+    if (pattern.empty()) return 0;
+
+    const size_t m = pattern.size();
+    size_t base{};
+    for (; idx < m_blocks.size() && base < limit; ++idx, offset = 0)
+    {
+        const auto sp = m_blocks[idx].mapped_span().subspan(offset);
+        const ::std::byte* const end = sp.data() + sp.size();
+        for (const ::std::byte* p = sp.data(); 
+             (p = scan_candidates(p, end, pattern.front(), pattern.back(), m)) != end; 
+             ++p)
+        {
+            const auto pos_in_block = static_cast<size_t>(p - sp.data());
+            if (base + pos_in_block + m > limit) return {};
+            if (equal_at(idx, offset + pos_in_block, pattern))
+                return base + pos_in_block;
+        }
+        base += sp.size();
+    }
+    return {};
+}
+
+bool buffer::equal_at(size_t idx, size_t offset, ::std::span<const ::std::byte> pattern) const
+{
+    for (; !pattern.empty(); ++idx, offset = 0)
+    {
+        if (idx >= m_blocks.size()) return false;
+        const auto sp = m_blocks[idx].mapped_span().subspan(offset);
+        const size_t len = ::std::min(pattern.size(), sp.size());
+        if (::std::memcmp(sp.data(), pattern.data(), len) != 0)
+            return false;
+        pattern = pattern.subspan(len);
+    }
+    return true;
 }
 
 bool buffer::empty() const noexcept
@@ -0,0 +1,317 @@
+#include "toolpex/buffer_block_pool.h"
+#include "toolpex/spin_lock.h"
+#include "toolpex/assert.h"
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace toolpex
+{
+
+namespace
+{
+
+constexpr size_t size_class_of(size_t bytes) noexcept
+{
+    if (bytes <= buffer_block_pool::min_class_size) return 0;
+    return ::std::bit_width(bytes - 1) - ::std::bit_width(buffer_block_pool::min_class_size - 1);
+}
+
+constexpr size_t class_size(size_t idx) noexcept
+{
+    return buffer_block_pool::min_class_size << idx;
+}
+
+constexpr size_t thread_cache_limit(size_t idx) noexcept
+{
+    const size_t result = buffer_block_pool::thread_cache_bytes_per_class / class_size(idx);
+    return result < 4 ? 4 : result;
+}
+
+constexpr size_t global_cache_limit(size_t idx) noexcept
+{
+    const size_t result = buffer_block_pool::global_cache_bytes_per_class / class_size(idx);
+    return result < 16 ? 16 : result;
+}
+
+static_assert(size_class_of(1) == 0);
+static_assert(size_class_of(64) == 0);
+static_assert(size_class_of(65) == 1);
+static_assert(size_class_of(4096) == 6);
+static_assert(size_class_of(buffer_block_pool::max_class_size) == buffer_block_pool::num_classes - 1);
+
+// An intrusive singly linked list, the link lives in the freed block itself.
+class free_list
+{
+public:
+    void push(void* p) noexcept
+    {
+        auto* n = static_cast<node*>(p);
+        n->next = ::std::exchange(m_head, n);
+        ++m_count;
+    }
+
+    void* pop() noexcept
+    {
+        if (!m_head) return nullptr;
+        --m_count;
+        return ::std::exchange(m_head, m_head->next);
+    }
+
+    /// Move at most `n` blocks to `other`.
+    void transfer_to(free_list& other, size_t n) noexcept
+    {
+        while (n-- && m_head)
+            other.push(pop());
+    }
+
+    size_t size() const noexcept { return m_count; }
+    bool empty() const noexcept { return !m_head; }
+
+private:
+    struct node { node* next; };
+    node* m_head{};
+    size_t m_count{};
+};
+
+} // annoymous namespace
+
+struct buffer_block_pool::shared_state
+{
+    explicit shared_state(::std::pmr::memory_resource* up) noexcept
+        : upstream{ up }
+    {
+    }
+
+    ~shared_state() noexcept
+    {
+        release_global();
+    }
+
+    void release_list(free_list& l, size_t idx) noexcept
+    {
+        while (void* p = l.pop())
+            upstream->deallocate(p, class_size(idx), alignof(::std::max_align_t));
+    }
+
+    // Move `n` blocks of `from` to the global list, the ones beyond its limit go upstream.
+    void give_back(free_list& from, size_t n, size_t idx) noexcept
+    {
+        free_list excess;
+        {
+            ::std::lock_guard lk{ lock };
+            from.transfer_to(global[idx], n);
+            if (global[idx].size() > global_cache_limit(idx))
+                global[idx].transfer_to(excess, global[idx].size() - global_cache_limit(idx));
+        }
+        release_list(excess, idx);
+    }
+
+    void release_global() noexcept
+    {
+        ::std::lock_guard lk{ lock };
+        for (size_t i{}; i < num_classes; ++i)
+            release_list(global[i], i);
+    }
+
+    ::std::pmr::memory_resource* upstream{};
+    ::std::atomic_size_t upstream_allocs{};
+    // Set by the pool destructor, caches of other threads are dropped lazily.
+    ::std::atomic_bool dead{};
+    spin_lock lock;
+    ::std::array<free_list, num_classes> global{};
+};
+
+struct buffer_block_pool::thread_cache
+{
+    explicit thread_cache(::std::shared_ptr<shared_state> s) noexcept
+        : state{ ::std::move(s) }
+    {
+    }
+
+    ~thread_cache() noexcept
+    {
+        for (size_t i{}; i < num_classes; ++i)
+            state->give_back(lists[i], lists[i].size(), i);
+    }
+
+    void release() noexcept
+    {
+        for (size_t i{}; i < num_classes; ++i)
+            state->release_list(lists[i], i);
+    }
+
+    ::std::shared_ptr<shared_state> state;
+    ::std::array<free_list, num_classes> lists{};
+};
+
+namespace
+{
+
+// Trivially destructible, so it's still readable while other thread_local objects are being destructed.
+thread_local bool t_registry_alive{};
+
+// Per thread caches of every pool this thread ever touched,
+// usually there's only one, the `default_pool()`.
+template<typename Cache>
+struct thread_cache_registry
+{
+    thread_cache_registry() noexcept { t_registry_alive = true; }
+    ~thread_cache_registry() noexcept { t_registry_alive = false; }
+
+    Cache* find(const void* state) noexcept
+    {
+        if (last && last->state.get() == state) [[likely]]
+            return last;
+        for (auto& c : caches)
+        {
+            if (c->state.get() == state)
+                return last = c.get();
+        }
+        return nullptr;
+    }
+
+    // Drops the caches of destructed pools first, so the registry won't grow
+    // with every short-lived pool this thread touched.
+    Cache* add(::std::unique_ptr<Cache> c)
+    {
+        ::std::erase_if(caches, [](const auto& old) {
+            if (!old->state->dead.load(::std::memory_order_acquire))
+                return false;
+            old->release();
+            return true;
+        });
+        caches.push_back(::std::move(c));
+        return last = caches.back().get();
+    }
+
+    void erase(const void* state) noexcept
+    {
+        ::std::erase_if(caches, [state](const auto& c) { return c->state.get() == state; });
+        last = nullptr;
+    }
+
+    ::std::vector<::std::unique_ptr<Cache>> caches;
+    Cache* last{};
+};
+
+template<typename Cache>
+thread_cache_registry<Cache>* local_registry() noexcept
+{
+    thread_local thread_cache_registry<Cache> registry;
+    return t_registry_alive ? &registry : nullptr;
+}
+
+} // annoymous namespace
+
+buffer_block_pool::buffer_block_pool(::std::pmr::memory_resource* upstream)
+    : m_state{ ::std::make_shared<shared_state>(upstream ? upstream : ::std::pmr::new_delete_resource()) }
+{
+}
+
+buffer_block_pool::~buffer_block_pool() noexcept
+{
+    m_state->dead.store(true, ::std::memory_order_release);
+    release();
+    if (auto* registry = local_registry<thread_cache>(); registry)
+        registry->erase(m_state.get());
+}
+
+buffer_block_pool& buffer_block_pool::default_pool() noexcept
+{
+    // Leaked on purpose, so buffers destructed in thread_local or static destructors stay valid.
+    static auto* pool = new buffer_block_pool{};
+    return *pool;
+}
+
+buffer_block_pool::thread_cache* buffer_block_pool::local_cache(bool create) const
+{
+    auto* registry = local_registry<thread_cache>();
+    if (!registry) [[unlikely]]
+        return nullptr;
+    if (auto* c = registry->find(m_state.get()); c) [[likely]]
+        return c;
+    if (!create) return nullptr;
+    return registry->add(::std::make_unique<thread_cache>(m_state));
+}
+
+void* buffer_block_pool::do_allocate(size_t bytes, size_t alignment)
+{
+    if (bytes > max_class_size || alignment > alignof(::std::max_align_t))
+    {
+        m_state->upstream_allocs.fetch_add(1, ::std::memory_order_relaxed);
+        return m_state->upstream->allocate(bytes, alignment);
+    }
+
+    const size_t idx = size_class_of(bytes);
+    if (auto* cache = local_cache(); cache) [[likely]]
+    {
+        auto& local = cache->lists[idx];
+        if (void* p = local.pop(); p) [[likely]]
+            return p;
+
+        {
+            ::std::lock_guard lk{ m_state->lock };
+            m_state->global[idx].transfer_to(local, thread_cache_limit(idx) / 2);
+        }
+        if (void* p = local.pop(); p)
+            return p;
+    }
+
+    m_state->upstream_allocs.fetch_add(1, ::std::memory_order_relaxed);
+    return m_state->upstream->allocate(class_size(idx), alignof(::std::max_align_t));
+}
+
+void buffer_block_pool::do_deallocate(void* p, size_t bytes, size_t alignment)
+{
+    if (bytes > max_class_size || alignment > alignof(::std::max_align_t))
+    {
+        m_state->upstream->deallocate(p, bytes, alignment);
+        return;
+    }
+
+    const size_t idx = size_class_of(bytes);
+    auto* cache = local_cache();
+    if (!cache) [[unlikely]]
+    {
+        // This thread is exiting, its cache has gone.
+        free_list one;
+        one.push(p);
+        m_state->give_back(one, 1, idx);
+        return;
+    }
+
+    auto& local = cache->lists[idx];
+    local.push(p);
+    if (local.size() > thread_cache_limit(idx)) [[unlikely]]
+        m_state->give_back(local, local.size() / 2, idx);
+}
+
+bool buffer_block_pool::do_is_equal(const ::std::pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
+void buffer_block_pool::release() noexcept
+{
+    m_state->release_global();
+
+    if (auto* cache = local_cache(false); cache)
+        cache->release();
+}
+
+size_t buffer_block_pool::upstream_allocations() const noexcept
+{
+    return m_state->upstream_allocs.load(::std::memory_order_relaxed);
+}
+
+::std::pmr::memory_resource* buffer_block_pool::upstream_resource() const noexcept
+{
+    return m_state->upstream;
+}
+
+} // namespace toolpex
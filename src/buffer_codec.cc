@@ -0,0 +1,244 @@
+#include "toolpex/buffer_codec.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <new>
+
+#if defined(TOOLPEX_WITH_LZ4)
+#include <lz4frame.h>
+#endif
+
+#if defined(TOOLPEX_WITH_ZSTD)
+#include <zstd.h>
+#endif
+
+namespace toolpex
+{
+
+size_t run_codec(buffer_codec& c, buffer& in, buffer& out, bool finish)
+{
+    size_t produced{};
+    for (;;)
+    {
+        const auto in_sp = in.next_readable_span();
+        const bool last = finish && in_sp.size() == in.readable_bytes();
+        const auto out_sp = out.writable_span(c.min_output_span());
+
+        const auto step = c.process(in_sp, out_sp, last);
+        in.commit_remove_after_read(step.consumed);
+        out.commit_write(step.produced);
+        produced += step.produced;
+
+        if (step.finished) break;
+        if (step.consumed == 0 && step.produced == 0)
+        {
+            // Needs more input, which is fine unless there won't be any.
+            if (!finish) break;
+            throw ::std::runtime_error{ ::std::string{ c.name() } + ": truncated stream" };
+        }
+    }
+    return produced;
+}
+
+codec_step noop_codec::process(::std::span<const ::std::byte> in,
+                               ::std::span<::std::byte> out,
+                               bool finish)
+{
+    const size_t n = ::std::min(in.size(), out.size());
+    ::std::copy_n(in.data(), n, out.data());
+    return { n, n, finish && n == in.size() };
+}
+
+#if defined(TOOLPEX_WITH_LZ4)
+
+namespace
+{
+
+size_t lz4_check(size_t r)
+{
+    if (LZ4F_isError(r))
+        throw ::std::runtime_error{ ::std::string{ "lz4: " } + LZ4F_getErrorName(r) };
+    return r;
+}
+
+// Bounds the staging area.
+constexpr size_t lz4_chunk_size = 64 * 1024;
+
+} // annoymous namespace
+
+lz4_compressor::lz4_compressor()
+{
+    if (LZ4F_isError(LZ4F_createCompressionContext(&m_ctx, LZ4F_VERSION)))
+        throw ::std::bad_alloc{};
+}
+
+lz4_compressor::~lz4_compressor() noexcept
+{
+    LZ4F_freeCompressionContext(m_ctx);
+}
+
+void lz4_compressor::reset()
+{
+    // `LZ4F_compressBegin()` starts over anyway.
+    m_begun = m_ended = false;
+    m_staging.clear();
+    m_staging_pos = 0;
+}
+
+size_t lz4_compressor::drain_staging(::std::span<::std::byte> out) noexcept
+{
+    const size_t n = ::std::min(out.size(), m_staging.size() - m_staging_pos);
+    ::std::copy_n(m_staging.data() + m_staging_pos, n, out.data());
+    m_staging_pos += n;
+    return n;
+}
+
+codec_step lz4_compressor::process(::std::span<const ::std::byte> in,
+                                   ::std::span<::std::byte> out,
+                                   bool finish)
+{
+    codec_step result{};
+    result.produced = drain_staging(out);
+    out = out.subspan(result.produced);
+
+    while (!out.empty() && m_staging_pos == m_staging.size())
+    {
+        m_staging.clear();
+        m_staging_pos = 0;
+        if (!m_begun)
+        {
+            m_staging.resize(LZ4F_HEADER_SIZE_MAX);
+            m_staging.resize(lz4_check(LZ4F_compressBegin(m_ctx, m_staging.data(), m_staging.size(), nullptr)));
+            m_begun = true;
+        }
+        else if (result.consumed < in.size())
+        {
+            const size_t chunk = ::std::min(in.size() - result.consumed, lz4_chunk_size);
+            m_staging.resize(LZ4F_compressBound(chunk, nullptr));
+            m_staging.resize(lz4_check(LZ4F_compressUpdate(
+                m_ctx, m_staging.data(), m_staging.size(), in.data() + result.consumed, chunk, nullptr)));
+            result.consumed += chunk;
+        }
+        else if (finish && !m_ended)
+        {
+            m_staging.resize(LZ4F_compressBound(0, nullptr));
+            m_staging.resize(lz4_check(LZ4F_compressEnd(m_ctx, m_staging.data(), m_staging.size(), nullptr)));
+            m_ended = true;
+        }
+        else break;
+
+        const size_t n = drain_staging(out);
+        result.produced += n;
+        out = out.subspan(n);
+    }
+
+    result.finished = m_ended && m_staging_pos == m_staging.size();
+    return result;
+}
+
+lz4_decompressor::lz4_decompressor()
+{
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&m_ctx, LZ4F_VERSION)))
+        throw ::std::bad_alloc{};
+}
+
+lz4_decompressor::~lz4_decompressor() noexcept
+{
+    LZ4F_freeDecompressionContext(m_ctx);
+}
+
+void lz4_decompressor::reset()
+{
+    LZ4F_resetDecompressionContext(m_ctx);
+}
+
+codec_step lz4_decompressor::process(::std::span<const ::std::byte> in,
+                                     ::std::span<::std::byte> out,
+                                     bool finish)
+{
+    size_t dst_size = out.size(), src_size = in.size();
+    const size_t hint = lz4_check(LZ4F_decompress(
+        m_ctx, out.data(), &dst_size, in.data(), &src_size, nullptr));
+    return { src_size, dst_size, finish && src_size == in.size() && hint == 0 };
+}
+
+#endif
+
+#if defined(TOOLPEX_WITH_ZSTD)
+
+namespace
+{
+
+size_t zstd_check(size_t r)
+{
+    if (ZSTD_isError(r))
+        throw ::std::runtime_error{ ::std::string{ "zstd: " } + ZSTD_getErrorName(r) };
+    return r;
+}
+
+} // annoymous namespace
+
+zstd_compressor::zstd_compressor(int level)
+    : m_ctx{ ZSTD_createCCtx() }
+{
+    if (!m_ctx) throw ::std::bad_alloc{};
+    zstd_check(ZSTD_CCtx_setParameter(m_ctx, ZSTD_c_compressionLevel, level));
+}
+
+zstd_compressor::~zstd_compressor() noexcept
+{
+    ZSTD_freeCCtx(m_ctx);
+}
+
+void zstd_compressor::reset()
+{
+    ZSTD_CCtx_reset(m_ctx, ZSTD_reset_session_only);
+}
+
+codec_step zstd_compressor::process(::std::span<const ::std::byte> in,
+                                    ::std::span<::std::byte> out,
+                                    bool finish)
+{
+    ::ZSTD_inBuffer ib{ in.data(), in.size(), 0 };
+    ::ZSTD_outBuffer ob{ out.data(), out.size(), 0 };
+    const size_t remaining = zstd_check(ZSTD_compressStream2(
+        m_ctx, &ob, &ib, finish ? ZSTD_e_end : ZSTD_e_continue));
+    return { ib.pos, ob.pos, finish && remaining == 0 };
+}
+
+zstd_decompressor::zstd_decompressor()
+    : m_ctx{ ZSTD_createDCtx() }
+{
+    if (!m_ctx) throw ::std::bad_alloc{};
+}
+
+zstd_decompressor::~zstd_decompressor() noexcept
+{
+    ZSTD_freeDCtx(m_ctx);
+}
+
+void zstd_decompressor::reset()
+{
+    ZSTD_DCtx_reset(m_ctx, ZSTD_reset_session_only);
+    m_output_full = m_frame_done = false;
+}
+
+codec_step zstd_decompressor::process(::std::span<const ::std::byte> in,
+                                      ::std::span<::std::byte> out,
+                                      bool finish)
+{
+    if (in.empty() && !m_output_full)
+        return { 0, 0, finish && m_frame_done };
+
+    ::ZSTD_inBuffer ib{ in.data(), in.size(), 0 };
+    ::ZSTD_outBuffer ob{ out.data(), out.size(), 0 };
+    const size_t hint = zstd_check(ZSTD_decompressStream(m_ctx, &ob, &ib));
+    m_output_full = ob.pos == ob.size;
+    m_frame_done = hint == 0;
+    return { ib.pos, ob.pos, finish && ib.pos == in.size() && m_frame_done };
+}
+
+#endif
+
+} // namespace toolpex
@@ -0,0 +1,146 @@
+#include "toolpex/buffer_reader.h"
+
+#include <algorithm>
+#include <utility>
+#include <stdexcept>
+
+namespace toolpex
+{
+
+buffer_reader::buffer_reader(buffer& buf) noexcept
+    : m_buffer{ &buf }
+{
+    seek_to_reading_position();
+}
+
+void buffer_reader::seek_to_reading_position() noexcept
+{
+    m_block_idx = m_buffer->m_current_reading_block_idx;
+    m_offset = m_buffer->m_current_block_readed_nbytes;
+    m_remaining = m_buffer->readable_bytes();
+    m_consumed = 0;
+}
+
+::std::span<const ::std::byte> buffer_reader::block_span(size_t idx, size_t offset) const
+{
+    // Through the const overload, reading must not unshare a block.
+    return m_buffer->m_blocks[idx].mapped_span().subspan(offset);
+}
+
+void buffer_reader::copy_out(size_t n, ::std::byte* dst) const
+{
+    for (size_t idx{ m_block_idx }, off{ m_offset }; n; ++idx, off = 0)
+    {
+        const auto sp = block_span(idx, off);
+        const size_t len = ::std::min(n, sp.size());
+        dst = ::std::copy_n(sp.data(), len, dst);
+        n -= len;
+    }
+}
+
+::std::span<const ::std::byte> buffer_reader::peek(size_t n)
+{
+    if (n == 0 || n > m_remaining) return {};
+
+    // Fast path, the bytes are in one block.
+    size_t idx{ m_block_idx }, off{ m_offset };
+    for (; block_span(idx, off).empty(); ++idx, off = 0)
+        ;
+    if (const auto sp = block_span(idx, off); sp.size() >= n)
+        return sp.first(n);
+
+    ::std::byte* dst{};
+    if (n <= small_scratch_size) dst = m_small_scratch.data();
+    else
+    {
+        m_large_scratch.resize(n);
+        dst = m_large_scratch.data();
+    }
+    copy_out(n, dst);
+    return { dst, n };
+}
+
+bool buffer_reader::skip(size_t n) noexcept
+{
+    if (n > m_remaining) return false;
+    m_remaining -= n;
+    m_consumed += n;
+
+    while (n)
+    {
+        const size_t avail = m_buffer->m_blocks[m_block_idx].size() - m_offset;
+        if (n < avail)
+        {
+            m_offset += n;
+            break;
+        }
+        n -= avail;
+        ++m_block_idx;
+        m_offset = 0;
+    }
+    return true;
+}
+
+::std::span<const ::std::byte> buffer_reader::read(size_t n)
+{
+    const auto result = peek(n);
+    if (!result.empty()) skip(n);
+    return result;
+}
+
+::std::optional<uint64_t> buffer_reader::read_varint()
+{
+    constexpr size_t max_varint_size = 10;
+
+    uint64_t result{};
+    size_t nbytes{};
+    for (size_t idx{ m_block_idx }, off{ m_offset }; nbytes < m_remaining; ++idx, off = 0)
+    {
+        for (const auto b : block_span(idx, off))
+        {
+            if (nbytes == max_varint_size)
+                throw ::std::runtime_error{ "buffer_reader::read_varint: varint too long" };
+            // The 10th byte holds only the 64th bit.
+            if (nbytes == max_varint_size - 1 && (b & ::std::byte{ 0x7e }) != ::std::byte{})
+                throw ::std::runtime_error{ "buffer_reader::read_varint: varint exceeds 64 bits" };
+            result |= static_cast<uint64_t>(b & ::std::byte{ 0x7f }) << (7 * nbytes++);
+            if ((b & ::std::byte{ 0x80 }) == ::std::byte{})
+            {
+                skip(nbytes);
+                return result;
+            }
+        }
+    }
+    return {};
+}
+
+::std::optional<size_t> buffer_reader::find(::std::span<const ::std::byte> delimiter) const
+{
+    return m_buffer->find_from(m_block_idx, m_offset, m_remaining, delimiter);
+}
+
+::std::optional<::std::span<const ::std::byte>>
+buffer_reader::read_until(::std::span<const ::std::byte> delimiter)
+{
+    const auto pos = find(delimiter);
+    if (!pos) return {};
+    if (*pos == 0)
+    {
+        // An empty `peek()` means failure, not an empty field.
+        skip(delimiter.size());
+        return ::std::span<const ::std::byte>{};
+    }
+    const auto result = peek(*pos);
+    skip(*pos + delimiter.size());
+    return result;
+}
+
+size_t buffer_reader::commit(bool remove_after_read)
+{
+    const size_t result = m_consumed;
+    m_buffer->commit_read_across_blocks(result, remove_after_read);
+    seek_to_reading_position();
+    return result;
+}
+
+} // namespace toolpex
@@ -0,0 +1,89 @@
+#include "toolpex/buffer_streambuf.h"
+
+#include <algorithm>
+#include <climits>
+
+namespace toolpex
+{
+
+void buffer_streambuf::commit_put_area() noexcept
+{
+    if (const auto n = pptr() - pbase(); n > 0)
+    {
+        m_buffer->commit_write(static_cast<size_t>(n));
+
+        // The rest of the span is still ours.
+        setp(pptr(), epptr());
+    }
+}
+
+void buffer_streambuf::commit_get_area() noexcept
+{
+    if (const auto n = gptr() - eback(); n > 0)
+    {
+        m_buffer->commit_read(static_cast<size_t>(n));
+        setg(gptr(), gptr(), egptr());
+    }
+}
+
+buffer_streambuf::int_type buffer_streambuf::overflow(int_type ch)
+{
+    commit_put_area();
+
+    // The free tail of the current block, a new block only if it's full.
+    auto sp = m_buffer->writable_span(1);
+    auto* p = reinterpret_cast<char*>(sp.data());
+    setp(p, p + ::std::min<size_t>(sp.size(), INT_MAX));
+
+    if (traits_type::eq_int_type(ch, traits_type::eof()))
+        return traits_type::not_eof(ch);
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+    return ch;
+}
+
+::std::streamsize buffer_streambuf::xsputn(const char_type* s, ::std::streamsize n)
+{
+    ::std::streamsize result{};
+    while (result < n)
+    {
+        if (pptr() == epptr())
+            overflow(traits_type::eof());
+
+        const auto len = ::std::min<::std::streamsize>(epptr() - pptr(), n - result);
+        ::std::copy_n(s + result, len, pptr());
+        pbump(static_cast<int>(len));
+        result += len;
+    }
+    return result;
+}
+
+buffer_streambuf::int_type buffer_streambuf::underflow()
+{
+    commit_get_area();
+
+    // Characters just written become readable.
+    commit_put_area();
+
+    const auto sp = m_buffer->next_readable_span();
+    if (sp.empty()) return traits_type::eof();
+
+    auto* p = const_cast<char*>(reinterpret_cast<const char*>(sp.data()));
+    setg(p, p, p + sp.size());
+    return traits_type::to_int_type(*gptr());
+}
+
+::std::streamsize buffer_streambuf::showmanyc()
+{
+    const auto n = static_cast<::std::streamsize>(m_buffer->readable_bytes()) - (gptr() - eback());
+    return n > 0 ? n : -1;
+}
+
+int buffer_streambuf::sync()
+{
+    commit_put_area();
+    commit_get_area();
+    return 0;
+}
+
+} // namespace toolpex
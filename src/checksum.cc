@@ -0,0 +1,228 @@
+#include "toolpex/checksum.h"
+
+#include <bit>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace toolpex
+{
+
+namespace
+{
+
+// CRC32C ------------------------------------------------------------
+
+constexpr uint32_t crc32c_poly = 0x82f63b78; // reflected 0x1edc6f41
+
+constexpr auto make_crc32c_tables() noexcept
+{
+    ::std::array<::std::array<uint32_t, 256>, 8> result{};
+    for (uint32_t i{}; i < 256; ++i)
+    {
+        uint32_t crc = i;
+        for (int k{}; k < 8; ++k)
+            crc = (crc >> 1) ^ (crc32c_poly & (0u - (crc & 1)));
+        result[0][i] = crc;
+    }
+    for (uint32_t i{}; i < 256; ++i)
+    {
+        for (size_t t{ 1 }; t < 8; ++t)
+            result[t][i] = (result[t - 1][i] >> 8) ^ result[0][result[t - 1][i] & 0xff];
+    }
+    return result;
+}
+
+constexpr auto crc32c_tables = make_crc32c_tables();
+
+uint64_t load_le64(const ::std::byte* p) noexcept
+{
+    uint64_t result{};
+    ::std::memcpy(&result, p, sizeof(result));
+    if constexpr (::std::endian::native == ::std::endian::big)
+        result = ::std::byteswap(result);
+    return result;
+}
+
+uint32_t load_le32(const ::std::byte* p) noexcept
+{
+    uint32_t result{};
+    ::std::memcpy(&result, p, sizeof(result));
+    if constexpr (::std::endian::native == ::std::endian::big)
+        result = ::std::byteswap(result);
+    return result;
+}
+
+// Works on the inverted crc.
+uint32_t crc32c_table(const ::std::byte* p, size_t n, uint32_t crc) noexcept
+{
+    const auto& t = crc32c_tables;
+    for (; n >= 8; n -= 8, p += 8)
+    {
+        const uint64_t v = load_le64(p) ^ crc;
+        crc = t[7][v & 0xff]         ^ t[6][(v >> 8) & 0xff]
+            ^ t[5][(v >> 16) & 0xff] ^ t[4][(v >> 24) & 0xff]
+            ^ t[3][(v >> 32) & 0xff] ^ t[2][(v >> 40) & 0xff]
+            ^ t[1][(v >> 48) & 0xff] ^ t[0][v >> 56];
+    }
+    for (; n; --n, ++p)
+        crc = (crc >> 8) ^ t[0][(crc ^ ::std::to_integer<uint32_t>(*p)) & 0xff];
+    return crc;
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("sse4.2")))
+uint32_t crc32c_sse42(const ::std::byte* p, size_t n, uint32_t crc) noexcept
+{
+    uint64_t crc64 = crc;
+    for (; n >= 8; n -= 8, p += 8)
+        crc64 = _mm_crc32_u64(crc64, load_le64(p));
+    crc = static_cast<uint32_t>(crc64);
+    for (; n; --n, ++p)
+        crc = _mm_crc32_u8(crc, ::std::to_integer<uint8_t>(*p));
+    return crc;
+}
+
+uint32_t crc32c_impl(const ::std::byte* p, size_t n, uint32_t crc) noexcept
+{
+    static const auto impl = __builtin_cpu_supports("sse4.2") ? crc32c_sse42 : crc32c_table;
+    return impl(p, n, crc);
+}
+
+#else
+
+uint32_t crc32c_impl(const ::std::byte* p, size_t n, uint32_t crc) noexcept
+{
+    return crc32c_table(p, n, crc);
+}
+
+#endif
+
+// XXH64 -------------------------------------------------------------
+
+constexpr uint64_t prime64_1 = 0x9e3779b185ebca87ull;
+constexpr uint64_t prime64_2 = 0xc2b2ae3d27d4eb4full;
+constexpr uint64_t prime64_3 = 0x165667b19e3779f9ull;
+constexpr uint64_t prime64_4 = 0x85ebca77c2b2ae63ull;
+constexpr uint64_t prime64_5 = 0x27d4eb2f165667c5ull;
+
+constexpr uint64_t xxh64_round(uint64_t acc, uint64_t input) noexcept
+{
+    acc += input * prime64_2;
+    acc = ::std::rotl(acc, 31);
+    return acc * prime64_1;
+}
+
+constexpr uint64_t xxh64_merge_round(uint64_t acc, uint64_t val) noexcept
+{
+    acc ^= xxh64_round(0, val);
+    return acc * prime64_1 + prime64_4;
+}
+
+} // annoymous namespace
+
+uint32_t crc32c(::std::span<const ::std::byte> data, uint32_t crc) noexcept
+{
+    return ~crc32c_impl(data.data(), data.size(), ~crc);
+}
+
+uint32_t crc32c(const buffer& buf, uint32_t crc)
+{
+    crc = ~crc;
+    for (const auto& blk : buf.blocks())
+    {
+        const auto sp = blk.mapped_span();
+        crc = crc32c_impl(sp.data(), sp.size(), crc);
+    }
+    return ~crc;
+}
+
+xxhash64::xxhash64(uint64_t seed) noexcept
+    : m_seed{ seed },
+      m_acc{ seed + prime64_1 + prime64_2, seed + prime64_2, seed, seed - prime64_1 }
+{
+}
+
+xxhash64& xxhash64::update(::std::span<const ::std::byte> data) noexcept
+{
+    m_total_len += data.size();
+
+    auto consume_stripe = [this](const ::std::byte* p) noexcept {
+        for (size_t i{}; i < 4; ++i)
+            m_acc[i] = xxh64_round(m_acc[i], load_le64(p + i * 8));
+    };
+
+    if (m_pending_size)
+    {
+        const size_t n = ::std::min(stripe_size - m_pending_size, data.size());
+        ::std::copy_n(data.data(), n, m_pending.data() + m_pending_size);
+        m_pending_size += n;
+        data = data.subspan(n);
+        if (m_pending_size < stripe_size) return *this;
+        consume_stripe(m_pending.data());
+        m_pending_size = 0;
+    }
+
+    for (; data.size() >= stripe_size; data = data.subspan(stripe_size))
+        consume_stripe(data.data());
+
+    ::std::copy_n(data.data(), data.size(), m_pending.data());
+    m_pending_size = data.size();
+
+    return *this;
+}
+
+xxhash64& xxhash64::update(const buffer& buf)
+{
+    for (const auto& blk : buf.blocks())
+        update(blk.mapped_span());
+    return *this;
+}
+
+uint64_t xxhash64::digest() const noexcept
+{
+    uint64_t h{};
+    if (m_total_len >= stripe_size)
+    {
+        h = ::std::rotl(m_acc[0], 1) + ::std::rotl(m_acc[1], 7)
+          + ::std::rotl(m_acc[2], 12) + ::std::rotl(m_acc[3], 18);
+        for (const auto acc : m_acc)
+            h = xxh64_merge_round(h, acc);
+    }
+    else h = m_seed + prime64_5;
+
+    h += m_total_len;
+
+    const ::std::byte* p = m_pending.data();
+    size_t n = m_pending_size;
+    for (; n >= 8; n -= 8, p += 8)
+    {
+        h ^= xxh64_round(0, load_le64(p));
+        h = ::std::rotl(h, 27) * prime64_1 + prime64_4;
+    }
+    if (n >= 4)
+    {
+        h ^= static_cast<uint64_t>(load_le32(p)) * prime64_1;
+        h = ::std::rotl(h, 23) * prime64_2 + prime64_3;
+        n -= 4;
+        p += 4;
+    }
+    for (; n; --n, ++p)
+    {
+        h ^= ::std::to_integer<uint64_t>(*p) * prime64_5;
+        h = ::std::rotl(h, 11) * prime64_1;
+    }
+
+    h ^= h >> 33;
+    h *= prime64_2;
+    h ^= h >> 29;
+    h *= prime64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+} // namespace toolpex
@@ -0,0 +1,170 @@
+#include "toolpex/mmap_resource.h"
+#include "toolpex/buffer_block_pool.h"
+#include "toolpex/unique_posix_fd.h"
+#include "toolpex/exceptions.h"
+
+#include <new>
+#include <cerrno>
+#include <cstdint>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace toolpex
+{
+
+namespace
+{
+
+size_t page_size() noexcept
+{
+    static const auto result = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    return result;
+}
+
+constexpr size_t round_up(size_t n, size_t align) noexcept
+{
+    return (n + align - 1) / align * align;
+}
+
+// Frees the blocks of a file mapping, never allocates, 
+// the blocks are read only so copy on write doesn't come here.
+class mapped_file_resource : public ::std::pmr::memory_resource
+{
+protected:
+    void* do_allocate(size_t, size_t) override
+    {
+        throw ::std::bad_alloc{};
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t) override
+    {
+        ::munmap(p, bytes);
+    }
+
+    bool do_is_equal(const ::std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+mapped_file_resource& mapped_file_res() noexcept
+{
+    static mapped_file_resource result;
+    return result;
+}
+
+} // annoymous namespace
+
+mmap_resource::mmap_resource(bool use_hugepage,
+                             size_t min_mmap_size,
+                             ::std::pmr::memory_resource* upstream) noexcept
+    : m_use_hugepage{ use_hugepage },
+      m_min_mmap_size{ min_mmap_size },
+      m_upstream{ upstream ? upstream : &buffer_block_pool::default_pool() }
+{
+}
+
+bool mmap_resource::hugepage_eligible(size_t bytes) const noexcept
+{
+    return m_use_hugepage && bytes >= huge_page_size;
+}
+
+size_t mmap_resource::mapping_size(size_t bytes) const noexcept
+{
+    return round_up(bytes, hugepage_eligible(bytes) ? huge_page_size : page_size());
+}
+
+void* mmap_resource::do_allocate(size_t bytes, size_t alignment)
+{
+    if (bytes < m_min_mmap_size || alignment > page_size())
+        return m_upstream->allocate(bytes, alignment);
+
+    const size_t size = mapping_size(bytes);
+    const bool huge = hugepage_eligible(bytes);
+
+    // Over map for huge pages, then trim both ends to get a 2 MiB aligned region.
+    const size_t map_size = huge ? size + huge_page_size : size;
+    void* p = ::mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) throw ::std::bad_alloc{};
+
+    auto* result = static_cast<::std::byte*>(p);
+    if (huge)
+    {
+        const auto addr = reinterpret_cast<uintptr_t>(result);
+        auto* aligned = reinterpret_cast<::std::byte*>(round_up(addr, huge_page_size));
+        if (const size_t head = static_cast<size_t>(aligned - result); head)
+            ::munmap(result, head);
+        if (const size_t tail = map_size - size - static_cast<size_t>(aligned - result); tail)
+            ::munmap(aligned + size, tail);
+        result = aligned;
+
+        // Failures are fine, we just don't get huge pages.
+        ::madvise(result, size, MADV_HUGEPAGE);
+    }
+
+    m_mapped_bytes.fetch_add(size, ::std::memory_order_relaxed);
+    return result;
+}
+
+void mmap_resource::do_deallocate(void* p, size_t bytes, size_t alignment)
+{
+    if (bytes < m_min_mmap_size || alignment > page_size())
+    {
+        m_upstream->deallocate(p, bytes, alignment);
+        return;
+    }
+
+    const size_t size = mapping_size(bytes);
+    ::munmap(p, size);
+    m_mapped_bytes.fetch_sub(size, ::std::memory_order_relaxed);
+}
+
+bool mmap_resource::do_is_equal(const ::std::pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
+buffer mapped_file_buffer(const ::std::filesystem::path& path, size_t block_size)
+{
+    unique_posix_fd fd{ ::open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+    if (fd < 0) throw posix_exception{ errno };
+
+    struct ::stat st{};
+    if (::fstat(fd, &st) < 0) throw posix_exception{ errno };
+    const auto file_size = static_cast<size_t>(st.st_size);
+
+    buffer result{};
+    if (file_size == 0) return result;
+
+    void* p = ::mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) throw posix_exception{ errno };
+    ::madvise(p, file_size, MADV_SEQUENTIAL);
+
+    // Each block unmaps its own part of the mapping.
+    auto* base = static_cast<::std::byte*>(p);
+    block_size = round_up(::std::max<size_t>(block_size, 1), page_size());
+    // The block being appended owns its part even if `append_block()` throws, the rest doesn't.
+    size_t off{}, len{};
+    try
+    {
+        for (; off < file_size; off += len)
+        {
+            len = ::std::min(block_size, file_size - off);
+            result.append_block(buffer_block::adopt_read_only(&mapped_file_res(), base + off, len));
+        }
+    }
+    catch (...)
+    {
+        if (off + len < file_size)
+            ::munmap(base + off + len, file_size - off - len);
+        throw;
+    }
+
+    return result;
+}
+
+} // namespace toolpex
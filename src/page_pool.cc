@@ -0,0 +1,127 @@
+// This file is part of Toolpex
+// https://github.com/JPewterschmidt/toolpex
+//
+// Copyleft 2023 - 2024, ShiXin Wang. All wrongs reserved.
+
+#include "toolpex/page_pool.h"
+#include "toolpex/exceptions.h"
+#include "toolpex/assert.h"
+
+#include <new>
+#include <mutex>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/mman.h>
+
+TOOLPEX_NAMESPACE_BEG
+
+char* page_pool_allocator::allocate(size_t n)
+{
+    toolpex_assert(m_pool);
+    if (n != m_pool->page_size())
+        throw ::std::invalid_argument{ "page_pool_allocator: size must be the page size of the pool" };
+    char* result = m_pool->pop();
+    if (!result) throw ::std::bad_alloc{};
+    return result;
+}
+
+void page_pool_allocator::deallocate(char* p, [[maybe_unused]] size_t n) noexcept
+{
+    toolpex_assert(m_pool && n == m_pool->page_size());
+    m_pool->push(p);
+}
+
+page_pool::page_pool(size_t page_size, size_t npages, bool lock_memory)
+    : m_page_size{ page_size }, m_npages{ npages }
+{
+    const auto sys_page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    if (page_size == 0 || page_size % sys_page_size)
+        throw ::std::invalid_argument("Page size must be a multiple of the system page size.");
+    if (npages == 0)
+        throw ::std::invalid_argument("Number of pages must be a positive integer.");
+
+    m_slab_size = page_size * npages;
+    void* p = ::mmap(nullptr, m_slab_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) throw posix_exception{ errno };
+    m_slab = static_cast<char*>(p);
+
+    if (lock_memory)
+    {
+        if (::mlock(m_slab, m_slab_size) < 0)
+        {
+            const int err = errno;
+            ::munmap(m_slab, m_slab_size);
+            throw posix_exception{ err };
+        }
+        m_locked = true;
+    }
+
+    // Popped from the back, so the lower addresses go first.
+    m_free.reserve(npages);
+    for (size_t i{ npages }; i > 0; --i)
+        m_free.push_back(m_slab + (i - 1) * page_size);
+}
+
+page_pool::~page_pool() noexcept
+{
+    toolpex_assert(in_use() == 0);
+    if (m_locked) ::munlock(m_slab, m_slab_size);
+    ::munmap(m_slab, m_slab_size);
+}
+
+page_pool::page_type page_pool::acquire()
+{
+    return { m_page_size, page_pool_allocator{ this } };
+}
+
+::std::optional<page_pool::page_type> page_pool::try_acquire()
+{
+    // Checked again by `acquire()`, it's just to skip the exception in the common case.
+    if (available() == 0) return {};
+    try
+    {
+        return acquire();
+    }
+    catch (const ::std::bad_alloc&)
+    {
+        return {};
+    }
+}
+
+bool page_pool::owns(const void* p) const noexcept
+{
+    const auto* c = static_cast<const char*>(p);
+    return c >= m_slab && c < m_slab + m_slab_size
+        && static_cast<size_t>(c - m_slab) % m_page_size == 0;
+}
+
+char* page_pool::pop() noexcept
+{
+    char* result{};
+    {
+        ::std::lock_guard lk{ m_lock };
+        if (m_free.empty()) return nullptr;
+        result = m_free.back();
+        m_free.pop_back();
+    }
+
+    const size_t now = m_in_use.fetch_add(1, ::std::memory_order_relaxed) + 1;
+    size_t peak = m_peak_in_use.load(::std::memory_order_relaxed);
+    while (now > peak && !m_peak_in_use.compare_exchange_weak(peak, now, ::std::memory_order_relaxed))
+        ;
+    return result;
+}
+
+void page_pool::push(char* p) noexcept
+{
+    toolpex_assert(owns(p));
+    {
+        ::std::lock_guard lk{ m_lock };
+        // Never reallocates, the capacity was reserved for all the pages.
+        m_free.push_back(p);
+    }
+    m_in_use.fetch_sub(1, ::std::memory_order_relaxed);
+}
+
+TOOLPEX_NAMESPACE_END
@@ -0,0 +1,153 @@
+#include "toolpex/spsc_byte_ring.h"
+#include "toolpex/unique_posix_fd.h"
+
+#include <bit>
+#include <new>
+#include <algorithm>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <sys/mman.h>
+
+namespace toolpex
+{
+
+spsc_byte_ring::spsc_byte_ring(size_t capacity, bool double_mapped)
+{
+    if (capacity == 0)
+        throw ::std::invalid_argument("Capacity must be a positive integer.");
+
+    m_capacity = ::std::bit_ceil(capacity);
+    if (double_mapped)
+    {
+        m_capacity = ::std::max(m_capacity, static_cast<size_t>(::sysconf(_SC_PAGESIZE)));
+        m_double_mapped = map_twice();
+    }
+    if (!m_double_mapped)
+    {
+        m_storage = static_cast<::std::byte*>(
+            ::operator new(m_capacity, ::std::align_val_t{ cache_line_size }));
+    }
+    m_mask = m_capacity - 1;
+}
+
+spsc_byte_ring::~spsc_byte_ring() noexcept
+{
+    if (m_double_mapped)
+        ::munmap(m_storage, m_capacity * 2);
+    else ::operator delete(m_storage, ::std::align_val_t{ cache_line_size });
+}
+
+bool spsc_byte_ring::map_twice()
+{
+    unique_posix_fd fd{ ::memfd_create("toolpex_spsc_byte_ring", MFD_CLOEXEC) };
+    if (fd < 0 || ::ftruncate(fd, static_cast<off_t>(m_capacity)) < 0)
+        return false;
+
+    // Reserve the address range first, then map the file onto both halves of it.
+    void* p = ::mmap(nullptr, m_capacity * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return false;
+    auto* base = static_cast<::std::byte*>(p);
+
+    for (::std::byte* half : { base, base + m_capacity })
+    {
+        if (::mmap(half, m_capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+        {
+            ::munmap(base, m_capacity * 2);
+            return false;
+        }
+    }
+
+    m_storage = base;
+    return true;
+}
+
+::std::span<::std::byte> spsc_byte_ring::writable_span() noexcept
+{
+    const size_t head = m_producer.head.load(::std::memory_order_relaxed);
+    const size_t offset = head & m_mask;
+    const size_t contiguous = m_double_mapped ? m_capacity : m_capacity - offset;
+
+    // The cached tail could be stale, reload it unless it already gives the longest span possible.
+    size_t free = m_capacity - (head - m_producer.cached_tail);
+    if (free < contiguous)
+    {
+        m_producer.cached_tail = m_consumer.tail.load(::std::memory_order_acquire);
+        free = m_capacity - (head - m_producer.cached_tail);
+    }
+
+    return { m_storage + offset, ::std::min(free, contiguous) };
+}
+
+bool spsc_byte_ring::commit_write(size_t nbytes) noexcept
+{
+    const size_t head = m_producer.head.load(::std::memory_order_relaxed);
+    if (nbytes > m_capacity - (head - m_producer.cached_tail))
+        return false;
+    m_producer.head.store(head + nbytes, ::std::memory_order_release);
+    return true;
+}
+
+size_t spsc_byte_ring::write(::std::span<const ::std::byte> bytes) noexcept
+{
+    size_t result{};
+    while (result < bytes.size())
+    {
+        const auto sp = writable_span();
+        if (sp.empty()) break;
+        const size_t n = ::std::min(sp.size(), bytes.size() - result);
+        ::std::copy_n(bytes.data() + result, n, sp.data());
+        commit_write(n);
+        result += n;
+    }
+    return result;
+}
+
+::std::span<const ::std::byte> spsc_byte_ring::next_readable_span() noexcept
+{
+    const size_t tail = m_consumer.tail.load(::std::memory_order_relaxed);
+    const size_t offset = tail & m_mask;
+    const size_t contiguous = m_double_mapped ? m_capacity : m_capacity - offset;
+
+    size_t readable = m_consumer.cached_head - tail;
+    if (readable < contiguous)
+    {
+        m_consumer.cached_head = m_producer.head.load(::std::memory_order_acquire);
+        readable = m_consumer.cached_head - tail;
+    }
+
+    return { m_storage + offset, ::std::min(readable, contiguous) };
+}
+
+bool spsc_byte_ring::commit_read(size_t nbytes) noexcept
+{
+    const size_t tail = m_consumer.tail.load(::std::memory_order_relaxed);
+    if (nbytes > m_consumer.cached_head - tail)
+        return false;
+    m_consumer.tail.store(tail + nbytes, ::std::memory_order_release);
+    return true;
+}
+
+size_t spsc_byte_ring::read(::std::span<::std::byte> out) noexcept
+{
+    size_t result{};
+    while (result < out.size())
+    {
+        const auto sp = next_readable_span();
+        if (sp.empty()) break;
+        const size_t n = ::std::min(sp.size(), out.size() - result);
+        ::std::copy_n(sp.data(), n, out.data() + result);
+        commit_read(n);
+        result += n;
+    }
+    return result;
+}
+
+size_t spsc_byte_ring::readable_bytes() const noexcept
+{
+    const size_t tail = m_consumer.tail.load(::std::memory_order_acquire);
+    const size_t head = m_producer.head.load(::std::memory_order_acquire);
+    return head - tail;
+}
+
+} // namespace toolpex
@@ -0,0 +1,379 @@
+#include "toolpex/uring_engine.h"
+#include "toolpex/exceptions.h"
+#include "toolpex/assert.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <vector>
+#include <exception>
+#include <algorithm>
+#include <stdexcept>
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace toolpex
+{
+
+namespace
+{
+
+int sys_io_uring_setup(unsigned entries, ::io_uring_params* p) noexcept
+{
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, p));
+}
+
+int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) noexcept
+{
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+int sys_io_uring_register(int fd, unsigned opcode, const void* arg, unsigned nr_args) noexcept
+{
+    return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+void* map_ring(int fd, size_t size, off_t offset)
+{
+    void* result = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    if (result == MAP_FAILED) throw posix_exception{ errno };
+    return result;
+}
+
+template<typename T>
+T* at_offset(void* base, unsigned offset) noexcept
+{
+    return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+
+unsigned load_acquire(unsigned* p) noexcept
+{
+    return ::std::atomic_ref<unsigned>{ *p }.load(::std::memory_order_acquire);
+}
+
+void store_release(unsigned* p, unsigned v) noexcept
+{
+    ::std::atomic_ref<unsigned>{ *p }.store(v, ::std::memory_order_release);
+}
+
+} // annoymous namespace
+
+struct uring_engine::operation
+{
+    operation(bool r, buffer& b, callback_promise<size_t> p) noexcept
+        : is_read{ r }, buf{ &b }, cp{ ::std::move(p) }
+    {
+    }
+
+    bool is_read{};
+    buffer* buf{};
+    callback_promise<size_t> cp;
+
+    // Where a read lands, the bytes are committed to the current block of `buf`,
+    // which must still end right here when the read completed.
+    const ::std::byte* target{};
+};
+
+namespace
+{
+
+bool still_writing_at(const buffer& buf, const ::std::byte* target) noexcept
+{
+    if (buf.blocks().empty()) return false;
+    const auto last = buf.blocks().back().valid_span();
+    return last.data() + last.size() == target;
+}
+
+} // annoymous namespace
+
+// Fixed size blocks carved from one `mmap`ed region, which is registered as fixed buffer 0.
+class uring_engine::registered_arena : public ::std::pmr::memory_resource
+{
+public:
+    registered_arena(size_t nblocks, size_t block_size)
+        : m_block_size{ (block_size + alignof(::std::max_align_t) - 1) & ~(alignof(::std::max_align_t) - 1) },
+          m_size{ nblocks * m_block_size }
+    {
+        void* p = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) throw posix_exception{ errno };
+        m_storage = static_cast<::std::byte*>(p);
+
+        m_free.reserve(nblocks);
+        for (size_t i{ nblocks }; i > 0; --i)
+            m_free.push_back(m_storage + (i - 1) * m_block_size);
+    }
+
+    ~registered_arena() noexcept override
+    {
+        ::munmap(m_storage, m_size);
+    }
+
+    ::iovec as_iovec() const noexcept { return { m_storage, m_size }; }
+
+    bool contains(::std::span<const ::std::byte> sp) const noexcept
+    {
+        return sp.data() >= m_storage && sp.data() + sp.size() <= m_storage + m_size;
+    }
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        if (bytes > m_block_size || alignment > alignof(::std::max_align_t) || m_free.empty())
+            throw ::std::bad_alloc{};
+        void* result = m_free.back();
+        m_free.pop_back();
+        return result;
+    }
+
+    void do_deallocate(void* p, size_t, size_t) override
+    {
+        m_free.push_back(static_cast<::std::byte*>(p));
+    }
+
+    bool do_is_equal(const ::std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+private:
+    size_t m_block_size{};
+    size_t m_size{};
+    ::std::byte* m_storage{};
+    ::std::vector<::std::byte*> m_free;
+};
+
+uring_engine::uring_engine(unsigned entries)
+{
+    ::io_uring_params p{};
+    const int fd = sys_io_uring_setup(entries, &p);
+    if (fd < 0) throw posix_exception{ errno };
+    m_ring_fd = fd;
+
+    m_sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    m_cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(::io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        m_sq_ring_size = m_cq_ring_size = ::std::max(m_sq_ring_size, m_cq_ring_size);
+        m_sq_ring = map_ring(m_ring_fd, m_sq_ring_size, IORING_OFF_SQ_RING);
+        m_cq_ring = m_sq_ring;
+    }
+    else
+    {
+        m_sq_ring = map_ring(m_ring_fd, m_sq_ring_size, IORING_OFF_SQ_RING);
+        m_cq_ring = map_ring(m_ring_fd, m_cq_ring_size, IORING_OFF_CQ_RING);
+    }
+    m_sqes_size = p.sq_entries * sizeof(::io_uring_sqe);
+    m_sqes = static_cast<::io_uring_sqe*>(map_ring(m_ring_fd, m_sqes_size, IORING_OFF_SQES));
+
+    m_sq_head = at_offset<unsigned>(m_sq_ring, p.sq_off.head);
+    m_sq_tail = at_offset<unsigned>(m_sq_ring, p.sq_off.tail);
+    m_sq_array = at_offset<unsigned>(m_sq_ring, p.sq_off.array);
+    m_sq_mask = *at_offset<unsigned>(m_sq_ring, p.sq_off.ring_mask);
+    m_sq_entries = p.sq_entries;
+
+    m_cq_head = at_offset<unsigned>(m_cq_ring, p.cq_off.head);
+    m_cq_tail = at_offset<unsigned>(m_cq_ring, p.cq_off.tail);
+    m_cqes = at_offset<::io_uring_cqe>(m_cq_ring, p.cq_off.cqes);
+    m_cq_mask = *at_offset<unsigned>(m_cq_ring, p.cq_off.ring_mask);
+    m_cq_entries = p.cq_entries;
+}
+
+uring_engine::~uring_engine() noexcept
+{
+    // Requests still in flight would complete into memory we are going to free.
+    while (m_in_flight)
+    {
+        try { wait(); }
+        catch (...) { break; }
+    }
+
+    if (m_sqes) ::munmap(m_sqes, m_sqes_size);
+    if (m_cq_ring && m_cq_ring != m_sq_ring) ::munmap(m_cq_ring, m_cq_ring_size);
+    if (m_sq_ring) ::munmap(m_sq_ring, m_sq_ring_size);
+    m_ring_fd.close();
+}
+
+void uring_engine::register_arena(size_t nblocks, size_t block_size)
+{
+    toolpex_assert(!m_arena);
+    auto arena = ::std::make_unique<registered_arena>(nblocks, block_size);
+    const ::iovec iov = arena->as_iovec();
+    if (sys_io_uring_register(m_ring_fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+        throw posix_exception{ errno };
+    m_arena = ::std::move(arena);
+}
+
+::std::pmr::memory_resource* uring_engine::registered_resource() noexcept
+{
+    return m_arena.get();
+}
+
+::io_uring_sqe* uring_engine::get_sqe()
+{
+    // Never let the completions overflow the CQ ring.
+    while (m_in_flight >= m_cq_entries)
+        wait();
+
+    const unsigned tail = *m_sq_tail;
+    // The kernel may consume fewer entries than we handed over.
+    while (tail - load_acquire(m_sq_head) >= m_sq_entries)
+    {
+        submit();
+    }
+
+    const unsigned idx = tail & m_sq_mask;
+    m_sq_array[idx] = idx;
+    auto* sqe = &m_sqes[idx];
+    ::std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+void uring_engine::queue(int fd, uint8_t opcode, ::std::span<const ::std::byte> sp,
+                         uint64_t offset, ::std::unique_ptr<operation> op)
+{
+    auto* sqe = get_sqe();
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->off = offset;
+    sqe->addr = reinterpret_cast<uint64_t>(sp.data());
+    sqe->len = static_cast<uint32_t>(sp.size());
+    if (m_arena && m_arena->contains(sp))
+    {
+        sqe->opcode = (opcode == IORING_OP_READ) ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+        sqe->buf_index = 0;
+    }
+    sqe->user_data = reinterpret_cast<uint64_t>(op.release());
+
+    store_release(m_sq_tail, *m_sq_tail + 1);
+    ++m_to_submit;
+    ++m_in_flight;
+}
+
+void uring_engine::submit_read(int fd, buffer& buf, callback_promise<size_t> cp,
+                               uint64_t offset, size_t at_least)
+{
+    auto sp = buf.writable_span(at_least);
+    auto op = ::std::make_unique<operation>(true, buf, ::std::move(cp));
+    op->target = sp.data();
+    queue(fd, IORING_OP_READ, sp, offset, ::std::move(op));
+}
+
+void uring_engine::submit_write(int fd, buffer& buf, callback_promise<size_t> cp, uint64_t offset)
+{
+    auto sp = buf.next_readable_span();
+    if (sp.empty())
+    {
+        throw ::std::invalid_argument("Nothing to write in the next readable span of the buffer.");
+    }
+    queue(fd, IORING_OP_WRITE, sp, offset,
+          ::std::make_unique<operation>(false, buf, ::std::move(cp)));
+}
+
+int uring_engine::enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    for (;;)
+    {
+        const int ret = sys_io_uring_enter(m_ring_fd, to_submit, min_complete, flags);
+        if (ret >= 0) return ret;
+        if (errno == EINTR) continue;
+        throw posix_exception{ errno };
+    }
+}
+
+size_t uring_engine::submit()
+{
+    if (m_to_submit == 0) return 0;
+    const int ret = enter(m_to_submit, 0, 0);
+    m_to_submit -= static_cast<unsigned>(ret);
+    return static_cast<size_t>(ret);
+}
+
+size_t uring_engine::poll()
+{
+    return reap();
+}
+
+size_t uring_engine::wait(size_t min_complete)
+{
+    if (min_complete > m_in_flight) min_complete = m_in_flight;
+    if (min_complete == 0)
+    {
+        submit();
+        return reap();
+    }
+
+    const int ret = enter(m_to_submit, static_cast<unsigned>(min_complete), IORING_ENTER_GETEVENTS);
+    m_to_submit -= static_cast<unsigned>(ret);
+    return reap();
+}
+
+void uring_engine::dispatch(operation& op, int res)
+{
+    if (res < 0)
+    {
+        op.cp.set_exception(::std::make_exception_ptr(posix_exception{ -res }));
+        return;
+    }
+
+    const auto nbytes = static_cast<size_t>(res);
+    if (op.is_read) 
+    {
+        if (!still_writing_at(*op.buf, op.target))
+        {
+            op.cp.set_exception(::std::make_exception_ptr(::std::runtime_error{ 
+                "The buffer was written while a read was in flight." 
+            }));
+            return;
+        }
+        op.buf->commit_write(nbytes);
+    }
+    else op.buf->commit_read(nbytes);
+    op.cp.set_value(nbytes);
+}
+
+size_t uring_engine::reap()
+{
+    // Take all the ready completions off the ring before running any callback,
+    // a callback may submit, and then wait and reap again.
+    struct completion
+    {
+        ::std::unique_ptr<operation> op;
+        int res{};
+    };
+    ::std::vector<completion> ready;
+    const unsigned tail = load_acquire(m_cq_tail);
+    unsigned head = *m_cq_head;
+    ready.reserve(tail - head);
+    for (; head != tail; ++head)
+    {
+        const ::io_uring_cqe& cqe = m_cqes[head & m_cq_mask];
+        ready.push_back({ ::std::unique_ptr<operation>{ reinterpret_cast<operation*>(cqe.user_data) }, cqe.res });
+    }
+    store_release(m_cq_head, head);
+    m_in_flight -= ready.size();
+
+    // A throwing callback must not lose the completions after it, 
+    // every one of them is dispatched before the first exception propagates.
+    ::std::exception_ptr first_exception;
+    for (auto& [op, res] : ready)
+    {
+        try
+        {
+            dispatch(*op, res);
+        }
+        catch (...)
+        {
+            if (!first_exception) first_exception = ::std::current_exception();
+        }
+    }
+    if (first_exception) ::std::rethrow_exception(first_exception);
+    return ready.size();
+}
+
+} // namespace toolpex
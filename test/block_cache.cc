@@ -0,0 +1,154 @@
+#include "gtest/gtest.h"
+#include "toolpex/block_cache.h"
+#include "toolpex/unique_posix_fd.h"
+#include "temp_file.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+#include <string_view>
+
+#include <unistd.h>
+
+using namespace toolpex;
+
+namespace
+{
+
+const size_t psz = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+
+::std::string_view as_sv(::std::span<const ::std::byte> sp)
+{
+    return { reinterpret_cast<const char*>(sp.data()), sp.size() };
+}
+
+class block_cache_suite : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        fd = toolpex_test::open_unlinked_temp_file();
+        for (int i{}; content.size() < 64 * 1024; ++i) 
+            content += ::std::to_string(i) + ";";
+        ASSERT_EQ(::write(fd, content.data(), content.size()), static_cast<ssize_t>(content.size()));
+    }
+
+    unique_posix_fd fd;
+    ::std::string content;
+};
+
+} // annoymous namespace
+
+TEST_F(block_cache_suite, read_through)
+{
+    block_cache cache{ 4 * psz, psz, 2 };
+    ASSERT_EQ(cache.capacity_bytes(), 4 * psz);
+
+    auto p = cache.read_through(fd, 100, 1000);
+    ASSERT_TRUE(p);
+    ASSERT_EQ(as_sv(p.bytes()), ::std::string_view{ content }.substr(100, 1000));
+    ASSERT_EQ(cache.stats().misses(), 1);
+
+    auto again = cache.read_through(fd, 100, 1000);
+    ASSERT_EQ(again.bytes().data(), p.bytes().data());
+    ASSERT_EQ(cache.stats().hits(), 1);
+    ASSERT_EQ(cache.size(), 1);
+
+    // Short at the end of the file.
+    auto tail = cache.read_through(fd, static_cast<off_t>(content.size() - 10), psz);
+    ASSERT_EQ(tail.bytes().size(), 10);
+
+    ASSERT_THROW(cache.read_through(fd, 0, psz + 1), ::std::invalid_argument);
+    ASSERT_THROW(cache.read_through(-1, 0, 1), ::std::system_error);
+}
+
+TEST_F(block_cache_suite, longer_request_rereads)
+{
+    block_cache cache{ 4 * psz, psz, 2 };
+
+    auto short_one = cache.read_through(fd, 0, 100);
+    ASSERT_EQ(short_one.bytes().size(), 100);
+    ASSERT_FALSE(short_one.at_eof());
+
+    // The cached block is too short, read again and replaced.
+    auto longer = cache.read_through(fd, 0, 4000);
+    ASSERT_EQ(as_sv(longer.bytes()), ::std::string_view{ content }.substr(0, 4000));
+    ASSERT_EQ(cache.size(), 1);
+    ASSERT_EQ(cache.stats().misses(), 2);
+
+    // The old pin is still valid.
+    ASSERT_EQ(as_sv(short_one.bytes()), ::std::string_view{ content }.substr(0, 100));
+
+    // A longer block serves shorter requests.
+    auto shorter = cache.read_through(fd, 0, 10);
+    ASSERT_EQ(shorter.bytes().data(), longer.bytes().data());
+
+    // Short at the end of file is a hit for longer requests.
+    const auto tail_off = static_cast<off_t>(content.size() - 10);
+    auto tail = cache.read_through(fd, tail_off, 100);
+    ASSERT_TRUE(tail.at_eof());
+    auto tail_again = cache.read_through(fd, tail_off, 200);
+    ASSERT_EQ(tail_again.bytes().data(), tail.bytes().data());
+    ASSERT_EQ(tail_again.bytes().size(), 10);
+}
+
+TEST_F(block_cache_suite, eviction_skips_pinned)
+{
+    block_cache cache{ 2 * psz, psz, 1 };
+    const auto id = block_cache::file_id_of(fd);
+
+    auto pinned = cache.read_through(id, fd, 0, 100);
+    cache.read_through(id, fd, 1000, 100);
+    ASSERT_EQ(cache.size_bytes(), 2 * psz);
+
+    // The unpinned block at 1000 is the victim, though 0 is older.
+    cache.read_through(id, fd, 2000, 100);
+    ASSERT_TRUE(cache.get({ id, 0 }));
+    ASSERT_FALSE(cache.get({ id, 1000 }));
+    ASSERT_EQ(cache.stats().evictions(), 1);
+
+    auto pinned2 = cache.get({ id, 2000 });
+    ASSERT_THROW(cache.read_through(id, fd, 3000, 100), ::std::bad_alloc);
+
+    // Erased but still pinned, the page stays valid.
+    ASSERT_TRUE(cache.erase({ id, 0 }));
+    ASSERT_FALSE(cache.get({ id, 0 }));
+    ASSERT_EQ(as_sv(pinned.bytes()), ::std::string_view{ content }.substr(0, 100));
+    ASSERT_EQ(cache.size_bytes(), 2 * psz);
+    pinned = {};
+    ASSERT_EQ(cache.size_bytes(), psz);
+}
+
+TEST_F(block_cache_suite, erase_file)
+{
+    block_cache cache{ 16 * psz, psz, 4 };
+    for (off_t off{}; off < 8 * 100; off += 100)
+        cache.read_through(1, fd, off, 100);
+    cache.read_through(2, fd, 0, 100);
+    ASSERT_EQ(cache.size(), 9);
+    ASSERT_EQ(cache.erase_file(1), 8);
+    ASSERT_EQ(cache.size(), 1);
+    ASSERT_EQ(cache.size_bytes(), psz);
+    ASSERT_TRUE(cache.get({ 2, 0 }));
+}
+
+TEST_F(block_cache_suite, concurrent_read_through)
+{
+    block_cache cache{ 8 * psz, psz, 4 };
+    ::std::vector<::std::jthread> threads;
+    for (int t{}; t < 4; ++t)
+    {
+        threads.emplace_back([&, t] {
+            for (int i{}; i < 2000; ++i)
+            {
+                const auto off = static_cast<off_t>(((i * 7 + t) % 32) * 512);
+                auto p = cache.read_through(42, fd, off, 512);
+                ASSERT_EQ(as_sv(p.bytes()), ::std::string_view{ content }.substr(static_cast<size_t>(off), 512));
+            }
+        });
+    }
+    threads.clear();
+    ASSERT_LE(cache.size(), 8);
+    const auto st = cache.stats();
+    ASSERT_EQ(st.hits() + st.misses(), 4 * 2000);
+}
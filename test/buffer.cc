@@ -1,9 +1,20 @@
 #include "toolpex/buffer.h"
 #include "gtest/gtest.h"
 #include "toolpex/functional.h"
+#include "toolpex/unique_posix_fd.h"
+#include "toolpex/exceptions.h"
+#include "temp_file.h"
 
 #include <string>
 #include <span>
+#include <array>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
 
 using namespace toolpex;
 using namespace ::std::string_literals;
@@ -159,3 +170,617 @@ TEST_F(buffer_suite, commit_0_read)
     b.commit_read(0);
     ASSERT_EQ(sp1.data(), b.next_readable_span().data());
 }
+
+TEST_F(buffer_suite, interleaved_write_read)
+{
+    reset_without_fill();
+    b.append("abc"s);
+    ASSERT_EQ(b.next_readable_span().size(), 3);
+    b.commit_read(3);
+    ASSERT_TRUE(b.next_readable_span().empty());
+
+    // Appended into the block just finished reading.
+    b.append("de"s);
+    ASSERT_EQ(b.next_readable_span().size(), 2);
+    b.commit_read(2);
+
+    // Spill into a new block.
+    b.append("0123456789abcdefghij"s);
+    ::std::string result;
+    for (auto sp = b.next_readable_span(); !sp.empty(); sp = b.next_readable_span())
+    {
+        result += sp | rv::transform(byte_to_char) | r::to<::std::string>();
+        b.commit_read(sp.size());
+    }
+    ASSERT_EQ(result, "0123456789abcdefghij");
+}
+
+TEST_F(buffer_suite, as_iovecs)
+{
+    reset();
+    const auto iovs = b.as_iovecs();
+    size_t total{};
+    for (const auto& iov : iovs) total += iov.iov_len;
+    ASSERT_EQ(total, b.total_nbytes_valid());
+
+    b.commit_read(1);
+    size_t total_after_read{};
+    for (const auto& iov : b.as_iovecs()) total_after_read += iov.iov_len;
+    ASSERT_EQ(total_after_read, total - 1);
+    ASSERT_EQ(b.as_iovecs(1).size(), 1);
+}
+
+TEST_F(buffer_suite, write_to_read_from)
+{
+    reset();
+    const auto expected = b.flattened_view() | rv::transform(byte_to_char) | r::to<::std::string>();
+
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    unique_posix_fd rfd{ fds[0] }, wfd{ fds[1] };
+    
+    ASSERT_EQ(b.write_to(wfd), expected.size());
+    ASSERT_TRUE(b.as_iovecs().empty());
+    wfd.close();
+
+    buffer received{ 8 };
+    ssize_t ret{};
+    while ((ret = received.read_from(rfd)) > 0)
+        ;
+    ASSERT_EQ(ret, 0);
+    ASSERT_EQ(received.flattened_view() | rv::transform(byte_to_char) | r::to<::std::string>(), expected);
+}
+
+TEST_F(buffer_suite, write_to_would_block)
+{
+    int fds[2];
+    ASSERT_EQ(::pipe2(fds, O_NONBLOCK), 0);
+    unique_posix_fd rfd{ fds[0] }, wfd{ fds[1] };
+
+    buffer big{ 4096 };
+    const ::std::string chunk(4096, 'x');
+    for (int i{}; i < 64; ++i)
+        big.append(chunk);
+
+    const size_t wrote = big.write_to(wfd);
+    ASSERT_GT(wrote, 0);
+    ASSERT_LT(wrote, chunk.size() * 64);
+    
+    ::std::array<char, 4096> sink;
+    size_t drained{}, total_wrote{ wrote };
+    for (;;)
+    {
+        ssize_t n{};
+        while ((n = ::read(rfd, sink.data(), sink.size())) > 0)
+            drained += static_cast<size_t>(n);
+        ASSERT_EQ(drained, total_wrote);
+        if (big.as_iovecs().empty()) break;
+        total_wrote += big.write_to(wfd);
+    }
+    ASSERT_EQ(total_wrote, chunk.size() * 64);
+    ASSERT_EQ(big.read_from(rfd), -1);
+}
+
+TEST_F(buffer_suite, read_from_without_data)
+{
+    int fds[2];
+    ASSERT_EQ(::pipe2(fds, O_NONBLOCK), 0);
+    unique_posix_fd rfd{ fds[0] }, wfd{ fds[1] };
+
+    buffer b{ 4096 };
+    for (int i{}; i < 5; ++i)
+        ASSERT_EQ(b.read_from(rfd), -1);
+    ASSERT_EQ(b.blocks().size(), 0);
+
+    ASSERT_EQ(::write(wfd, "hello", 5), 5);
+    ASSERT_EQ(b.read_from(rfd), 5);
+    ASSERT_EQ(::write(wfd, "world", 5), 5);
+    ASSERT_EQ(b.read_from(rfd), 5);
+    ASSERT_EQ(b.blocks().size(), 1);
+
+    for (int i{}; i < 5; ++i)
+        ASSERT_EQ(b.read_from(rfd), -1);
+    wfd.close();
+    for (int i{}; i < 5; ++i)
+        ASSERT_EQ(b.read_from(rfd), 0);
+    ASSERT_EQ(b.blocks().size(), 1);
+    ASSERT_EQ(b.readable_bytes(), 10);
+}
+
+TEST_F(buffer_suite, read_from_into_blocks)
+{
+    int fds[2];
+    ASSERT_EQ(::pipe2(fds, O_NONBLOCK), 0);
+    unique_posix_fd rfd{ fds[0] }, wfd{ fds[1] };
+    const ::std::string payload(10000, 'p');
+    ASSERT_EQ(::write(wfd, payload.data(), payload.size()), static_cast<ssize_t>(payload.size()));
+
+    // Without a free tail, a read fills exactly one fresh block.
+    buffer b{ 4096 };
+    ASSERT_EQ(b.read_from(rfd), 4096);
+    ASSERT_EQ(b.blocks().size(), 1);
+
+    // A short tail spills a little to the next block.
+    b.commit_remove_after_read(4000);
+    b.append(::std::string(4096 - 100, 'x'));
+    ASSERT_EQ(b.read_from(rfd), 100 + 4096);
+    ASSERT_EQ(b.readable_bytes(), 96 + 3996 + 4196);
+    ASSERT_EQ(b.read_from(rfd), 10000 - 4096 - 4196);
+}
+
+TEST_F(buffer_suite, concurrent_dup_of_const_buffer)
+{
+    buffer src{ 4096 };
+    src.append(::std::string(10000, 'x'));
+    const buffer& csrc = src;
+
+    ::std::vector<::std::jthread> threads;
+    for (int t{}; t < 4; ++t)
+    {
+        threads.emplace_back([&csrc] {
+            for (int i{}; i < 1000; ++i)
+            {
+                buffer d = csrc.dup();
+                buffer s = csrc.slice(1, 5000);
+                ASSERT_EQ(d.readable_bytes(), 10000);
+                ASSERT_EQ(s.readable_bytes(), 5000);
+            }
+        });
+    }
+    threads.clear();
+    ASSERT_TRUE(r::all_of(src.blocks(), [](const auto& blk) { return !blk.shared(); }));
+}
+
+TEST_F(buffer_suite, dup_shares_blocks)
+{
+    reset();
+
+    buffer c = b.dup();
+    ASSERT_EQ(c.blocks().size(), b.blocks().size());
+    ASSERT_EQ(c.blocks()[0].valid_span().data(), b.blocks()[0].valid_span().data());
+    ASSERT_TRUE(b.last_block().shared());
+
+    // Both sides append to new blocks, the shared ones stay untouched.
+    const auto before = b.flattened_view() | rv::transform(byte_to_char) | r::to<::std::string>();
+    c.append("hello"s);
+    b.append("world"s);
+    ASSERT_EQ(c.flattened_view() | rv::transform(byte_to_char) | r::to<::std::string>(), before + "hello");
+    ASSERT_EQ(b.flattened_view() | rv::transform(byte_to_char) | r::to<::std::string>(), before + "world");
+}
+
+TEST_F(buffer_suite, copy_on_write)
+{
+    buffer_block blk{ 16 };
+    auto ws = blk.writable_span();
+    ws[0] = ::std::byte{ 'a' };
+    blk.commit_write(1);
+
+    buffer_block view = blk.share(0, 1);
+    ASSERT_TRUE(blk.shared());
+    ASSERT_EQ(blk.left(), 0);
+
+    blk.valid_span()[0] = ::std::byte{ 'b' };
+    ASSERT_FALSE(blk.shared());
+    ASSERT_FALSE(view.shared());
+    ASSERT_EQ(::std::as_const(view).valid_span()[0], ::std::byte{ 'a' });
+    ASSERT_EQ(::std::as_const(blk).valid_span()[0], ::std::byte{ 'b' });
+}
+
+TEST_F(buffer_suite, slice)
+{
+    b = { 16 };
+    b.append("0123456789abcdefghijklmnopqrstuvwxyz"s);
+    b.commit_read(4);
+
+    buffer s = b.slice(10, 20);
+    ASSERT_EQ(s.flattened_view() | rv::transform(byte_to_char) | r::to<::std::string>(), "efghijklmnopqrstuvwx");
+    ASSERT_EQ(s.next_readable_span().data(), b.next_readable_span().data() + 10);
+    ASSERT_THROW(b.slice(10, 100), ::std::out_of_range);
+
+    // The slice keeps the storage alive.
+    b = { 16 };
+    ASSERT_EQ(s.flattened_view() | rv::transform(byte_to_char) | r::to<::std::string>(), "efghijklmnopqrstuvwx");
+}
+
+TEST_F(buffer_suite, read_then_unshare)
+{
+    b = { 16 };
+    b.append("abc"s);
+    {
+        buffer c = b.dup();
+        b.commit_read(3);
+    }
+    // The block becomes writable again, the reader must still see the new bytes.
+    b.append("de"s);
+    ASSERT_EQ(b.next_readable_span().size(), 2);
+}
+
+TEST_F(buffer_suite, running_counters)
+{
+    reset();
+    auto fold_valid = [this] { 
+        size_t result{};
+        for (auto sp : b.blocks_valid_span()) result += sp.size();
+        return result;
+    };
+    auto fold_allocated = [this] { 
+        size_t result{};
+        for (const auto& blk : b.blocks()) result += blk.capacity();
+        return result;
+    };
+
+    const size_t written = b.total_nbytes_written();
+    ASSERT_EQ(written, 3 + 3 * 25);
+    ASSERT_EQ(b.readable_bytes(), written);
+    ASSERT_EQ(b.total_nbytes_valid(), fold_valid());
+    ASSERT_EQ(b.total_nbytes_allocated(), fold_allocated());
+
+    buffer s = b.slice(2, 5);
+    ASSERT_EQ(s.readable_bytes(), 5);
+    ASSERT_EQ(s.total_nbytes_valid(), 5);
+
+    b.commit_read(1);
+    ASSERT_EQ(b.readable_bytes(), written - 1);
+    while (b.readable_bytes() > 10)
+        b.commit_remove_after_read(b.next_readable_span().size());
+    ASSERT_GT(b.total_nbytes_released(), 0);
+    ASSERT_EQ(b.total_nbytes_read() + b.readable_bytes(), written);
+    ASSERT_EQ(b.total_nbytes_valid(), fold_valid());
+    ASSERT_EQ(b.total_nbytes_allocated(), fold_allocated());
+}
+
+TEST_F(buffer_suite, streaming_recycles_blocks)
+{
+    buffer s{ 64 };
+    const ::std::string chunk(64, 'x');
+    const ::std::byte* first_storage{};
+    for (int i{}; i < 1000; ++i)
+    {
+        s.append(chunk);
+        if (i == 0) first_storage = s.next_readable_span().data();
+        while (s.readable_bytes())
+            s.commit_remove_after_read(s.next_readable_span().size());
+        ASSERT_LE(s.blocks().size(), 2);
+    }
+    ASSERT_EQ(s.total_nbytes_written(), 64 * 1000);
+    ASSERT_EQ(s.total_nbytes_valid(), s.blocks().empty() ? 0 : s.last_block().size());
+
+    // Two blocks take turns.
+    s.append(chunk);
+    s.append(chunk);
+    ASSERT_TRUE(s.blocks()[0].valid_span().data() == first_storage 
+             || s.blocks()[1].valid_span().data() == first_storage);
+}
+
+TEST_F(buffer_suite, compact)
+{
+    b = { 16 };
+    b.append("0123456789abcdefghijklmnopqrstuvwxyz"s);
+    ASSERT_GT(b.blocks().size(), 0);
+    ASSERT_FALSE(b.compact(10));
+
+    while (b.readable_bytes() > 5)
+        b.commit_read(::std::min(b.next_readable_span().size(), b.readable_bytes() - 5));
+    ASSERT_TRUE(b.compact(10));
+    ASSERT_EQ(b.blocks().size(), 1);
+    ASSERT_EQ(b.readable_bytes(), 5);
+    ASSERT_EQ(b.total_nbytes_valid(), 5);
+    ASSERT_EQ(b.total_nbytes_allocated(), b.last_block().capacity());
+
+    b.append("!"s);
+    ASSERT_EQ(b.flattened_view() | rv::transform(byte_to_char) | r::to<::std::string>(), "vwxyz!");
+}
+
+TEST_F(buffer_suite, compact_unread)
+{
+    // Nothing read, nothing released, the reading state could still be reset.
+    b = { 16 };
+    for (auto piece : { "0123456789abcdef"s, "ghijklmnopqrstuv"s, "wxyz"s })
+        b.append(piece);
+    ASSERT_GT(b.blocks().size(), 1);
+    ASSERT_TRUE(b.compact(100));
+    ASSERT_EQ(b.blocks().size(), 1);
+
+    b.commit_read(10);
+    b.reset_reading_info();
+    ASSERT_EQ(b.readable_bytes(), 36);
+    ASSERT_EQ(b.flattened_view() | rv::transform(byte_to_char) | r::to<::std::string>(), 
+              "0123456789abcdefghijklmnopqrstuvwxyz");
+}
+
+TEST_F(buffer_suite, find)
+{
+    b = { 16 };
+    ::std::string all;
+    for (int i{}; i < 200; ++i)
+    {
+        // Uneven pieces, so patterns land on every kind of block boundary.
+        const ::std::string piece = ::std::to_string(i * 7919) + (i % 13 == 0 ? "\r\n" : "|");
+        b.append(piece);
+        all += piece;
+    }
+    b.commit_read(3);
+    all.erase(0, 3);
+
+    auto expected = [&](::std::string_view pat) -> ::std::optional<size_t> {
+        const auto pos = all.find(pat);
+        if (pos == ::std::string::npos) return {};
+        return pos;
+    };
+    for (::std::string_view pat : { "\r\n", "|", "7919|", "|1", "0\r\n", "nothing", "", "|15838|23757|" })
+        ASSERT_EQ(b.find(pat), expected(pat)) << pat;
+
+    // Every substring starts on every position.
+    for (size_t i{}; i + 5 <= all.size(); i += 37)
+    {
+        const auto pat = ::std::string_view{ all }.substr(i, 5);
+        ASSERT_EQ(b.find(pat), expected(pat)) << pat;
+    }
+
+    ASSERT_EQ(b.find(::std::byte{ '\n' }), all.find('\n'));
+    ASSERT_FALSE(b.find(::std::byte{ 'z' }));
+
+    // Large blocks go through the vectorized loop.
+    buffer big{ 4096 };
+    ::std::string text(10000, 'a');
+    for (size_t i{}; i < text.size(); i += 97) text[i] = 'b';
+    text.replace(4090, 12, "needle-split");
+    text.replace(9000, 7, "needle!");
+    for (size_t i{}; i < text.size(); i += 4096)
+        big.append(::std::string_view{ text }.substr(i, 4096));
+    ASSERT_EQ(big.find("needle-split"), 4090);
+    ASSERT_EQ(big.find("needle!"), 9000);
+    ASSERT_EQ(big.find("ab"), text.find("ab"));
+    ASSERT_FALSE(big.find("bb"));
+}
+
+TEST_F(buffer_suite, find_then_consume)
+{
+    buffer lines{ 16 };
+    lines.append("first line without end, "s);
+    lines.append("still the first\nsecond\n"s);
+    ASSERT_GE(lines.blocks().size(), 2);
+
+    const auto nl = lines.find(::std::byte{ '\n' });
+    ASSERT_TRUE(nl);
+    ASSERT_GT(*nl, 16);
+    ASSERT_TRUE(lines.commit_remove_after_read(*nl + 1));
+    ASSERT_EQ(lines.readable_bytes(), 7);
+    ASSERT_EQ(lines.next_readable_span() | rv::transform(byte_to_char) | r::to<::std::string>(), "second\n");
+
+    const auto nl2 = lines.find(::std::byte{ '\n' });
+    ASSERT_EQ(nl2, 6);
+    ASSERT_FALSE(lines.commit_read(*nl2 + 2));
+    ASSERT_EQ(lines.readable_bytes(), 7);
+    ASSERT_TRUE(lines.commit_read(*nl2 + 1));
+    ASSERT_EQ(lines.readable_bytes(), 0);
+}
+
+TEST_F(buffer_suite, linearize)
+{
+    b = { 8 };
+    const ::std::string_view text{ "0123456789abcdefghijklmnopqrstuvwxyz" };
+    for (size_t i{}; i < text.size(); i += 5)
+        b.append(text.substr(i, 5));
+    b.commit_read(2);
+    const size_t nblocks = b.blocks().size();
+
+    ASSERT_EQ(b.linearize(3).data(), b.next_readable_span().data());
+
+    auto sp = b.linearize(12);
+    ASSERT_EQ(::std::string_view(reinterpret_cast<const char*>(sp.data()), sp.size()), text.substr(2, 12));
+    ASSERT_GE(b.next_readable_span().size(), 12);
+    ASSERT_LT(b.blocks().size(), nblocks + 1);
+
+    // Nothing lost or reordered, even the bytes already read.
+    b.append("!"s);
+    ASSERT_EQ(b.flattened_view() | rv::transform(byte_to_char) | r::to<::std::string>(), ::std::string{ text } + "!");
+    ASSERT_EQ(b.readable_bytes(), text.size() - 2 + 1);
+    ASSERT_EQ(b.total_nbytes_valid(), text.size() + 1);
+    size_t allocated{};
+    for (const auto& blk : b.blocks()) allocated += blk.capacity();
+    ASSERT_EQ(b.total_nbytes_allocated(), allocated);
+
+    // Up to the last byte, the writer keeps going.
+    sp = b.linearize(b.readable_bytes());
+    ASSERT_EQ(sp.size(), text.size() - 1);
+    b.append("?"s);
+    ASSERT_EQ(b.readable_bytes(), text.size());
+    ASSERT_THROW(b.linearize(1000), ::std::out_of_range);
+}
+
+TEST_F(buffer_suite, flatten)
+{
+    reset();
+    b.commit_read(1);
+    buffer f = b.flatten();
+    ASSERT_EQ(f.blocks().size(), 1);
+    ASSERT_EQ(f.readable_bytes(), b.readable_bytes());
+    ASSERT_EQ(f.find("abc"), b.find("abc"));
+}
+
+TEST_F(buffer_suite, aligned_blocks)
+{
+    ASSERT_THROW(buffer_block(100, nullptr, 3), ::std::invalid_argument);
+    ASSERT_THROW(buffer(100, nullptr, 3), ::std::invalid_argument);
+    ASSERT_THROW(buffer(100, nullptr, 0), ::std::invalid_argument);
+    ASSERT_THROW(buffer(100, nullptr, 4), ::std::invalid_argument);
+
+    b = { 8192, nullptr, 4096 };
+    ASSERT_EQ(b.block_alignment(), 4096);
+    const ::std::string data(5000, 'x');
+    for (size_t i{}; i < 3; ++i)
+    {
+        b.append(data);
+        ASSERT_TRUE(b.pad_to_alignment());
+        ASSERT_EQ(b.padding_needed(), 0);
+    }
+    ASSERT_EQ(b.total_nbytes_written() % 4096, 0);
+    for (const auto& blk : b.blocks())
+    {
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(blk.valid_span().data()) % 4096, 0);
+        ASSERT_EQ(blk.capacity() % 4096, 0);
+        ASSERT_EQ(blk.size() % 4096, 0);
+    }
+    ASSERT_EQ(r::count(b.flattened_view(), ::std::byte{}), 3 * (8192 - 5000));
+
+    auto ws = b.writable_span(1);
+    ws[0] = ::std::byte{ 'y' };
+    ASSERT_TRUE(b.commit_write_padded(1, ::std::byte{ '#' }));
+    ASSERT_EQ(b.total_nbytes_written() % 4096, 0);
+
+    // A block moved by `linearize()` starts in the middle of its allocation, never recycled.
+    b = { 8192, nullptr, 4096 };
+    b.append("0123456789"s);
+    auto big = b.writable_span(16384);
+    r::fill(big, ::std::byte{ 'z' });
+    b.commit_write(big.size());
+    b.linearize(110);
+    ASSERT_TRUE(b.commit_remove_after_read(b.readable_bytes()));
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(b.writable_span().data()) % 4096, 0);
+
+    // The default is still `max_align_t`, padding is cheap.
+    buffer small{ 100 };
+    small.append("abc"s);
+    ASSERT_EQ(small.padding_needed(), buffer::alignment - 3);
+}
+
+TEST_F(buffer_suite, write_to_o_direct)
+{
+    // tmpfs refuses `O_DIRECT`.
+    const auto path = toolpex_test::make_temp_file("/var/tmp/toolpex_o_direct");
+    unique_posix_fd fd{ ::open(path.c_str(), O_WRONLY | O_DIRECT) };
+    if (fd < 0)
+    {
+        ::unlink(path.c_str());
+        GTEST_SKIP() << "O_DIRECT is not supported here";
+    }
+
+    b = { 4096, nullptr, 4096 };
+    ::std::string text;
+    for (int i{}; text.size() < 10000; ++i) text += ::std::to_string(i) + ",";
+    b.append(text);
+    b.pad_to_alignment();
+    const size_t total = b.readable_bytes();
+    ASSERT_EQ(b.write_to(fd), total);
+
+    unique_posix_fd rfd{ ::open(path.c_str(), O_RDONLY) };
+    ::std::string back(total, '\0');
+    ASSERT_EQ(::read(rfd, back.data(), back.size()), static_cast<ssize_t>(total));
+    ASSERT_EQ(back.substr(0, text.size()), text);
+    ::unlink(path.c_str());
+}
+
+TEST_F(buffer_suite, file_segment)
+{
+    unique_posix_fd file = toolpex_test::open_unlinked_temp_file();
+    ::std::string content;
+    for (int i{}; content.size() < 20000; ++i) content += ::std::to_string(i) + " ";
+    ASSERT_EQ(::write(file, content.data(), content.size()), static_cast<ssize_t>(content.size()));
+
+    const ::std::string body = content.substr(5000, 12000);
+    b.append("HEADER\n"s);
+    b.commit_read(7);
+    b.append("more header\n"s);
+    b.append_file_segment(file, 5000, body.size());
+    b.append("TRAILER"s);
+    const auto expected = "more header\n" + body + "TRAILER";
+    ASSERT_EQ(b.readable_bytes(), expected.size());
+
+    // Byte level access maps the segment on demand.
+    ASSERT_EQ(b.find("TRAILER"), expected.size() - 7);
+    ASSERT_EQ(b.find(body.substr(100, 20)), 12 + 100);
+
+    buffer d = b.dup();
+    ASSERT_TRUE(d.blocks()[2].is_file_segment());
+
+    for (int piped : { 0, 1 })
+    {
+        buffer& src = piped ? d : b;
+        int fds[2];
+        ASSERT_EQ(piped ? ::pipe(fds) : ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+        unique_posix_fd rfd{ fds[0] }, wfd{ fds[1] };
+        if (piped) ::fcntl(wfd, F_SETPIPE_SZ, 1024 * 1024);
+        else { int sz{ 1024 * 1024 }; ::setsockopt(wfd, SOL_SOCKET, SO_SNDBUF, &sz, sizeof(sz)); }
+
+        // The dup has the bytes already read too.
+        if (piped) src.commit_read(7);
+        ASSERT_EQ(src.write_to(wfd), expected.size());
+        ASSERT_EQ(src.readable_bytes(), 0);
+        wfd.close();
+
+        buffer received{ 4096 };
+        while (received.read_from(rfd) > 0)
+            ;
+        ASSERT_EQ(received.flattened_view() | rv::transform(byte_to_char) | r::to<::std::string>(), expected);
+    }
+
+    {
+        // `sendfile()` refuses an `O_APPEND` file, and it's not a pipe for `splice()` either.
+        unique_posix_fd out = toolpex_test::open_unlinked_temp_file();
+        ASSERT_EQ(::fcntl(out, F_SETFL, O_APPEND), 0);
+
+        buffer src;
+        src.append("head "s);
+        src.append_file_segment(file, 5000, body.size());
+        ASSERT_EQ(src.write_to(out), 5 + body.size());
+
+        ::std::string written(5 + body.size(), '\0');
+        ASSERT_EQ(::pread(out, written.data(), written.size(), 0), static_cast<ssize_t>(written.size()));
+        ASSERT_EQ(written, "head " + body);
+    }
+
+    {
+        // An empty block in front of a segment doesn't stop the sending.
+        int fds[2];
+        ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+        unique_posix_fd rfd{ fds[0] }, wfd{ fds[1] };
+        buffer src;
+        src.append("header"s);
+        src.writable_span(4096);
+        src.append_file_segment(file, 0, 1000);
+        size_t sent{};
+        for (int i{}; i < 4 && src.readable_bytes(); ++i)
+            sent += src.write_to(wfd);
+        ASSERT_EQ(sent, 6 + 1000);
+        ASSERT_EQ(src.readable_bytes(), 0);
+    }
+
+    {
+        // Readers of a const buffer map the segment concurrently.
+        buffer src;
+        src.append_file_segment(file, 5000, body.size());
+        const buffer& csrc = src;
+        ::std::vector<::std::jthread> threads;
+        for (int i{}; i < 4; ++i)
+            threads.emplace_back([&csrc, &body] { ASSERT_EQ(csrc.find(body.substr(200, 10)), 200); });
+    }
+
+    {
+        // A segment can not be mapped, a pipe for instance.
+        int fds[2];
+        ASSERT_EQ(::pipe(fds), 0);
+        unique_posix_fd rfd{ fds[0] }, wfd{ fds[1] };
+        buffer src;
+        src.append("abc"s);
+        src.append_file_segment(rfd, 0, 100);
+        src.append("xyz"s);
+        ASSERT_THROW(src.find("xyz"), posix_exception);
+        ASSERT_THROW(src.flatten(), posix_exception);
+        ASSERT_THROW(src.compact(4096), posix_exception);
+        ASSERT_THROW(src.as_iovecs(), posix_exception);
+        ASSERT_THROW(src.linearize(5), posix_exception);
+        ASSERT_EQ(src.readable_bytes(), 106);
+        ASSERT_EQ(src.blocks().size(), 3);
+        const auto first = src.linearize(3);
+        ASSERT_EQ(::std::string_view(reinterpret_cast<const char*>(first.data()), first.size()), "abc");
+    }
+
+    // Mutable access copies the segment into memory.
+    auto seg = buffer_block::file_segment(file, 10, 5);
+    ASSERT_TRUE(seg.writable_span().empty());
+    seg.valid_span()[0] = ::std::byte{ '#' };
+    ASSERT_FALSE(seg.is_file_segment());
+    ASSERT_EQ(::std::string_view(reinterpret_cast<const char*>(::std::as_const(seg).valid_span().data()), 5), 
+              "#" + content.substr(11, 4));
+}
@@ -0,0 +1,155 @@
+#include "toolpex/buffer_block_pool.h"
+#include "toolpex/buffer.h"
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <latch>
+#include <memory_resource>
+#include <thread>
+#include <vector>
+
+using namespace toolpex;
+
+namespace
+{
+
+class counting_resource : public ::std::pmr::memory_resource
+{
+public:
+    ::std::atomic_int outstanding{};
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        ++outstanding;
+        return ::std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+        --outstanding;
+        ::std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const ::std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+} // annoymous namespace
+
+TEST(buffer_block_pool, recycle)
+{
+    buffer_block_pool pool;
+    void* p1 = pool.allocate(4096);
+    pool.deallocate(p1, 4096);
+    void* p2 = pool.allocate(4000);
+    ASSERT_EQ(p1, p2) << "same size class should be recycled";
+    pool.deallocate(p2, 4000);
+    ASSERT_EQ(pool.upstream_allocations(), 1);
+
+    void* large = pool.allocate(buffer_block_pool::max_class_size + 1);
+    pool.deallocate(large, buffer_block_pool::max_class_size + 1);
+    ASSERT_EQ(pool.upstream_allocations(), 2);
+}
+
+TEST(buffer_block_pool, steady_state_buffer)
+{
+    buffer_block_pool pool;
+    auto round_trip = [&pool] {
+        buffer b{ 4096, &pool };
+        for (int i{}; i < 16; ++i)
+        {
+            auto sp = b.writable_span(4096);
+            b.commit_write(sp.size());
+        }
+    };
+
+    round_trip();
+    const size_t warmed = pool.upstream_allocations();
+    for (int i{}; i < 100; ++i)
+        round_trip();
+    ASSERT_EQ(pool.upstream_allocations(), warmed);
+}
+
+TEST(buffer_block_pool, cross_thread)
+{
+    buffer_block_pool pool;
+    ::std::vector<void*> ptrs;
+    for (int i{}; i < 1000; ++i)
+        ptrs.push_back(pool.allocate(1024));
+
+    ::std::jthread{ [&] {
+        for (void* p : ptrs) pool.deallocate(p, 1024);
+    }}.join();
+
+    // The exited thread has flushed its cache into the global overflow list.
+    const size_t before = pool.upstream_allocations();
+    for (int i{}; i < 1000; ++i)
+        ptrs[i] = pool.allocate(1024);
+    ASSERT_EQ(pool.upstream_allocations(), before);
+    for (void* p : ptrs) pool.deallocate(p, 1024);
+}
+
+TEST(buffer_block_pool, global_list_is_capped)
+{
+    counting_resource upstream;
+    buffer_block_pool pool{ &upstream };
+    ::std::vector<void*> ptrs;
+    for (int i{}; i < 1000; ++i)
+        ptrs.push_back(pool.allocate(4096));
+
+    // A burst freed by a thread which exits then.
+    ::std::jthread{ [&] {
+        for (void* p : ptrs) pool.deallocate(p, 4096);
+    }}.join();
+    ASSERT_LE(static_cast<size_t>(upstream.outstanding.load()), 
+              buffer_block_pool::global_cache_bytes_per_class / 4096);
+}
+
+TEST(buffer_block_pool, default_for_buffer)
+{
+    buffer b;
+    b.append("hello");
+    ASSERT_EQ(b.total_nbytes_valid(), 5);
+}
+
+TEST(buffer_block_pool, destructed_pool_leaves_no_cache)
+{
+    counting_resource upstream;
+    auto pool = ::std::make_unique<buffer_block_pool>(&upstream);
+    ::std::latch cached{ 1 }, destructed{ 1 }, swept{ 1 }, done{ 1 };
+
+    ::std::jthread worker{ [&] {
+        pool->deallocate(pool->allocate(1024), 1024);
+        cached.count_down();
+        destructed.wait();
+
+        // Touching another pool drops the cache of the destructed one.
+        {
+            buffer_block_pool other{ &upstream };
+            other.deallocate(other.allocate(1024), 1024);
+        }
+        swept.count_down();
+        done.wait();
+    }};
+
+    cached.wait();
+    pool.reset();
+    // Not ASSERT, the worker is still waiting on us.
+    EXPECT_EQ(upstream.outstanding.load(), 1) << "still cached by the worker";
+    destructed.count_down();
+    swept.wait();
+    EXPECT_EQ(upstream.outstanding.load(), 0);
+    done.count_down();
+    worker.join();
+
+    // Short-lived pools on one thread give everything back.
+    for (int i{}; i < 100; ++i)
+    {
+        buffer_block_pool p{ &upstream };
+        p.deallocate(p.allocate(64), 64);
+    }
+    ASSERT_EQ(upstream.outstanding.load(), 0);
+}
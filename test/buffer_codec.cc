@@ -0,0 +1,120 @@
+#include "toolpex/buffer_codec.h"
+#include "gtest/gtest.h"
+
+#include <string>
+#include <string_view>
+#include <ranges>
+
+using namespace toolpex;
+
+namespace
+{
+
+::std::string sample_payload(size_t n)
+{
+    ::std::string result;
+    for (int i{}; result.size() < n; ++i)
+        result += "key=" + ::std::to_string(i % 97) + ";value=" + ::std::to_string(i * i) + "\n";
+    result.resize(n);
+    return result;
+}
+
+void feed(buffer& b, ::std::string_view data, size_t piece)
+{
+    for (size_t i{}; i < data.size(); i += piece)
+        b.append(data.substr(i, piece));
+}
+
+// Streams `data` through `enc` then `dec` in small blocks.
+::std::string round_trip(buffer_codec& enc, buffer_codec& dec, ::std::string_view data)
+{
+    buffer plain{ 100 }, packed{ 64 }, result{ 128 };
+    for (size_t i{}; i < data.size(); i += 1000)
+    {
+        feed(plain, data.substr(i, 1000), 77);
+        run_codec(enc, plain, packed);
+        run_codec(dec, packed, result);
+    }
+    run_codec(enc, plain, packed, true);
+    run_codec(dec, packed, result, true);
+    EXPECT_EQ(plain.readable_bytes(), 0);
+    EXPECT_EQ(packed.readable_bytes(), 0);
+    return buffer_lens<char>(result).flattened_view() | ::std::ranges::to<::std::string>();
+}
+
+} // annoymous namespace
+
+TEST(buffer_codec, noop)
+{
+    const auto data = sample_payload(10000);
+    noop_codec enc, dec;
+    ASSERT_EQ(round_trip(enc, dec, data), data);
+
+    buffer in{ 16 }, out{ 16 };
+    ASSERT_EQ(run_codec(enc, in, out, true), 0);
+    ASSERT_EQ(out.total_nbytes_valid(), 0);
+}
+
+TEST(buffer_codec, bounded_memory)
+{
+    const auto data = sample_payload(100000);
+    noop_codec c;
+    buffer in{ 100 }, out{ 100 };
+    feed(in, data, 100);
+    run_codec(c, in, out, true);
+
+    // Consumed input blocks are released along the way.
+    ASSERT_LE(in.total_nbytes_valid(), 100);
+    ASSERT_EQ(out.total_nbytes_valid(), data.size());
+}
+
+#if defined(TOOLPEX_WITH_LZ4)
+TEST(buffer_codec, lz4)
+{
+    const auto data = sample_payload(300000);
+    lz4_compressor enc;
+    lz4_decompressor dec;
+    ASSERT_EQ(round_trip(enc, dec, data), data);
+
+    enc.reset();
+    dec.reset();
+    ASSERT_EQ(round_trip(enc, dec, data.substr(0, 10)), data.substr(0, 10));
+}
+
+TEST(buffer_codec, lz4_truncated)
+{
+    const auto data = sample_payload(10000);
+    lz4_compressor enc;
+    buffer plain{ 4096 }, packed{ 4096 };
+    plain.append(data);
+    run_codec(enc, plain, packed, true);
+    ASSERT_LT(packed.total_nbytes_valid(), data.size());
+
+    auto cut = packed.slice(0, packed.readable_bytes() - 4);
+    lz4_decompressor dec;
+    buffer result;
+    ASSERT_THROW(run_codec(dec, cut, result, true), ::std::runtime_error);
+}
+#endif
+
+#if defined(TOOLPEX_WITH_ZSTD)
+TEST(buffer_codec, zstd)
+{
+    const auto data = sample_payload(300000);
+    zstd_compressor enc;
+    zstd_decompressor dec;
+    ASSERT_EQ(round_trip(enc, dec, data), data);
+
+    enc.reset();
+    dec.reset();
+    ASSERT_EQ(round_trip(enc, dec, data.substr(0, 10)), data.substr(0, 10));
+}
+
+TEST(buffer_codec, zstd_corrupted)
+{
+    buffer garbage, result;
+    garbage.append(sample_payload(100));
+    zstd_decompressor dec;
+    ASSERT_THROW(run_codec(dec, garbage, result, true), ::std::runtime_error);
+}
+#endif
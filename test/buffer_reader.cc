@@ -0,0 +1,140 @@
+#include "toolpex/buffer_reader.h"
+#include "toolpex/encode.h"
+#include "toolpex/unique_posix_fd.h"
+#include "toolpex/exceptions.h"
+#include "gtest/gtest.h"
+
+#include <string>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+#include <unistd.h>
+
+using namespace toolpex;
+using namespace ::std::string_literals;
+
+namespace
+{
+
+::std::string to_string(::std::span<const ::std::byte> sp)
+{
+    return { reinterpret_cast<const char*>(sp.data()), sp.size() };
+}
+
+} // annoymous namespace
+
+TEST(buffer_reader, read_int_straddles_blocks)
+{
+    buffer b{ 16 };
+    ::std::string frame(14, 'x');
+    append_encode_big_endian_to(uint32_t{ 0xdeadbeef }, frame);
+    append_encode_little_endian_to(uint16_t{ 0x1234 }, frame);
+    b.append(::std::string_view{ frame }.substr(0, 16));
+    b.append(::std::string_view{ frame }.substr(16));
+    ASSERT_EQ(b.blocks().size(), 2);
+
+    buffer_reader r{ b };
+    ASSERT_TRUE(r.skip(14));
+    ASSERT_EQ(r.read_int<uint32_t>(), 0xdeadbeef);
+    ASSERT_EQ((r.read_int<uint16_t, ::std::endian::little>()), 0x1234);
+    ASSERT_FALSE(r.read_int<uint8_t>());
+    ASSERT_EQ(r.remaining(), 0);
+}
+
+TEST(buffer_reader, peek_fast_path)
+{
+    buffer b{ 16 };
+    b.append("hello world"s);
+    buffer_reader r{ b };
+    auto sp = r.peek(5);
+    ASSERT_EQ(sp.data(), b.next_readable_span().data());
+    ASSERT_EQ(to_string(sp), "hello");
+    ASSERT_TRUE(r.peek(100).empty());
+}
+
+TEST(buffer_reader, keeps_blocks_shared)
+{
+    buffer b{ 16 };
+    b.append("hello world, hello reader"s);
+    buffer d = b.dup();
+    ASSERT_TRUE(d.blocks().front().shared());
+    const auto* data_before = ::std::as_const(d.blocks().front()).valid_span().data();
+
+    buffer_reader r{ d };
+    ASSERT_EQ(to_string(r.peek(5)), "hello");
+    ASSERT_EQ(r.find(","), 11);
+    // Straddles the two blocks, copied out.
+    ASSERT_EQ(to_string(r.read(25)), "hello world, hello reader");
+
+    ASSERT_TRUE(d.blocks().front().shared());
+    ASSERT_EQ(::std::as_const(d.blocks().front()).valid_span().data(), data_before);
+}
+
+TEST(buffer_reader, unmappable_file_segment)
+{
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    unique_posix_fd rfd{ fds[0] }, wfd{ fds[1] };
+    buffer b;
+    b.append("abc"s);
+    b.append_file_segment(rfd, 0, 100);
+    b.append("xyz"s);
+
+    buffer_reader r{ b };
+    ASSERT_EQ(to_string(r.peek(3)), "abc");
+    ASSERT_THROW(r.peek(5), posix_exception);
+    ASSERT_TRUE(r.skip(3));
+    ASSERT_THROW(r.read_varint(), posix_exception);
+    ASSERT_EQ(r.remaining(), 103);
+}
+
+TEST(buffer_reader, varint)
+{
+    buffer b{ 16 };
+    // 300 = 0xac 0x02
+    const unsigned char bytes[]{ 0x01, 0xac, 0x02, 0xff };
+    b.append(::std::span<const unsigned char>{ bytes });
+
+    buffer_reader r{ b };
+    ASSERT_EQ(r.read_varint(), 1);
+    ASSERT_EQ(r.read_varint(), 300);
+    ASSERT_FALSE(r.read_varint());
+    ASSERT_EQ(r.remaining(), 1);
+
+    buffer bad{ 4 };
+    bad.append(::std::string(11, '\xff'));
+    buffer_reader rb{ bad };
+    ASSERT_THROW(rb.read_varint(), ::std::runtime_error);
+
+    // UINT64_MAX takes 10 bytes, a 10th byte above 1 overflows.
+    const unsigned char max[]{ 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01 };
+    const unsigned char over[]{ 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x02 };
+    buffer big{ 4 };
+    big.append(::std::span<const unsigned char>{ max });
+    big.append(::std::span<const unsigned char>{ over });
+    buffer_reader rbig{ big };
+    ASSERT_EQ(rbig.read_varint(), UINT64_MAX);
+    ASSERT_THROW(rbig.read_varint(), ::std::runtime_error);
+}
+
+TEST(buffer_reader, read_until_and_commit)
+{
+    buffer b{ 8 };
+    const ::std::string_view req{ "GET / HTTP/1.1\r\nHost: x\r\n\r\npartial" };
+    for (size_t i{}; i < req.size(); i += 5)
+        b.append(req.substr(i, 5));
+    ASSERT_GT(b.blocks().size(), 1);
+
+    buffer_reader r{ b };
+    ASSERT_EQ(r.find("\r\n\r\n"), 23);
+    ASSERT_EQ(to_string(*r.read_until("\r\n")), "GET / HTTP/1.1");
+    ASSERT_EQ(to_string(*r.read_until("\r\n")), "Host: x");
+    ASSERT_EQ(to_string(*r.read_until("\r\n")), "");
+    ASSERT_FALSE(r.read_until("\r\n"));
+    ASSERT_EQ(r.commit(true), 27);
+    ASSERT_EQ(b.readable_bytes(), 7);
+
+    buffer_reader r2{ b };
+    ASSERT_EQ(to_string(r2.read(7)), "partial");
+}
@@ -0,0 +1,108 @@
+#include "toolpex/buffer_streambuf.h"
+#include "gtest/gtest.h"
+
+#include <string>
+#include <format>
+#include <ostream>
+#include <istream>
+#include <algorithm>
+#include <string_view>
+
+using namespace toolpex;
+
+namespace
+{
+
+::std::string readable_string(const buffer& b)
+{
+    ::std::string result;
+    for (auto sp : b.as_iovecs())
+        result.append(static_cast<const char*>(sp.iov_base), sp.iov_len);
+    return result;
+}
+
+} // annoymous namespace
+
+TEST(buffer_streambuf, ostream)
+{
+    buffer b{ 16 };
+    {
+        buffer_streambuf sb{ b };
+        ::std::ostream os{ &sb };
+        os << "answer=" << 42 << ", pi=" << 3.5 << ' ' << ::std::string(40, 'x');
+        os.flush();
+        ASSERT_EQ(b.readable_bytes(), 7 + 2 + 5 + 3 + 1 + 40);
+        os << "!";
+    }
+    ASSERT_EQ(readable_string(b), "answer=42, pi=3.5 " + ::std::string(40, 'x') + "!");
+    ASSERT_GT(b.blocks().size(), 1);
+}
+
+TEST(buffer_streambuf, istream)
+{
+    buffer b{ 8 };
+    b.append(::std::string_view{ "alpha 17 beta 4242" });
+    b.append(::std::string_view{ "0 gamma" });
+
+    buffer_streambuf sb{ b };
+    ::std::istream is{ &sb };
+    ::std::string w1, w2, w3;
+    int i1{}, i2{};
+    is >> w1 >> i1 >> w2 >> i2 >> w3;
+    ASSERT_EQ(w1, "alpha");
+    ASSERT_EQ(i1, 17);
+    ASSERT_EQ(w2, "beta");
+    ASSERT_EQ(i2, 42420);
+    ASSERT_EQ(w3, "gamma");
+    sb.pubsync();
+    ASSERT_EQ(b.readable_bytes(), 0);
+}
+
+TEST(buffer_inserter, copy)
+{
+    buffer b{ 16 };
+    const ::std::string_view text{ "written through an output iterator, across blocks" };
+    auto it = ::std::copy(text.begin(), text.end(), buffer_inserter{ b });
+    // The last span is still pending.
+    ASSERT_LT(b.readable_bytes(), text.size());
+    it.commit();
+    ASSERT_EQ(readable_string(b), text);
+
+    buffer_streambuf sb{ b };
+    auto sit = buffer_inserter{ sb };
+    *sit++ = '!';
+    *sit++ = '?';
+    sb.pubsync();
+    ASSERT_EQ(readable_string(b), ::std::string{ text } + "!?");
+}
+
+TEST(buffer_inserter, small_writes_share_a_block)
+{
+    buffer b{ 4096 };
+    for (int i{}; i < 5; ++i)
+    {
+        const ::std::string_view two{ "ab" };
+        ::std::copy(two.begin(), two.end(), buffer_inserter{ b }).commit();
+    }
+    {
+        buffer_streambuf sb{ b };
+        ::std::ostream os{ &sb };
+        os << 'c';
+    }
+    ASSERT_EQ(b.blocks().size(), 1);
+    ASSERT_EQ(readable_string(b), "abababababc");
+}
+
+TEST(buffer_inserter, format_to)
+{
+    buffer b{ 16 };
+    ::std::format_to(buffer_inserter{ b }, "{}: {}, {}", "key", 42, ::std::string(40, 'v')).commit();
+    ASSERT_EQ(readable_string(b), "key: 42, " + ::std::string(40, 'v'));
+    ASSERT_GT(b.blocks().size(), 2);
+
+    buffer_streambuf sb{ b };
+    for (int i{}; i < 10; ++i)
+        ::std::format_to(buffer_inserter{ sb }, "[{}]", i);
+    sb.pubsync();
+    ASSERT_EQ(readable_string(b), "key: 42, " + ::std::string(40, 'v') + "[0][1][2][3][4][5][6][7][8][9]");
+}
@@ -0,0 +1,97 @@
+#include "toolpex/checksum.h"
+#include "toolpex/unique_posix_fd.h"
+#include "toolpex/exceptions.h"
+#include "temp_file.h"
+#include "gtest/gtest.h"
+
+#include <string>
+#include <string_view>
+
+#include <unistd.h>
+
+using namespace toolpex;
+
+TEST(checksum, crc32c_known_values)
+{
+    ASSERT_EQ(crc32c(::std::string_view{}), 0u);
+    ASSERT_EQ(crc32c("123456789"), 0xe3069283u);
+    ASSERT_EQ(crc32c(::std::string(32, '\0')), 0x8a9136aau);
+}
+
+TEST(checksum, crc32c_streaming)
+{
+    ::std::string data;
+    for (int i{}; i < 1000; ++i) data += ::std::to_string(i * i);
+    const uint32_t whole = crc32c(data);
+    for (size_t cut : { 1ul, 7ul, 8ul, 333ul, data.size() - 1 })
+    {
+        const ::std::string_view sv{ data };
+        ASSERT_EQ(crc32c(sv.substr(cut), crc32c(sv.substr(0, cut))), whole);
+    }
+
+    buffer b{ 100 };
+    for (size_t i{}; i < data.size(); i += 77)
+        b.append(::std::string_view{ data }.substr(i, 77));
+    ASSERT_GT(b.blocks().size(), 1);
+    ASSERT_EQ(crc32c(b), whole);
+}
+
+TEST(checksum, xxh64_known_values)
+{
+    ASSERT_EQ(xxh64(::std::string_view{}), 0xef46db3751d8e999ull);
+    ASSERT_EQ(xxh64("a"), 0xd24ec4f1a98c6e5bull);
+    ASSERT_EQ(xxh64("abc"), 0x44bc2cf5ad770999ull);
+
+    // 32 bytes or longer, through the 4 lane stripes and the merge rounds.
+    constexpr ::std::string_view spam{ "Nobody inspects the spammish repetition" };
+    ASSERT_EQ(xxh64(spam), 0xfbcea83c8a378bf1ull);
+    ASSERT_EQ(xxh64(spam, 20141025), 0xce06936136852706ull);
+    constexpr ::std::string_view fox{ "The quick brown fox jumps over the lazy dog" };
+    ASSERT_EQ(xxh64(fox), 0x0b242d361fda71bcull);
+    ASSERT_EQ(xxh64(fox, 20141025), 0x61068fc2c4569aacull);
+}
+
+TEST(checksum, xxh64_streaming)
+{
+    ::std::string data;
+    for (int i{}; i < 1000; ++i) data += ::std::to_string(i * 7);
+    const uint64_t whole = xxh64(data, 42);
+
+    for (size_t piece : { 1ul, 5ul, 31ul, 32ul, 33ul, 1000ul })
+    {
+        xxhash64 h{ 42 };
+        for (size_t i{}; i < data.size(); i += piece)
+            h.update(::std::string_view{ data }.substr(i, piece));
+        ASSERT_EQ(h.digest(), whole) << piece;
+    }
+
+    buffer b{ 64 };
+    for (size_t i{}; i < data.size(); i += 50)
+        b.append(::std::string_view{ data }.substr(i, 50));
+    ASSERT_EQ(xxhash64{ 42 }.update(b).digest(), whole);
+    ASSERT_NE(xxh64(data, 43), whole);
+}
+
+TEST(checksum, file_segments)
+{
+    ::std::string data;
+    for (int i{}; i < 1000; ++i) data += ::std::to_string(i * 13);
+
+    unique_posix_fd file = toolpex_test::open_unlinked_temp_file();
+    ASSERT_EQ(::write(file, data.data(), data.size()), static_cast<ssize_t>(data.size()));
+
+    buffer b;
+    b.append(::std::string_view{ data }.substr(0, 100));
+    b.append_file_segment(file, 100, data.size() - 100);
+    ASSERT_EQ(crc32c(b), crc32c(data));
+    ASSERT_EQ(xxhash64{ 7 }.update(b).digest(), xxh64(data, 7));
+
+    // Never silently skipped.
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    unique_posix_fd rfd{ fds[0] }, wfd{ fds[1] };
+    b.append_file_segment(rfd, 0, 10);
+    ASSERT_THROW(crc32c(b), posix_exception);
+    xxhash64 h;
+    ASSERT_THROW(h.update(b), posix_exception);
+}
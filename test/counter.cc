@@ -6,6 +6,10 @@
 #include "gtest/gtest.h"
 #include "toolpex/counter.h"
 
+#include <thread>
+#include <atomic>
+#include <vector>
+
 using namespace toolpex;
 
 TEST(counter, approximate_limit_counter)
@@ -27,3 +31,163 @@ TEST(counter, approximate_limit_counter)
     c.reset(100);
     ASSERT_EQ(c.limit(), 100);
 }
+
+TEST(counter, approximate_limit_counter_slots)
+{
+    using counter_t = approximate_limit_counter<>;
+    static_assert(alignof(counter_t::execution_unit_slot) == 64);
+
+    counter_t c{ 1000 };
+    auto h1 = c.get_specific_handler(::std::this_thread::get_id());
+    auto h2 = c.get_specific_handler(::std::this_thread::get_id());
+    ASSERT_NE(h1.slot(), h2.slot());
+
+    ASSERT_TRUE(h1.add_count(10));
+    ASSERT_TRUE(h2.add_count(20));
+    {
+        auto moved = ::std::move(h2);
+        ASSERT_EQ(moved.read_count(), 30);
+    }
+    // The count of a unregistered execution unit goes to the global counter.
+    ASSERT_EQ(h1.read_count(), 30);
+}
+
+TEST(counter, approximate_limit_counter_concurrent)
+{
+    constexpr int nthreads = 4;
+    constexpr int per_thread = 10000;
+    approximate_limit_counter c{ nthreads * per_thread };
+
+    // Reserves stranded in the other threads could fail a add before the limit reached,
+    // but the counter never loses a successful add, nor exceeds the limit.
+    ::std::atomic_size_t succeeded{};
+    ::std::vector<::std::jthread> threads;
+    for (int t{}; t < nthreads; ++t)
+    {
+        threads.emplace_back([&c, &succeeded] {
+            auto h = c.get_specific_handler(::std::this_thread::get_id());
+            for (int i{}; i < per_thread; ++i)
+                if (h.add_count(1)) succeeded.fetch_add(1, ::std::memory_order_relaxed);
+        });
+    }
+    threads.clear();
+
+    auto h = c.get_specific_handler(::std::this_thread::get_id());
+    ASSERT_EQ(h.read_count(), succeeded.load());
+    ASSERT_LE(h.read_count(), c.limit());
+    ASSERT_TRUE(h.sub_count(1));
+    ASSERT_EQ(h.read_count(), succeeded.load() - 1);
+}
+
+TEST(counter, statistical_counter)
+{
+    statistical_counter c;
+    {
+        auto h = c.get_specific_handler(::std::this_thread::get_id());
+        static_assert(sizeof(*h.slot()) == 64);
+        h.inc();
+        h.add_count(9);
+        h.sub_count(2);
+        ASSERT_EQ(h.read_count(), 8);
+    }
+    // Kept after unregistered.
+    ASSERT_EQ(c.read(), 8);
+
+    constexpr int nthreads = 4;
+    constexpr int per_thread = 10000;
+    ::std::vector<::std::jthread> threads;
+    for (int t{}; t < nthreads; ++t)
+    {
+        threads.emplace_back([&c] {
+            auto h = c.get_specific_handler(::std::this_thread::get_id());
+            for (int i{}; i < per_thread; ++i)
+                h.inc();
+        });
+    }
+    threads.clear();
+    ASSERT_EQ(c.read(), 8 + nthreads * per_thread);
+}
+
+TEST(counter, eventually_consistent_counter)
+{
+    eventually_consistent_counter c{ ::std::chrono::microseconds{ 100 } };
+    auto h = c.get_specific_handler(::std::this_thread::get_id());
+    h.add_count(5);
+    c.flush();
+    ASSERT_EQ(c.read(), 5);
+
+    constexpr int nthreads = 4;
+    constexpr int per_thread = 10000;
+    ::std::vector<::std::jthread> threads;
+    for (int t{}; t < nthreads; ++t)
+    {
+        threads.emplace_back([&c] {
+            auto h = c.get_specific_handler(::std::this_thread::get_id());
+            for (int i{}; i < per_thread; ++i)
+                h.inc();
+        });
+    }
+    threads.clear();
+
+    // The aggregator catches up eventually.
+    const auto expected = 5 + nthreads * per_thread;
+    for (int i{}; i < 1000 && c.read() != expected; ++i)
+        ::std::this_thread::sleep_for(::std::chrono::milliseconds{ 1 });
+    ASSERT_EQ(c.read(), expected);
+}
+
+TEST(counter, exact_limit_counter)
+{
+    exact_limit_counter c{ 1000 };
+    auto h = c.get_specific_handler(::std::this_thread::get_id());
+    static_assert(sizeof(*h.slot()) == 64);
+
+    ASSERT_TRUE(h.add_count(8));
+    ASSERT_TRUE(h.add_count(1));
+    ASSERT_EQ(h.read_count(), 9);
+    ASSERT_FALSE(h.add_count(10000));
+    ASSERT_FALSE(h.sub_count(10));
+    ASSERT_TRUE(h.sub_count(9));
+    ASSERT_EQ(h.read_count(), 0);
+
+    // Another execution unit holds a reserve, but the limit is still reachable exactly.
+    auto h2 = c.get_specific_handler(::std::this_thread::get_id());
+    ASSERT_TRUE(h2.add_count(1));
+    ASSERT_TRUE(h.add_count(999));
+    ASSERT_FALSE(h.add_count(1));
+    ASSERT_FALSE(h2.add_count(1));
+    ASSERT_EQ(h.read_count(), 1000);
+
+    c.reset(100);
+    ASSERT_EQ(h.read_count(), 0);
+    ASSERT_EQ(c.limit(), 100);
+}
+
+TEST(counter, exact_limit_counter_concurrent)
+{
+    constexpr int nthreads = 4;
+    constexpr int per_thread = 10000;
+    constexpr size_t limit = nthreads * per_thread / 2;
+    exact_limit_counter c{ limit };
+
+    ::std::atomic_size_t succeeded{};
+    ::std::vector<::std::jthread> threads;
+    for (int t{}; t < nthreads; ++t)
+    {
+        threads.emplace_back([&c, &succeeded] {
+            auto h = c.get_specific_handler(::std::this_thread::get_id());
+            for (int i{}; i < per_thread; ++i)
+            {
+                if (h.add_count(1)) succeeded.fetch_add(1, ::std::memory_order_relaxed);
+                if (i % 3 == 1 && h.sub_count(1)) succeeded.fetch_sub(1, ::std::memory_order_relaxed);
+            }
+        });
+    }
+    threads.clear();
+
+    // Half of the adds are over the limit, still the limit is reached exactly.
+    auto h = c.get_specific_handler(::std::this_thread::get_id());
+    ASSERT_EQ(succeeded.load(), limit);
+    ASSERT_EQ(h.read_count(), limit);
+    ASSERT_FALSE(h.add_count(1));
+}
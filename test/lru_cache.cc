@@ -5,8 +5,49 @@
 
 #include "gtest/gtest.h"
 #include "toolpex/lru_cache.h"
+#include "toolpex/lru_cache_persistence.h"
+#include "temp_file.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+
+#include <unistd.h>
 
 using namespace toolpex;
+using toolpex_test::make_temp_file;
+
+namespace
+{
+
+struct fragile
+{
+    int v;
+};
+
+} // annoymous namespace
+
+// Can't encode negative values.
+template<>
+struct toolpex::cache_serializer<fragile> : toolpex::cache_serializer<int>
+{
+    static size_t encoded_size(const fragile& f)
+    {
+        if (f.v < 0) throw ::std::runtime_error{ "can not encode" };
+        return sizeof(int);
+    }
+
+    static void encode_to(const fragile& f, ::std::span<::std::byte> dst) noexcept
+    {
+        cache_serializer<int>::encode_to(f.v, dst);
+    }
+
+    static fragile decode_from(::std::span<const ::std::byte> src)
+    {
+        return { cache_serializer<int>::decode_from(src) };
+    }
+};
 
 TEST(lru_cache_test, basic_functionality)
 {
@@ -72,3 +113,201 @@ TEST(lru_cache_test, clear)
     cache.clear();
     ASSERT_EQ(cache.size(), 0);
 }
+
+TEST(lru_cache_test, pop_least_recently_used)
+{
+    lru_cache<int, int> cache(3);
+    ASSERT_FALSE(cache.pop_least_recently_used().has_value());
+
+    cache.put(1, 10);
+    cache.put(2, 20);
+    cache.put(3, 30);
+    ASSERT_TRUE(cache.full());
+    (void)cache.get(1);
+
+    auto victim = cache.pop_least_recently_used();
+    ASSERT_TRUE(victim.has_value());
+    ASSERT_EQ(victim->first, 2);
+    ASSERT_EQ(victim->second, 20);
+    ASSERT_EQ(cache.size(), 2);
+    ASSERT_FALSE(cache.contains(2));
+    ASSERT_FALSE(cache.full());
+
+    ASSERT_EQ(cache.least_recently_used()->first, 3);
+    lru_cache<int, int, ::std::hash<int>, ::std::equal_to<int>, lru_cache_stats> counted(1);
+    counted.put(1, 10);
+    ASSERT_TRUE(counted.pop_least_recently_used());
+    ASSERT_EQ(counted.stats().evictions(), 1);
+    ASSERT_EQ(counted.least_recently_used(), nullptr);
+}
+
+TEST(lru_cache_test, stats)
+{
+    lru_cache<int, int, ::std::hash<int>, ::std::equal_to<int>, lru_cache_stats> cache(2);
+    cache.put(1, 10);
+    cache.put(2, 20);
+    cache.put(2, 21);
+    (void)cache.get(1);
+    (void)cache.get(3);
+    cache.put(3, 30);
+
+    const auto& s = cache.stats();
+    ASSERT_EQ(s.hits(), 1);
+    ASSERT_EQ(s.misses(), 1);
+    ASSERT_EQ(s.inserts(), 3);
+    ASSERT_EQ(s.evictions(), 1);
+    ASSERT_DOUBLE_EQ(s.hit_ratio(), 0.5);
+
+    cache.stats().reset();
+    ASSERT_EQ(cache.stats().hits(), 0);
+}
+
+TEST(lru_cache_test, eviction_listener)
+{
+    ::std::vector<::std::pair<int, ::std::string>> evicted;
+    lru_cache<int, ::std::string> cache(2, [&evicted](int&& k, ::std::string&& v) { 
+        evicted.emplace_back(k, ::std::move(v)); 
+    });
+
+    cache.put(1, "one");
+    cache.put(2, "two");
+    ASSERT_TRUE(evicted.empty());
+    cache.put(3, "three");
+    ASSERT_EQ(evicted.size(), 1);
+    ASSERT_EQ(evicted[0].first, 1);
+    ASSERT_EQ(evicted[0].second, "one");
+
+    auto old = cache.set_eviction_listener({});
+    ASSERT_TRUE(!!old);
+    cache.put(4, "four");
+    ASSERT_EQ(evicted.size(), 1);
+    ASSERT_EQ(cache.size(), 2);
+}
+
+TEST(lru_cache_test, listener_on_clear_and_assign)
+{
+    ::std::vector<::std::pair<int, ::std::string>> discarded;
+    lru_cache<int, ::std::string> cache(3, [&discarded, &cache](int&& k, ::std::string&& v) { 
+        ASSERT_FALSE(cache.contains(k));
+        discarded.emplace_back(k, ::std::move(v)); 
+    });
+
+    cache.put(1, "one");
+    cache.put(2, "two");
+    cache.clear();
+    ASSERT_EQ(cache.size(), 0);
+    ASSERT_EQ(discarded, (::std::vector<::std::pair<int, ::std::string>>{ { 2, "two" }, { 1, "one" } }));
+
+    discarded.clear();
+    cache.put(3, "three");
+    cache.assign({ { 4, "four" }, { 5, "five" } });
+    ASSERT_EQ(discarded, (::std::vector<::std::pair<int, ::std::string>>{ { 3, "three" } }));
+    ASSERT_EQ(cache.size(), 2);
+}
+
+TEST(lru_cache_test, save_load)
+{
+    const auto p = make_temp_file();
+
+    lru_cache<int, ::std::string> cache(3);
+    cache.put(1, "one");
+    cache.put(2, "two");
+    cache.put(3, "three");
+    (void)cache.get(1);
+    save(cache, p);
+
+    lru_cache<int, ::std::string> loaded(2);
+    ASSERT_EQ(load(loaded, p), 2);
+    ASSERT_EQ(loaded.get(1).value(), "one");
+    ASSERT_EQ(loaded.get(3).value(), "three");
+    ASSERT_FALSE(loaded.contains(2));
+
+    lru_cache<int, ::std::string> same_capa(3);
+    ASSERT_EQ(load(same_capa, p), 3);
+    same_capa.put(4, "four");
+    ASSERT_FALSE(same_capa.contains(2));
+
+    ASSERT_EQ(load_keys<int>(p), (::std::vector<int>{ 1, 3, 2 }));
+    ::std::filesystem::remove(p);
+}
+
+TEST(lru_cache_test, save_keys_only)
+{
+    const auto p = make_temp_file();
+
+    lru_cache<::std::string, ::std::string> cache(3);
+    cache.put("a", "1");
+    cache.put("b", "2");
+    save(cache, p, true);
+
+    ASSERT_EQ(load_keys<::std::string>(p), (::std::vector<::std::string>{ "b", "a" }));
+    EXPECT_THROW(load(cache, p), ::std::runtime_error);
+    ::std::filesystem::remove(p);
+}
+
+TEST(lru_cache_test, load_corrupted)
+{
+    const auto p = make_temp_file();
+    lru_cache<int, ::std::string> cache(3);
+    cache.put(1, "one");
+    cache.put(2, "two");
+    save(cache, p);
+
+    ::std::string content;
+    {
+        ::std::ifstream ifs{ p, ::std::ios::binary };
+        content.assign(::std::istreambuf_iterator<char>{ ifs }, {});
+    }
+    auto rewrite = [&p](const ::std::string& bytes) {
+        ::std::ofstream ofs{ p, ::std::ios::binary | ::std::ios::trunc };
+        ofs.write(bytes.data(), bytes.size());
+    };
+
+    // Truncated in the middle of a record.
+    rewrite(content.substr(0, content.size() - 2));
+    cache.put(3, "three");
+    EXPECT_THROW(load(cache, p), ::std::runtime_error);
+    // Left untouched.
+    EXPECT_EQ(cache.size(), 3);
+    EXPECT_EQ(cache.get(3).value(), "three");
+
+    // Saving replaces the file as a whole, nothing left next to it.
+    save(cache, p);
+    EXPECT_FALSE(::std::filesystem::exists(p.string() + ".saving"));
+    EXPECT_EQ(load(cache, p), 3);
+
+    // The size of the first key says 2 bytes, an `int` needs 4.
+    auto corrupted = content;
+    corrupted[16 + 3] = 2;
+    rewrite(corrupted);
+    EXPECT_THROW(load(cache, p), ::std::runtime_error);
+    EXPECT_THROW(load_keys<int>(p), ::std::runtime_error);
+
+    // A huge count with few records.
+    corrupted = content;
+    corrupted[8] = '\x7f';
+    rewrite(corrupted);
+    EXPECT_THROW(load_keys<int>(p), ::std::runtime_error);
+
+    ::std::filesystem::remove(p);
+}
+
+TEST(lru_cache_test, failed_save)
+{
+    const auto p = make_temp_file();
+    lru_cache<int, fragile> cache(3);
+    cache.put(1, fragile{ 1 });
+    save(cache, p);
+
+    cache.put(2, fragile{ -1 });
+    EXPECT_THROW(save(cache, p), ::std::runtime_error);
+    EXPECT_FALSE(::std::filesystem::exists(p.string() + ".saving"));
+
+    // The previous snapshot is intact.
+    lru_cache<int, fragile> loaded(3);
+    EXPECT_EQ(load(loaded, p), 1);
+    EXPECT_EQ(loaded.get(1).value().v, 1);
+
+    EXPECT_THROW(save(cache, "/nonexistent_toolpex_dir/snapshot"), posix_exception);
+    ::std::filesystem::remove(p);
+}
@@ -0,0 +1,92 @@
+#include "toolpex/mmap_resource.h"
+#include "toolpex/buffer_block_pool.h"
+#include "temp_file.h"
+#include "gtest/gtest.h"
+
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include <filesystem>
+
+#include <unistd.h>
+
+using namespace toolpex;
+
+TEST(mmap_resource, huge_allocation)
+{
+    mmap_resource res;
+    const size_t sz = 3 * mmap_resource::huge_page_size + 100;
+    auto* p = static_cast<char*>(res.allocate(sz));
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(p) % mmap_resource::huge_page_size, 0);
+    ASSERT_EQ(res.mapped_bytes(), 4 * mmap_resource::huge_page_size);
+    p[0] = 'a';
+    p[sz - 1] = 'z';
+    res.deallocate(p, sz);
+    ASSERT_EQ(res.mapped_bytes(), 0);
+}
+
+TEST(mmap_resource, small_goes_upstream)
+{
+    mmap_resource res;
+    void* p = res.allocate(128);
+    ASSERT_EQ(res.mapped_bytes(), 0);
+    res.deallocate(p, 128);
+}
+
+TEST(mmap_resource, as_buffer_resource)
+{
+    mmap_resource res{ false };
+    {
+        buffer b{ 1024 * 1024, &res };
+        b.append(::std::string(3 * 1024 * 1024, 'x'));
+        ASSERT_GE(res.mapped_bytes(), 3 * 1024 * 1024);
+        ASSERT_EQ(b.readable_bytes(), 3 * 1024 * 1024);
+    }
+    ASSERT_EQ(res.mapped_bytes(), 0);
+}
+
+TEST(mmap_resource, mapped_file_buffer)
+{
+    const auto path = toolpex_test::make_temp_file();
+    ::std::string content;
+    for (int i{}; i < 5000; ++i) content += ::std::to_string(i) + "\n";
+    content += "tail-marker";
+    {
+        ::std::ofstream ofs{ path, ::std::ios::binary };
+        ofs << content;
+    }
+
+    {
+        buffer b = mapped_file_buffer(path, 4096);
+        ASSERT_EQ(b.readable_bytes(), content.size());
+        ASSERT_GT(b.blocks().size(), 1);
+        ASSERT_EQ(b.find("tail-marker"), content.size() - 11);
+        ASSERT_EQ(b.find("4095\n4096"), content.find("4095\n4096"));
+
+        // Appending never touches the mapping.
+        b.append(::std::string_view{ "!" });
+        ASSERT_EQ(b.readable_bytes(), content.size() + 1);
+    }
+
+    {
+        // Released mapped blocks are never recycled for writing.
+        buffer b = mapped_file_buffer(path, 4096);
+        while (b.commit_remove_after_read(b.next_readable_span().size()) && b.readable_bytes());
+        b.append(::std::string(10000, 'x'));
+        ASSERT_EQ(b.readable_bytes(), 10000);
+    }
+
+    {
+        // Mutable access copies a shared mapped block, instead of allocating from the mapping.
+        const buffer b = mapped_file_buffer(path, 4096);
+        ASSERT_EQ(b.blocks().front().left(), 0);
+        auto blk = b.blocks().front().share(0, 4);
+        blk.valid_span()[0] = ::std::byte{ '#' };
+        ASSERT_EQ(::std::as_const(blk).valid_span()[0], ::std::byte{ '#' });
+        ASSERT_EQ(blk.resource(), &buffer_block_pool::default_pool());
+        ASSERT_EQ(b.find("0\n1\n"), 0);
+    }
+
+    ::std::filesystem::remove(path);
+    ASSERT_THROW(mapped_file_buffer(path), ::std::system_error);
+}
@@ -0,0 +1,109 @@
+#include "gtest/gtest.h"
+#include "toolpex/page_pool.h"
+
+#include <set>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+#include <unistd.h>
+
+using namespace toolpex;
+
+namespace
+{
+    const size_t sys_page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+}
+
+TEST(page_pool, acquire_and_return)
+{
+    page_pool pool{ sys_page_size, 4 };
+    ASSERT_EQ(pool.capacity(), 4);
+    ASSERT_EQ(pool.available(), 4);
+
+    ::std::set<const void*> seen;
+    {
+        ::std::vector<page_pool::page_type> pages;
+        for (size_t i{}; i < 4; ++i)
+        {
+            auto& p = pages.emplace_back(pool.acquire());
+            ASSERT_EQ(p.capacity(), sys_page_size);
+            const void* addr = p.next_writable().data();
+            ASSERT_EQ(reinterpret_cast<uintptr_t>(addr) % sys_page_size, 0);
+            ASSERT_TRUE(pool.owns(addr));
+            seen.insert(addr);
+        }
+        ASSERT_EQ(seen.size(), 4);
+        ASSERT_EQ(pool.in_use(), 4);
+        ASSERT_THROW(pool.acquire(), ::std::bad_alloc);
+        ASSERT_FALSE(pool.try_acquire());
+
+        pages.pop_back();
+        ASSERT_EQ(pool.available(), 1);
+        auto again = pool.try_acquire();
+        ASSERT_TRUE(again);
+        ASSERT_TRUE(seen.contains(again->next_writable().data()));
+    }
+    ASSERT_EQ(pool.in_use(), 0);
+    ASSERT_EQ(pool.peak_in_use(), 4);
+}
+
+TEST(page_pool, page_semantics)
+{
+    page_pool pool{ sys_page_size * 2, 2 };
+    auto p = pool.acquire();
+    auto sp = p.next_writable();
+    ASSERT_EQ(sp.size(), sys_page_size * 2);
+    sp[0] = ::std::byte{ 42 };
+    p.commit_write(1);
+    ASSERT_EQ(p.readable().size(), 1);
+
+    page_pool::page_type moved{ ::std::move(p) };
+    ASSERT_EQ(pool.in_use(), 1);
+    ASSERT_EQ(moved.readable()[0], ::std::byte{ 42 });
+    moved.release();
+    ASSERT_EQ(pool.in_use(), 0);
+}
+
+TEST(page_pool, bad_arguments)
+{
+    ASSERT_THROW(page_pool(100, 1), ::std::invalid_argument);
+    ASSERT_THROW(page_pool(sys_page_size, 0), ::std::invalid_argument);
+
+    page_pool pool{ sys_page_size, 1 };
+    page_pool_allocator alloc{ &pool };
+    ASSERT_THROW(alloc.allocate(1), ::std::invalid_argument);
+}
+
+TEST(page_pool, mlocked)
+{
+    try
+    {
+        page_pool pool{ sys_page_size, 2, true };
+        ASSERT_TRUE(pool.locked());
+        auto p = pool.acquire();
+    }
+    catch (const ::std::system_error&)
+    {
+        GTEST_SKIP() << "mlock is not permitted here";
+    }
+}
+
+TEST(page_pool, concurrent_churn)
+{
+    page_pool pool{ sys_page_size, 8 };
+    ::std::vector<::std::jthread> threads;
+    for (int t{}; t < 4; ++t)
+    {
+        threads.emplace_back([&pool] {
+            for (int i{}; i < 10000; ++i)
+            {
+                auto p = pool.try_acquire();
+                if (p) p->commit_write(1);
+            }
+        });
+    }
+    threads.clear();
+    ASSERT_EQ(pool.in_use(), 0);
+    ASSERT_LE(pool.peak_in_use(), 8);
+}
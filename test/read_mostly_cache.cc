@@ -0,0 +1,91 @@
+// This file is part of Toolpex
+// https://github.com/JPewterschmidt/toolpex
+//
+// Copyleft 2023 - 2024, ShiXin Wang. All wrongs reserved.
+
+#include "gtest/gtest.h"
+#include "toolpex/read_mostly_cache.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace toolpex;
+
+TEST(read_mostly_cache, basic)
+{
+    read_mostly_cache<int, ::std::string> cache(4);
+    ASSERT_EQ(cache.capacity(), 4);
+
+    cache.put(1, "one");
+    cache.put(2, "two");
+    ASSERT_EQ(cache.get(1).value(), "one");
+    ASSERT_EQ(cache.get(2).value(), "two");
+    ASSERT_FALSE(cache.get(3).has_value());
+
+    cache.put(1, "uno");
+    ASSERT_EQ(cache.get(1).value(), "uno");
+    ASSERT_EQ(cache.size(), 2);
+
+    ASSERT_TRUE(cache.erase(1));
+    ASSERT_FALSE(cache.erase(1));
+    ASSERT_FALSE(cache.contains(1));
+    ASSERT_EQ(cache.size(), 1);
+
+    cache.clear();
+    ASSERT_EQ(cache.size(), 0);
+    ASSERT_FALSE(cache.contains(2));
+}
+
+TEST(read_mostly_cache, eviction)
+{
+    read_mostly_cache<int, int> cache(4);
+    for (int i{}; i < 4; ++i)
+        cache.put(i, i * 2);
+
+    // Updating advances the clock, then 0..2 are touched, 3 becomes the oldest.
+    cache.put(0, 0);
+    for (int i{1}; i < 3; ++i)
+        ASSERT_EQ(cache.get(i).value(), i * 2);
+
+    cache.put(4, 8);
+    ASSERT_EQ(cache.size(), 4);
+    ASSERT_FALSE(cache.contains(3));
+    for (int i{}; i < 3; ++i)
+        ASSERT_TRUE(cache.contains(i));
+    ASSERT_TRUE(cache.contains(4));
+}
+
+TEST(read_mostly_cache, concurrent_read_write)
+{
+    read_mostly_cache<int, ::std::string> cache(64);
+    ::std::atomic_bool stop{};
+    ::std::atomic_bool broken{};
+
+    {
+        ::std::vector<::std::jthread> readers;
+        for (int t{}; t < 4; ++t)
+        {
+            readers.emplace_back([&] {
+                while (!stop.load())
+                {
+                    for (int k{}; k < 128; ++k)
+                    {
+                        auto v = cache.get(k);
+                        if (v && *v != ::std::to_string(k))
+                            broken = true;
+                    }
+                }
+            });
+        }
+
+        for (int round{}; round < 200; ++round)
+            for (int k{}; k < 128; ++k)
+                cache.put(k, ::std::to_string(k));
+        stop = true;
+    }
+
+    ASSERT_FALSE(broken.load());
+    ASSERT_EQ(cache.size(), 64);
+}
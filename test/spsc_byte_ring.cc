@@ -0,0 +1,144 @@
+#include "toolpex/spsc_byte_ring.h"
+#include "gtest/gtest.h"
+
+#include <array>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+using namespace toolpex;
+
+namespace
+{
+
+::std::span<const ::std::byte> bytes_of(const char* s, size_t n)
+{
+    return { reinterpret_cast<const ::std::byte*>(s), n };
+}
+
+} // annoymous namespace
+
+TEST(spsc_byte_ring, basic)
+{
+    spsc_byte_ring r{ 100 };
+    ASSERT_EQ(r.capacity(), 128);
+    ASSERT_TRUE(r.empty());
+    ASSERT_TRUE(r.next_readable_span().empty());
+
+    auto ws = r.writable_span();
+    ASSERT_EQ(ws.size(), 128);
+    ws[0] = ::std::byte{ 'a' };
+    ASSERT_TRUE(r.commit_write(1));
+    ASSERT_FALSE(r.commit_write(1000));
+    ASSERT_EQ(r.readable_bytes(), 1);
+
+    auto rs = r.next_readable_span();
+    ASSERT_EQ(rs.size(), 1);
+    ASSERT_EQ(rs[0], ::std::byte{ 'a' });
+    ASSERT_TRUE(r.commit_read(1));
+    ASSERT_FALSE(r.commit_read(1));
+    ASSERT_TRUE(r.empty());
+}
+
+TEST(spsc_byte_ring, wraparound)
+{
+    for (bool double_mapped : { false, true })
+    {
+        spsc_byte_ring r{ 4096, double_mapped };
+        ::std::vector<char> junk(4000, 'j');
+        ASSERT_EQ(r.write(bytes_of(junk.data(), junk.size())), 4000);
+        ::std::vector<::std::byte> sink(4000);
+        ASSERT_EQ(r.read(sink), 4000);
+
+        // Crosses the end of the storage.
+        const ::std::string msg(200, 'm');
+        ASSERT_EQ(r.write(bytes_of(msg.data(), msg.size())), 200);
+        const auto rs = r.next_readable_span();
+        if (r.double_mapped())
+        {
+            ASSERT_EQ(rs.size(), 200);
+            ASSERT_TRUE(::std::ranges::all_of(rs, [](auto b) { return b == ::std::byte{ 'm' }; }));
+        }
+        else ASSERT_EQ(rs.size(), 96);
+
+        ASSERT_EQ(r.read(sink), 200);
+        ASSERT_TRUE(r.empty());
+    }
+}
+
+TEST(spsc_byte_ring, full)
+{
+    spsc_byte_ring r{ 64 };
+    const ::std::string msg(100, 'x');
+    ASSERT_EQ(r.write(bytes_of(msg.data(), msg.size())), 64);
+    ASSERT_TRUE(r.writable_span().empty());
+    ASSERT_EQ(r.write(bytes_of(msg.data(), msg.size())), 0);
+}
+
+TEST(spsc_byte_ring, partial_produce_and_consume)
+{
+    spsc_byte_ring r{ 64 };
+    ::std::array<::std::byte, 64> chunk{};
+    const auto first = [&chunk](size_t n) { return ::std::span{ chunk }.first(n); };
+
+    ASSERT_EQ(r.write(chunk), 64);
+    ASSERT_EQ(r.read(first(10)), 10);
+    ASSERT_EQ(r.write(first(6)), 6);
+    ASSERT_EQ(r.read(first(50)), 50);
+    // The producer sees all the space freed since it last looked.
+    ASSERT_EQ(r.writable_span().size(), 54);
+    ASSERT_EQ(r.read(chunk), 10);
+    ASSERT_TRUE(r.empty());
+
+    spsc_byte_ring r2{ 64 };
+    ASSERT_EQ(r2.write(first(10)), 10);
+    ASSERT_EQ(r2.next_readable_span().size(), 10);
+    ASSERT_EQ(r2.write(first(20)), 20);
+    ASSERT_TRUE(r2.commit_read(4));
+    // So as the consumer.
+    ASSERT_EQ(r2.next_readable_span().size(), 26);
+    ASSERT_EQ(r2.readable_bytes(), 26);
+}
+
+TEST(spsc_byte_ring, two_threads)
+{
+    spsc_byte_ring r{ 4096, true };
+    constexpr size_t total = 8 * 1024 * 1024;
+
+    ::std::jthread producer{ [&r] {
+        size_t sent{};
+        while (sent < total)
+        {
+            auto ws = r.writable_span();
+            if (ws.empty()) 
+            {
+                ::std::this_thread::yield();
+                continue;
+            }
+            const size_t n = ::std::min(ws.size(), total - sent);
+            for (size_t i{}; i < n; ++i)
+                ws[i] = static_cast<::std::byte>((sent + i) * 31);
+            r.commit_write(n);
+            sent += n;
+        }
+    }};
+
+    size_t received{};
+    bool ok{ true };
+    while (received < total)
+    {
+        auto rs = r.next_readable_span();
+        if (rs.empty())
+        {
+            ::std::this_thread::yield();
+            continue;
+        }
+        for (size_t i{}; i < rs.size(); ++i)
+            ok &= rs[i] == static_cast<::std::byte>((received + i) * 31);
+        r.commit_read(rs.size());
+        received += rs.size();
+    }
+    ASSERT_TRUE(ok);
+    ASSERT_EQ(received, total);
+}
@@ -0,0 +1,43 @@
+// This file is part of Toolpex
+// https://github.com/JPewterschmidt/toolpex
+//
+// Copyleft 2023 - 2024, ShiXin Wang. All wrongs reserved.
+
+#ifndef TOOLPEX_TEST_TEMP_FILE_H
+#define TOOLPEX_TEST_TEMP_FILE_H
+
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+
+#include <unistd.h>
+
+#include "toolpex/unique_posix_fd.h"
+
+namespace toolpex_test
+{
+
+/// @brief  Create an empty file unique per run, so parallel runs don't collide.
+/// @param  prefix  A random suffix is appended to it.
+inline ::std::filesystem::path make_temp_file(::std::string prefix = "/tmp/toolpex_test")
+{
+    prefix += "_XXXXXX";
+    const int fd = ::mkstemp(prefix.data());
+    if (fd < 0) throw ::std::runtime_error{ "mkstemp failed" };
+    ::close(fd);
+    return prefix;
+}
+
+/// @brief  Like `make_temp_file()`, but unlinked at once, the file lives as long as the fd.
+inline ::toolpex::unique_posix_fd open_unlinked_temp_file(::std::string prefix = "/tmp/toolpex_test")
+{
+    prefix += "_XXXXXX";
+    ::toolpex::unique_posix_fd fd{ ::mkstemp(prefix.data()) };
+    if (!fd.valid()) throw ::std::runtime_error{ "mkstemp failed" };
+    ::unlink(prefix.c_str());
+    return fd;
+}
+
+} // namespace toolpex_test
+
+#endif
@@ -0,0 +1,175 @@
+// This file is part of Toolpex
+// https://github.com/JPewterschmidt/toolpex
+//
+// Copyleft 2023 - 2024, ShiXin Wang. All wrongs reserved.
+
+#include "gtest/gtest.h"
+#include "toolpex/tiered_cache.h"
+#include "temp_file.h"
+
+#include <filesystem>
+#include <string>
+#include <stdexcept>
+
+#include <unistd.h>
+
+using namespace toolpex;
+using toolpex_test::make_temp_file;
+using namespace ::std::string_literals;
+
+TEST(file_cache_tier, put_get)
+{
+    file_cache_tier<int, ::std::string> tier{ make_temp_file(), 4096 };
+    ASSERT_TRUE(tier.put(1, "hello"s));
+    ASSERT_TRUE(tier.put(2, "world"s));
+    ASSERT_EQ(tier.size(), 2);
+
+    ASSERT_EQ(tier.get(1).value(), "hello");
+    ASSERT_EQ(tier.get(2).value(), "world");
+    ASSERT_FALSE(tier.get(3).has_value());
+    ASSERT_EQ(tier.stats().hits, 2);
+    ASSERT_EQ(tier.stats().misses, 1);
+
+    ASSERT_EQ(tier.take(1).value(), "hello");
+    ASSERT_FALSE(tier.contains(1));
+    ASSERT_GT(tier.garbage_bytes(), 0);
+}
+
+TEST(file_cache_tier, compaction)
+{
+    const size_t record_size = file_cache_tier<int, int>::record_header_size + 2 * sizeof(int);
+    file_cache_tier<int, int> tier{ make_temp_file(), record_size * 4 };
+    for (int i{}; i < 4; ++i)
+        ASSERT_TRUE(tier.put(i, i * 2));
+
+    // Enough garbage already, nothing evicted.
+    tier.erase(0);
+    tier.erase(1);
+    ASSERT_TRUE(tier.put(4, 8));
+    ASSERT_EQ(tier.garbage_bytes(), 0);
+    ASSERT_EQ(tier.file_size(), record_size * 3);
+    ASSERT_EQ(tier.stats().evictions, 0);
+
+    for (int i{2}; i < 5; ++i)
+        ASSERT_EQ(tier.get(i).value(), i * 2);
+}
+
+TEST(file_cache_tier, evicts_oldest)
+{
+    const size_t record_size = file_cache_tier<int, int>::record_header_size + 2 * sizeof(int);
+    file_cache_tier<int, int> tier{ make_temp_file(), record_size * 4 };
+    for (int i{}; i < 4; ++i)
+        ASSERT_TRUE(tier.put(i, i * 2));
+
+    // A little garbage is not worth a compaction on its own, 
+    // the oldest records go until half of the file is reclaimable.
+    tier.erase(3);
+    ASSERT_TRUE(tier.put(4, 8));
+    ASSERT_EQ(tier.stats().evictions, 1);
+    ASSERT_FALSE(tier.contains(0));
+    ASSERT_EQ(tier.file_size(), record_size * 3);
+    for (int i : { 1, 2, 4 })
+        ASSERT_EQ(tier.get(i).value(), i * 2);
+
+    // No garbage at all, still room for the new one.
+    ASSERT_TRUE(tier.put(5, 10));
+    ASSERT_TRUE(tier.put(6, 12));
+    ASSERT_FALSE(tier.contains(1));
+    ASSERT_FALSE(tier.contains(2));
+    ASSERT_EQ(tier.stats().evictions, 3);
+    for (int i : { 4, 5, 6 })
+        ASSERT_EQ(tier.get(i).value(), i * 2);
+
+    file_cache_tier<int, ::std::string> small{ make_temp_file(), 16 };
+    ASSERT_FALSE(small.put(1, ::std::string(100, 'x')));
+}
+
+TEST(file_cache_tier, failed_compaction)
+{
+    const auto path = make_temp_file();
+    auto tmp_path = path;
+    tmp_path += ".compacting";
+    {
+        file_cache_tier<int, int> tier{ path, 1 << 20 };
+        for (int i{}; i < 4; ++i)
+            ASSERT_TRUE(tier.put(i, i * 2));
+        tier.erase(0);
+
+        // The new file can't take the place of a non-empty directory.
+        ::std::filesystem::remove(path);
+        ::std::filesystem::create_directory(path);
+        ::std::filesystem::create_directory(path / "occupied");
+        ASSERT_THROW(tier.compact(), ::std::filesystem::filesystem_error);
+
+        ASSERT_FALSE(::std::filesystem::exists(tmp_path));
+        ASSERT_GT(tier.garbage_bytes(), 0);
+        for (int i{1}; i < 4; ++i)
+            ASSERT_EQ(tier.get(i).value(), i * 2);
+    }
+    ::std::filesystem::remove_all(path);
+}
+
+TEST(tiered_cache, spill_and_promote)
+{
+    tiered_cache<int, ::std::string> cache{ 2, make_temp_file(), 1 << 20 };
+    cache.put(1, "one"s);
+    cache.put(2, "two"s);
+    cache.put(3, "three"s);
+
+    ASSERT_EQ(cache.size(), 3);
+    ASSERT_FALSE(cache.memory_tier().contains(1));
+    ASSERT_TRUE(cache.file_tier().contains(1));
+
+    ASSERT_EQ(cache.get(1).value(), "one");
+    ASSERT_TRUE(cache.memory_tier().contains(1));
+    ASSERT_FALSE(cache.file_tier().contains(1));
+    ASSERT_TRUE(cache.file_tier().contains(2));
+
+    ASSERT_EQ(cache.memory_stats().misses(), 1);
+    ASSERT_EQ(cache.file_stats().hits, 1);
+}
+
+namespace
+{
+    struct picky_serializer : cache_serializer<::std::string>
+    {
+        static size_t encoded_size(const ::std::string& str)
+        {
+            if (str == "bad") throw ::std::runtime_error{ "can not encode" };
+            return cache_serializer<::std::string>::encoded_size(str);
+        }
+    };
+}
+
+TEST(tiered_cache, failed_spill_keeps_victim)
+{
+    tiered_cache<int, ::std::string, ::std::hash<int>, ::std::equal_to<int>, 
+                 cache_serializer<int>, picky_serializer> cache{ 1, make_temp_file(), 1 << 20 };
+    cache.put(1, "bad"s);
+    ASSERT_THROW(cache.put(2, "two"s), ::std::runtime_error);
+    ASSERT_TRUE(cache.memory_tier().contains(1));
+    ASSERT_EQ(cache.size(), 1);
+    ASSERT_EQ(cache.memory_tier().stats().evictions(), 0);
+
+    cache.put(1, "one"s);
+    cache.put(2, "two"s);
+    ASSERT_TRUE(cache.file_tier().contains(1));
+    ASSERT_EQ(cache.memory_tier().stats().evictions(), 1);
+}
+
+TEST(tiered_cache, get_or_load)
+{
+    tiered_cache<int, int> cache{ 1, make_temp_file(), 1 << 20 };
+    size_t loads{};
+    auto loader = [&loads](int k) { ++loads; return k * 10; };
+
+    ASSERT_EQ(cache.get_or_load(1, loader), 10);
+    ASSERT_EQ(cache.get_or_load(2, loader), 20);
+    ASSERT_EQ(cache.get_or_load(1, loader), 10);
+    ASSERT_EQ(cache.get_or_load(2, loader), 20);
+    ASSERT_EQ(loads, 2);
+
+    ASSERT_EQ(cache.memory_stats().hits(), 0);
+    ASSERT_EQ(cache.file_stats().hits, 2);
+    ASSERT_EQ(cache.file_stats().misses, 2);
+}
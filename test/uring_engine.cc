@@ -0,0 +1,216 @@
+#include "toolpex/uring_engine.h"
+#include "toolpex/unique_posix_fd.h"
+#include "toolpex/functional.h"
+#include "temp_file.h"
+#include "gtest/gtest.h"
+
+#include <string>
+#include <ranges>
+#include <cstdlib>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace toolpex;
+using namespace ::std::string_literals;
+
+namespace r = ::std::ranges;
+namespace rv = ::std::ranges::views;
+
+namespace
+{
+    ::std::string to_string(const buffer& b)
+    {
+        return b.flattened_view() | rv::transform(byte_to_char) | r::to<::std::string>();
+    }
+
+    callback_promise<size_t> record_to(size_t& n)
+    {
+        return { [&n](future_frame<size_t> ff) { n = ff.value(); } };
+    }
+}
+
+TEST(uring_engine, pipe)
+{
+    uring_engine engine{ 8 };
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    unique_posix_fd rfd{ fds[0] }, wfd{ fds[1] };
+
+    buffer out, in;
+    out.append("hello uring"s);
+
+    size_t wrote{}, read{};
+    engine.submit_write(wfd, out, record_to(wrote));
+    engine.submit_read(rfd, in, record_to(read));
+    ASSERT_EQ(engine.in_flight(), 2);
+    ASSERT_EQ(engine.submit(), 2);
+    while (engine.in_flight()) engine.wait();
+
+    ASSERT_EQ(wrote, 11);
+    ASSERT_EQ(read, 11);
+    ASSERT_TRUE(out.next_readable_span().empty());
+    ASSERT_EQ(to_string(in), "hello uring");
+}
+
+TEST(uring_engine, socketpair_batch)
+{
+    uring_engine engine{ 4 };
+    int fds[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    unique_posix_fd a{ fds[0] }, b{ fds[1] };
+
+    constexpr size_t n = 16;
+    buffer outs[n], ins[n];
+    size_t results[n]{};
+    for (size_t i{}; i < n; ++i)
+    {
+        outs[i].append(::std::to_string(i));
+        engine.submit_write(a, outs[i], record_to(results[i]));
+    }
+    engine.wait(n);
+    ASSERT_EQ(engine.in_flight(), 0);
+
+    size_t total_read{};
+    buffer in;
+    while (total_read < 22) // "0".."9" and "10".."15"
+    {
+        size_t nread{};
+        engine.submit_read(b, in, record_to(nread));
+        engine.wait();
+        total_read += nread;
+    }
+    ASSERT_EQ(to_string(in), "0123456789101112131415");
+    // Reads keep filling the same block.
+    ASSERT_EQ(in.blocks().size(), 1);
+}
+
+TEST(uring_engine, file_offset_and_error)
+{
+    uring_engine engine;
+    unique_posix_fd fd = toolpex_test::open_unlinked_temp_file();
+
+    buffer out;
+    out.append("0123456789"s);
+    size_t wrote{};
+    engine.submit_write(fd, out, record_to(wrote), 100);
+    engine.wait();
+    ASSERT_EQ(wrote, 10);
+
+    buffer in;
+    size_t nread{};
+    engine.submit_read(fd, in, record_to(nread), 105);
+    engine.wait();
+    ASSERT_EQ(to_string(in), "56789");
+
+    bool failed{};
+    buffer dummy;
+    engine.submit_read(-1, dummy, { [&failed](future_frame<size_t> ff) { 
+        failed = !ff.safely_done();
+        (void)ff.get_exception();
+    }});
+    engine.wait();
+    ASSERT_TRUE(failed);
+}
+
+TEST(uring_engine, registered_arena)
+{
+    uring_engine engine{ 8 };
+    engine.register_arena(4, 4096);
+    ASSERT_NE(engine.registered_resource(), nullptr);
+
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    unique_posix_fd rfd{ fds[0] }, wfd{ fds[1] };
+
+    buffer out{ 4096, engine.registered_resource() };
+    buffer in{ 4096, engine.registered_resource() };
+    out.append("fixed buffers"s);
+
+    size_t wrote{}, read{};
+    engine.submit_write(wfd, out, record_to(wrote));
+    engine.submit_read(rfd, in, record_to(read));
+    while (engine.in_flight()) engine.wait();
+    ASSERT_EQ(to_string(in), "fixed buffers");
+}
+
+TEST(uring_engine, callback_resubmits)
+{
+    uring_engine engine{ 1 };
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    unique_posix_fd rfd{ fds[0] }, wfd{ fds[1] };
+
+    constexpr size_t n = 4;
+    buffer outs[n];
+    size_t results[n]{};
+    for (size_t i{}; i < n; ++i)
+        outs[i].append(::std::to_string(i));
+
+    // The callback submits more than the CQ ring could hold, which waits and reaps in it.
+    engine.submit_write(wfd, outs[0], { [&](future_frame<size_t> ff) {
+        results[0] = ff.value();
+        engine.submit_write(wfd, outs[2], record_to(results[2]));
+        engine.submit_write(wfd, outs[3], record_to(results[3]));
+    }});
+    engine.submit_write(wfd, outs[1], record_to(results[1]));
+    while (engine.in_flight()) engine.wait();
+
+    for (size_t i{}; i < n; ++i)
+        ASSERT_EQ(results[i], 1);
+}
+
+TEST(uring_engine, throwing_callback)
+{
+    uring_engine engine{ 4 };
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    unique_posix_fd rfd{ fds[0] }, wfd{ fds[1] };
+
+    constexpr size_t n = 3;
+    buffer outs[n];
+    size_t results[n]{};
+    for (size_t i{}; i < n; ++i)
+        outs[i].append(::std::to_string(i));
+
+    engine.submit_write(wfd, outs[0], { [](future_frame<size_t>) { 
+        throw ::std::runtime_error{ "callback failed" }; 
+    }});
+    engine.submit_write(wfd, outs[1], record_to(results[1]));
+    engine.submit_write(wfd, outs[2], record_to(results[2]));
+    ASSERT_THROW(engine.wait(n), ::std::runtime_error);
+
+    // The completions around the throwing one are not lost.
+    ASSERT_EQ(engine.in_flight(), 0);
+    ASSERT_EQ(results[1], 1);
+    ASSERT_EQ(results[2], 1);
+    for (const auto& out : outs)
+        ASSERT_EQ(out.readable_bytes(), 0);
+}
+
+TEST(uring_engine, misuses)
+{
+    uring_engine engine{ 4 };
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    unique_posix_fd rfd{ fds[0] }, wfd{ fds[1] };
+
+    buffer empty;
+    size_t wrote{};
+    ASSERT_THROW(engine.submit_write(wfd, empty, record_to(wrote)), ::std::invalid_argument);
+    ASSERT_EQ(engine.in_flight(), 0);
+
+    // Written while the read is in flight.
+    buffer in;
+    bool failed{};
+    engine.submit_read(rfd, in, { [&failed](future_frame<size_t> ff) { 
+        failed = !ff.safely_done();
+        (void)ff.get_exception();
+    }});
+    engine.submit();
+    in.append("x"s);
+    ASSERT_EQ(::write(wfd, "hello", 5), 5);
+    engine.wait();
+    ASSERT_TRUE(failed);
+    ASSERT_EQ(in.readable_bytes(), 1);
+}
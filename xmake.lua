@@ -5,6 +5,22 @@ add_requires(
     "concurrentqueue master", 
     "libuuid"
 )
+
+option("lz4")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Enable the LZ4 buffer codec")
+option_end()
+
+option("zstd")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Enable the zstd buffer codec")
+option_end()
+
+if has_config("lz4") then add_requires("lz4") end
+if has_config("zstd") then add_requires("zstd") end
+
 set_policy("build.warning", true)
 if is_mode("debug") then
     add_cxxflags("-fno-inline", {force = true})
@@ -20,6 +36,21 @@ target("toolpex")
     add_packages("libuuid")
     add_files("src/*.cc")
     add_includedirs("include", {public = true})
+    if has_config("lz4") then
+        add_packages("lz4", {public = true})
+        add_defines("TOOLPEX_WITH_LZ4", {public = true})
+    end
+    if has_config("zstd") then
+        add_packages("zstd", {public = true})
+        add_defines("TOOLPEX_WITH_ZSTD", {public = true})
+    end
     on_run(function (target)
         --nothing
     end)
+
+target("codec_bench")
+    set_kind("binary")
+    set_default(false)
+    set_languages("c++23", "c17")
+    add_deps("toolpex")
+    add_files("benchmark/codec_bench.cc")